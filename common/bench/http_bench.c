@@ -0,0 +1,186 @@
+/**
+ * Request latency with a new curl handle per request, as the apps used to
+ * do it, against a long-lived HttpClient.
+ *
+ * usage: http_bench URL [REQUESTS] [CA_FILE]
+ *
+ * Sends REQUESTS (default 200) GET requests to URL each way, one after the
+ * other, and prints the median, 95th percentile and mean time per request
+ * and how many requests opened a new connection.
+ *
+ * Then sends them again from three threads at once, laid out like the
+ * scanner's: one client on the main loop's checks, batches of
+ * BATCH_CLIENTS clients replaying the journal, and one client syncing the
+ * pass store.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+
+#include "httpclient.h"
+
+// Clients of a journal replay batch, JOURNAL_BATCH of the scanner
+#define BATCH_CLIENTS 8
+
+typedef struct {
+    const char* name;
+    const char* url;
+    int count;
+    int batch;
+    int64_t* times;
+} Worker_t;
+
+static size_t discard(char* data, size_t size, size_t nmemb, void* user_data) {
+    (void)data;
+    (void)user_data;
+    return size * nmemb;
+}
+
+static int compare(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char* name, int64_t* times, int count, int connects, int failures) {
+    int64_t sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += times[i];
+    }
+    qsort(times, count, sizeof(times[0]), compare);
+    printf("%-12s p50 %7.2f ms  p95 %7.2f ms  mean %7.2f ms  connects %4d  failures %d\n",
+           name,
+           times[count / 2] / 1000.0,
+           times[count * 95 / 100] / 1000.0,
+           sum / 1000.0 / count,
+           connects,
+           failures);
+}
+
+// The way the apps sent requests before HttpClient: everything set up and
+// torn down around each request
+static void bench_per_request(const char* url, const char* ca_file, int count, int64_t* times) {
+    int connects = 0;
+    int failures = 0;
+
+    for (int i = 0; i < count; i++) {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        CURL* curl = curl_easy_init();
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard);
+        if (ca_file) {
+            curl_easy_setopt(curl, CURLOPT_CAINFO, ca_file);
+        }
+        CURLcode res = curl_easy_perform(curl);
+
+        long new_connects = 0;
+        curl_off_t total  = 0;
+        curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connects);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+        connects += new_connects > 0;
+        failures += res != CURLE_OK;
+        times[i] = total;
+
+        curl_easy_cleanup(curl);
+        curl_global_cleanup();
+    }
+    report("per request", times, count, connects, failures);
+}
+
+static void bench_client(const char* url, int count, int64_t* times) {
+    HttpClient_t* client = httpClientNew();
+    HttpResponse_t response;
+    int connects = 0;
+    int failures = 0;
+
+    for (int i = 0; i < count; i++) {
+        failures += !httpClientGet(client, url, NULL, &response) || response.status != 200;
+        connects += response.newConnection;
+        times[i] = response.totalUs;
+    }
+    httpClientFree(client);
+    report("HttpClient", times, count, connects, failures);
+}
+
+// One thread of the scanner's layout, batch clients at a time
+static void* run_worker(void* user_data) {
+    Worker_t* worker = user_data;
+    HttpClient_t* clients[BATCH_CLIENTS];
+    const char* urls[BATCH_CLIENTS];
+    HttpResponse_t responses[BATCH_CLIENTS];
+    int connects = 0;
+    int failures = 0;
+    int done     = 0;
+
+    for (int i = 0; i < worker->batch; i++) {
+        clients[i] = httpClientNew();
+        urls[i]    = worker->url;
+    }
+    while (done < worker->count) {
+        int size = worker->count - done < worker->batch ? worker->count - done : worker->batch;
+        if (size == 1) {
+            httpClientGet(clients[0], worker->url, NULL, &responses[0]);
+        } else {
+            httpClientGetBatch(clients, urls, size, 10000, responses);
+        }
+        for (int i = 0; i < size; i++) {
+            failures += responses[i].status != 200;
+            connects += responses[i].newConnection;
+            worker->times[done++] = responses[i].totalUs;
+        }
+    }
+    for (int i = 0; i < worker->batch; i++) {
+        httpClientFree(clients[i]);
+    }
+    report(worker->name, worker->times, worker->count, connects, failures);
+    return NULL;
+}
+
+static void bench_threads(const char* url, int count, int64_t* times) {
+    Worker_t workers[] = {
+        {"checks", url, count, 1, times},
+        {"journal", url, count, BATCH_CLIENTS, times + count},
+        {"pass store", url, count, 1, times + 2 * count},
+    };
+    const size_t count_threads = sizeof(workers) / sizeof(workers[0]);
+    pthread_t threads[sizeof(workers) / sizeof(workers[0])];
+
+    for (size_t i = 0; i < count_threads; i++) {
+        pthread_create(&threads[i], NULL, run_worker, &workers[i]);
+    }
+    for (size_t i = 0; i < count_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s URL [REQUESTS] [CA_FILE]\n", argv[0]);
+        return 1;
+    }
+    const char* url     = argv[1];
+    int count           = argc > 2 ? atoi(argv[2]) : 200;
+    const char* ca_file = argc > 3 ? argv[3] : NULL;
+    if (count < 1) {
+        count = 1;
+    }
+
+    openlog("http_bench", LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_WARNING));
+
+    int64_t* times = malloc(3 * count * sizeof(int64_t));
+    bench_per_request(url, ca_file, count, times);
+
+    if (!httpClientGlobalInit(ca_file)) {
+        return 1;
+    }
+    bench_client(url, count, times);
+    bench_threads(url, count, times);
+    httpClientGlobalCleanup();
+
+    free(times);
+    return 0;
+}
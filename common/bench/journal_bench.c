@@ -0,0 +1,136 @@
+/**
+ * Append and replay throughput of the scan journal.
+ *
+ * usage: journal_bench URL [RECORDS] [BATCH] [CA_FILE]
+ *
+ * Appends RECORDS (default 2000) scans to a journal in the current
+ * directory, once with a sync after every record and once with a sync per
+ * batch, then replays them to URL as GET requests, first one at a time and
+ * then BATCH (default 8) side by side, and prints the records per second of
+ * each.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "httpclient.h"
+#include "journal.h"
+
+#define JOURNAL_PATH "journal_bench.jrn"
+#define MAX_BATCH    64
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fill a new journal, syncing every sync_every records
+static Journal_t* fill(int records, int sync_every) {
+    unlink(JOURNAL_PATH);
+    Journal_t* journal = journalOpen(JOURNAL_PATH, (size_t)records * 64 + 4096);
+    if (!journal) {
+        exit(1);
+    }
+
+    double start = now_s();
+    for (int i = 0; i < records; i++) {
+        char text[32];
+        int size = snprintf(text, sizeof(text), "BENCH-PASS-%06d", i);
+        journalAppend(journal, (int64_t)i, text, (size_t)size);
+        if ((i + 1) % sync_every == 0) {
+            journalSync(journal);
+        }
+    }
+    journalSync(journal);
+    printf("append, sync every %3d  %9.0f records/s\n", sync_every, records / (now_s() - start));
+    return journal;
+}
+
+// Replay the journal, batch requests at a time, until it is empty
+static void replay(Journal_t* journal, const char* url, int batch, HttpClient_t* const* clients) {
+    JournalRecord_t records[MAX_BATCH];
+    HttpResponse_t responses[MAX_BATCH];
+    char* urls[MAX_BATCH];
+    int records_total = (int)journalPending(journal);
+    int requests      = 0;
+    HttpClientStats_t before;
+    HttpClientStats_t after;
+
+    httpClientGetStats(&before);
+    double start = now_s();
+    size_t count;
+    while ((count = journalRead(journal, records, (size_t)batch)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            urls[i] = malloc(strlen(url) + records[i].size + 32);
+            sprintf(urls[i], "%s?scandata=%.*s&scanned=%lld", url, (int)records[i].size,
+                    (const char*)records[i].data, (long long)records[i].time);
+        }
+        httpClientGetBatch(clients, (const char* const*)urls, count, 10000, responses);
+        requests += (int)count;
+
+        // Only an unbroken run of answers from the oldest on is consumed
+        size_t acked = 0;
+        while (acked < count && responses[acked].status == 200) {
+            acked++;
+        }
+        for (size_t i = 0; i < count; i++) {
+            free(urls[i]);
+        }
+        if (acked == 0) {
+            fprintf(stderr, "replay got no answer, giving up\n");
+            break;
+        }
+        journalAck(journal, acked);
+        journalSync(journal);
+    }
+    double elapsed = now_s() - start;
+    httpClientGetStats(&after);
+    printf("replay, batch %3d       %9.0f records/s  (%d records, %d requests, %llu connects, %.2f s)\n",
+           batch, records_total / elapsed, records_total, requests,
+           (unsigned long long)(after.connects - before.connects), elapsed);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s URL [RECORDS] [BATCH] [CA_FILE]\n", argv[0]);
+        return 1;
+    }
+    const char* url = argv[1];
+    int records     = argc > 2 ? atoi(argv[2]) : 2000;
+    int batch       = argc > 3 ? atoi(argv[3]) : 8;
+    if (records < 1 || batch < 1 || batch > MAX_BATCH) {
+        fprintf(stderr, "RECORDS must be at least 1 and BATCH 1 to %d\n", MAX_BATCH);
+        return 1;
+    }
+    if (!httpClientGlobalInit(argc > 4 ? argv[4] : NULL)) {
+        return 1;
+    }
+
+    HttpClient_t* clients[MAX_BATCH];
+    for (int i = 0; i < batch; i++) {
+        clients[i] = httpClientNew();
+    }
+
+    // A sync per record is what an unbatched journal costs
+    journalClose(fill(records < 500 ? records : 500, 1));
+    Journal_t* journal = fill(records, 32);
+    replay(journal, url, 1, clients);
+    journalClose(journal);
+
+    journal = fill(records, 32);
+    replay(journal, url, batch, clients);
+    journalClose(journal);
+
+    for (int i = 0; i < batch; i++) {
+        httpClientFree(clients[i]);
+    }
+    httpClientGlobalCleanup();
+    unlink(JOURNAL_PATH);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+"""Local HTTPS stand-in for the Parkspass endpoints.
+
+Answers every GET and POST with a fixed pass validation response over
+HTTP/1.1 keep-alive, so connection reuse by the clients can be measured.
+A self-signed certificate for localhost is created next to this script on
+first use; pass it to the client as its CA file.
+
+usage: tls_stub_server.py [PORT]
+"""
+
+import http.server
+import os
+import ssl
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+CERT = os.path.join(HERE, "stub_cert.pem")
+KEY = os.path.join(HERE, "stub_key.pem")
+BODY = b'{"result":"success","message":"pass found","checkin":"bench"}'
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    # Headers and body are written separately, Nagle would hold the body
+    # back until the client's delayed ACK
+    disable_nagle_algorithm = True
+
+    def answer(self):
+        length = int(self.headers.get("Content-Length") or 0)
+        if length:
+            self.rfile.read(length)
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(BODY)))
+        self.end_headers()
+        self.wfile.write(BODY)
+
+    do_GET = answer
+    do_POST = answer
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main():
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 8443
+    if not os.path.exists(CERT):
+        subprocess.run(["openssl", "req", "-x509", "-newkey", "ec", "-pkeyopt", "ec_paramgen_curve:prime256v1",
+                        "-nodes", "-days", "365", "-subj", "/CN=localhost",
+                        "-addext", "subjectAltName=DNS:localhost,IP:127.0.0.1",
+                        "-keyout", KEY, "-out", CERT],
+                       check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(CERT, KEY)
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", port), Handler)
+    server.socket = context.wrap_socket(server.socket, server_side=True)
+    print("Serving https://localhost:%d/ with CA file %s" % (port, CERT), flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
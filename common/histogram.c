@@ -0,0 +1,72 @@
+#include "histogram.h"
+
+// Upper bound of the first bucket
+#define FIRST_BOUND_US 1000.0
+// 2^(1/4)
+#define BOUND_FACTOR 1.189207115002721
+
+static int64_t bounds[HISTOGRAM_BUCKETS];
+
+// Upper bound of every bucket, computed on first use
+static const int64_t* bucket_bounds(void) {
+    if (bounds[0] == 0) {
+        double bound = FIRST_BOUND_US;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            bounds[i] = (int64_t)bound;
+            bound *= BOUND_FACTOR;
+        }
+    }
+    return bounds;
+}
+
+void histogramAdd(Histogram_t* histogram, int64_t us) {
+    const int64_t* bound = bucket_bounds();
+    int low              = 0;
+    int high             = HISTOGRAM_BUCKETS - 1;
+
+    // First bucket whose bound is at least us, the last one if none is
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (bound[middle] >= us) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    histogram->counts[low]++;
+    histogram->total++;
+}
+
+int64_t histogramPercentile(const Histogram_t* histogram, double fraction) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(fraction * histogram->total + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            return bucket_bounds()[i];
+        }
+    }
+    return bucket_bounds()[HISTOGRAM_BUCKETS - 1];
+}
+
+void histogramDecay(Histogram_t* histogram) {
+    histogram->total = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        histogram->counts[i] /= 2;
+        histogram->total += histogram->counts[i];
+    }
+}
+
+void histogramMerge(Histogram_t* histogram, const Histogram_t* other) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        histogram->counts[i] += other->counts[i];
+    }
+    histogram->total += other->total;
+}
@@ -0,0 +1,60 @@
+/**
+ * A latency histogram with logarithmic buckets.
+ *
+ * Bucket bounds grow by a factor of 2^(1/4), about 19%, from 1 ms up to
+ * about a minute, so percentiles are accurate to within one bucket at any
+ * scale without storing the samples. Not thread safe.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define HISTOGRAM_BUCKETS 64
+
+typedef struct {
+    /// Samples per bucket, the last one also counts everything longer.
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+} Histogram_t;
+
+/**
+ * brief Add a sample.
+ *
+ * param histogram The histogram.
+ * param us Latency in microseconds.
+ */
+void histogramAdd(Histogram_t* histogram, int64_t us);
+
+/**
+ * brief Get a percentile.
+ *
+ * param histogram The histogram.
+ * param fraction Fraction of the samples at or below the result, e.g. 0.95.
+ * return Upper bound in microseconds of the bucket holding the percentile,
+ *        0 if there are no samples.
+ */
+int64_t histogramPercentile(const Histogram_t* histogram, double fraction);
+
+/**
+ * brief Halve every count, so older samples weigh less than newer ones.
+ *
+ * param histogram The histogram.
+ */
+void histogramDecay(Histogram_t* histogram);
+
+/**
+ * brief Add the samples of one histogram to another.
+ *
+ * param histogram Histogram to add to.
+ * param other Histogram to add.
+ */
+void histogramMerge(Histogram_t* histogram, const Histogram_t* other);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,352 @@
+// strdup() is POSIX, the apps compile with -std=c17
+#define _POSIX_C_SOURCE 200809L
+
+#include "httpclient.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+// Idle time before the first keep-alive probe and between probes, keeps
+// NAT mappings of the cellular backhaul from expiring under a connection
+#define KEEPALIVE_IDLE_S     30
+#define KEEPALIVE_INTERVAL_S 15
+// Idle connections are reused for this long, curl defaults to 118 s
+#define MAX_CONNECTION_AGE_S 600
+// Host names are looked up again after this long, curl defaults to 60 s
+#define DNS_CACHE_S 300
+// Initial size of a client's response buffer, grown as needed
+#define RESPONSE_CAPACITY 4096
+
+struct HttpClient {
+    CURL* curl;
+    char error[CURL_ERROR_SIZE];
+    // Response body, kept between requests so it is not reallocated
+    char* body;
+    size_t size;
+    size_t capacity;
+    // Multi handle of the batches this client leads, keeps their connections
+    CURLM* batch;
+};
+
+static CURLSH* share = NULL;
+static char* ca_file  = NULL;
+static pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+static atomic_uint_fast64_t stat_requests;
+static atomic_uint_fast64_t stat_failures;
+static atomic_uint_fast64_t stat_connects;
+static atomic_uint_fast64_t stat_total_us;
+
+static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* user_data);
+static void unlock_share(CURL* handle, curl_lock_data data, void* user_data);
+static size_t write_body(char* data, size_t size, size_t nmemb, void* user_data);
+static void begin(HttpClient_t* client, const char* url);
+static size_t read_body(char* buffer, size_t size, size_t nitems, void* user_data);
+static int seek_body(void* user_data, curl_off_t offset, int origin);
+
+bool httpClientGlobalInit(const char* caFile) {
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+        syslog(LOG_ERR, "Failed to initialize CURL");
+        return false;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&share_locks[i], NULL);
+    }
+    share = curl_share_init();
+    if (!share) {
+        syslog(LOG_ERR, "Failed to create CURL share handle");
+        curl_global_cleanup();
+        return false;
+    }
+    // Same variable the curl tool reads, lets a test server be trusted
+    if (!caFile && getenv("CURL_CA_BUNDLE") && *getenv("CURL_CA_BUNDLE")) {
+        caFile = getenv("CURL_CA_BUNDLE");
+    }
+    ca_file = caFile ? strdup(caFile) : NULL;
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_share);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    // Not the connection cache: the clients run on several threads at once,
+    // and curl does not support sharing connections between threads. Each
+    // client keeps its own connection, those of an HttpMulti_t share the
+    // multi handle's.
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return true;
+}
+
+void httpClientGlobalCleanup(void) {
+    curl_share_cleanup(share);
+    share = NULL;
+    free(ca_file);
+    ca_file = NULL;
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&share_locks[i]);
+    }
+    curl_global_cleanup();
+}
+
+HttpClient_t* httpClientNew(void) {
+    HttpClient_t* client = calloc(1, sizeof(HttpClient_t));
+    if (!client) {
+        return NULL;
+    }
+    client->body     = malloc(RESPONSE_CAPACITY);
+    client->capacity = RESPONSE_CAPACITY;
+    client->curl     = curl_easy_init();
+    if (!client->body || !client->curl) {
+        syslog(LOG_ERR, "Failed to initialize CURL");
+        httpClientFree(client);
+        return NULL;
+    }
+
+    CURL* curl = client->curl;
+    curl_easy_setopt(curl, CURLOPT_SHARE, share);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    if (ca_file) {
+        curl_easy_setopt(curl, CURLOPT_CAINFO, ca_file);
+    }
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, client->error);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);  // Follow redirects
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);       // Limit the number of redirects
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, (long)KEEPALIVE_IDLE_S);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, (long)KEEPALIVE_INTERVAL_S);
+    curl_easy_setopt(curl, CURLOPT_MAXAGE_CONN, (long)MAX_CONNECTION_AGE_S);
+    curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, (long)DNS_CACHE_S);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, client);
+    return client;
+}
+
+void httpClientFree(HttpClient_t* client) {
+    if (!client) {
+        return;
+    }
+    if (client->batch) {
+        curl_multi_cleanup(client->batch);
+    }
+    if (client->curl) {
+        curl_easy_cleanup(client->curl);
+    }
+    free(client->body);
+    free(client);
+}
+
+bool httpClientGet(HttpClient_t* client,
+                   const char* url,
+                   const struct curl_slist* headers,
+                   HttpResponse_t* response) {
+    CURL* curl = httpClientBeginGet(client, url, headers);
+    return httpClientFinish(client, curl_easy_perform(curl), response);
+}
+
+bool httpClientPost(HttpClient_t* client,
+                    const char* url,
+                    const struct curl_slist* headers,
+                    const char* body,
+                    size_t size,
+                    HttpResponse_t* response) {
+    CURL* curl = httpClientBeginPost(client, url, headers, body, size);
+    return httpClientFinish(client, curl_easy_perform(curl), response);
+}
+
+bool httpClientPostStream(HttpClient_t* client,
+                          const char* url,
+                          const struct curl_slist* headers,
+                          const HttpBodySource_t* source,
+                          HttpResponse_t* response) {
+    CURL* curl = client->curl;
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)-1);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_body);
+    curl_easy_setopt(curl, CURLOPT_READDATA, (void*)source);
+    curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seek_body);
+    curl_easy_setopt(curl, CURLOPT_SEEKDATA, (void*)source);
+    begin(client, url);
+    bool answered = httpClientFinish(client, curl_easy_perform(curl), response);
+
+    // The source does not outlive the call
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_READDATA, NULL);
+    curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_SEEKDATA, NULL);
+    return answered;
+}
+
+size_t httpClientGetBatch(HttpClient_t* const* clients,
+                          const char* const* urls,
+                          size_t count,
+                          long timeoutMs,
+                          HttpResponse_t* responses) {
+    size_t answered = 0;
+    if (count == 0) {
+        return 0;
+    }
+    // Connections live in the multi handle, one kept from the last batch
+    // saves a connect and a TLS handshake per request
+    if (!clients[0]->batch) {
+        clients[0]->batch = curl_multi_init();
+        if (!clients[0]->batch) {
+            syslog(LOG_ERR, "Failed to initialize CURL multi handle");
+            return 0;
+        }
+    }
+    CURLM* multi = clients[0]->batch;
+
+    for (size_t i = 0; i < count; i++) {
+        CURL* curl = httpClientBeginGet(clients[i], urls[i], NULL);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeoutMs);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, (char*)&responses[i]);
+        responses[i].status = 0;
+        curl_multi_add_handle(multi, curl);
+    }
+
+    // Run until every request is done, each answer is collected as it
+    // comes in
+    int running = (int)count;
+    while (running > 0) {
+        if (curl_multi_perform(multi, &running) != CURLM_OK ||
+            (running > 0 && curl_multi_wait(multi, NULL, 0, 1000, NULL) != CURLM_OK)) {
+            break;
+        }
+        CURLMsg* message;
+        int pending;
+        while ((message = curl_multi_info_read(multi, &pending))) {
+            HttpResponse_t* response = NULL;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char**)&response);
+            size_t index = (size_t)(response - responses);
+            if (message->msg == CURLMSG_DONE &&
+                httpClientFinish(clients[index], message->data.result, response)) {
+                answered++;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        curl_multi_remove_handle(multi, clients[i]->curl);
+    }
+    return answered;
+}
+
+CURL* httpClientBeginGet(HttpClient_t* client, const char* url, const struct curl_slist* headers) {
+    curl_easy_setopt(client->curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, headers);
+    begin(client, url);
+    return client->curl;
+}
+
+CURL* httpClientBeginPost(HttpClient_t* client,
+                          const char* url,
+                          const struct curl_slist* headers,
+                          const char* body,
+                          size_t size) {
+    curl_easy_setopt(client->curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(client->curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(client->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)size);
+    begin(client, url);
+    return client->curl;
+}
+
+bool httpClientFinish(HttpClient_t* client, CURLcode result, HttpResponse_t* response) {
+    long connects     = 0;
+    curl_off_t total  = 0;
+    response->status  = 0;
+    curl_easy_getinfo(client->curl, CURLINFO_NUM_CONNECTS, &connects);
+    curl_easy_getinfo(client->curl, CURLINFO_TOTAL_TIME_T, &total);
+    client->body[client->size] = '\0';
+    response->body             = client->body;
+    response->size             = client->size;
+    response->totalUs          = total;
+    response->newConnection    = connects > 0;
+    response->timedOut         = result == CURLE_OPERATION_TIMEDOUT;
+
+    atomic_fetch_add_explicit(&stat_requests, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_connects, connects > 0 ? 1 : 0, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stat_total_us, (uint_fast64_t)total, memory_order_relaxed);
+    if (result != CURLE_OK) {
+        atomic_fetch_add_explicit(&stat_failures, 1, memory_order_relaxed);
+        syslog(LOG_INFO,
+               "Request failed: %s",
+               client->error[0] ? client->error : curl_easy_strerror(result));
+        return false;
+    }
+    curl_easy_getinfo(client->curl, CURLINFO_RESPONSE_CODE, &response->status);
+    return true;
+}
+
+char* httpClientEscape(HttpClient_t* client, const char* text) {
+    return curl_easy_escape(client ? client->curl : NULL, text, 0);
+}
+
+void httpClientGetStats(HttpClientStats_t* stats) {
+    stats->requests = atomic_load_explicit(&stat_requests, memory_order_relaxed);
+    stats->failures = atomic_load_explicit(&stat_failures, memory_order_relaxed);
+    stats->connects = atomic_load_explicit(&stat_connects, memory_order_relaxed);
+    stats->totalUs  = atomic_load_explicit(&stat_total_us, memory_order_relaxed);
+}
+
+// Clear what the previous request left behind and set the URL
+static void begin(HttpClient_t* client, const char* url) {
+    client->size     = 0;
+    client->error[0] = '\0';
+    curl_easy_setopt(client->curl, CURLOPT_URL, url);
+}
+
+// Takes the next part of a streamed request body from its source
+static size_t read_body(char* buffer, size_t size, size_t nitems, void* user_data) {
+    const HttpBodySource_t* source = user_data;
+    return source->read(buffer, size * nitems, source->userData);
+}
+
+// Only rewinding to the start is ever asked for
+static int seek_body(void* user_data, curl_off_t offset, int origin) {
+    const HttpBodySource_t* source = user_data;
+    if (offset != 0 || origin != SEEK_SET || !source->rewind || !source->rewind(source->userData)) {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    return CURL_SEEKFUNC_OK;
+}
+
+// Collects the response from the server into the client's buffer
+static size_t write_body(char* data, size_t size, size_t nmemb, void* user_data) {
+    HttpClient_t* client = user_data;
+    size_t length        = size * nmemb;
+
+    // Keep room for the terminating NUL
+    if (client->size + length + 1 > client->capacity) {
+        size_t capacity = client->capacity;
+        while (client->size + length + 1 > capacity) {
+            capacity *= 2;
+        }
+        char* body = realloc(client->body, capacity);
+        if (!body) {
+            return 0;
+        }
+        client->body     = body;
+        client->capacity = capacity;
+    }
+    memcpy(client->body + client->size, data, length);
+    client->size += length;
+    return length;
+}
+
+static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* user_data) {
+    (void)handle;
+    (void)access;
+    (void)user_data;
+    pthread_mutex_lock(&share_locks[data]);
+}
+
+static void unlock_share(CURL* handle, curl_lock_data data, void* user_data) {
+    (void)handle;
+    (void)user_data;
+    pthread_mutex_unlock(&share_locks[data]);
+}
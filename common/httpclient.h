@@ -0,0 +1,248 @@
+/**
+ * A long-lived HTTP client shared by the apps in this repository.
+ *
+ * Creating a curl handle per request makes every request look up the host,
+ * open a TCP connection and do a full TLS handshake before the request is
+ * even sent. A client keeps its curl handle, so the connection stays open
+ * between requests and is probed with TCP keep-alive while idle. All clients
+ * of the process also share a curl share handle holding the DNS cache and
+ * the TLS sessions, so even a new client resumes the TLS session of an
+ * earlier one instead of doing a full handshake. Connections are not shared,
+ * since clients are used on several threads at once.
+ *
+ * Call httpClientGlobalInit() once at startup, before any thread uses a
+ * client.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * brief The answer to a request.
+ *
+ * The body belongs to the client and is valid until its next request.
+ */
+typedef struct {
+    /// HTTP status code, 0 if no answer was received.
+    long status;
+    /// Response body, NUL terminated.
+    const char* body;
+    size_t size;
+    /// Microseconds from the start of the request to the end of the answer.
+    int64_t totalUs;
+    /// Whether a new connection had to be opened for the request.
+    bool newConnection;
+    /// Whether the request ran out of time before an answer.
+    bool timedOut;
+} HttpResponse_t;
+
+/**
+ * brief Counters of the requests made by all clients.
+ */
+typedef struct {
+    uint64_t requests;
+    /// Requests that got no answer.
+    uint64_t failures;
+    /// Requests that opened a new connection instead of reusing one.
+    uint64_t connects;
+    /// Sum of the request times in microseconds.
+    uint64_t totalUs;
+} HttpClientStats_t;
+
+typedef struct HttpClient HttpClient_t;
+
+/**
+ * brief Where httpClientPostStream() takes the request body from.
+ */
+typedef struct {
+    /// Fill buffer with up to size bytes of the body. Return how many were
+    /// written, 0 once the body is complete or CURL_READFUNC_ABORT to give
+    /// up on the request.
+    size_t (*read)(char* buffer, size_t size, void* userData);
+    /// Start the body over, when the request has to be sent again on a new
+    /// connection. Return false if that is not possible. May be NULL.
+    bool (*rewind)(void* userData);
+    void* userData;
+} HttpBodySource_t;
+
+/**
+ * brief Initialise curl and the share handle used by all clients.
+ *
+ * Must be called once before any other function, while the process has a
+ * single thread.
+ *
+ * param caFile File of CA certificates to verify servers with, NULL for the
+ *        one named by CURL_CA_BUNDLE if that is set, else the system's.
+ * return false if curl could not be initialised.
+ */
+bool httpClientGlobalInit(const char* caFile);
+
+/**
+ * brief Release what httpClientGlobalInit() set up, after all clients are
+ * freed.
+ */
+void httpClientGlobalCleanup(void);
+
+/**
+ * brief Create a client.
+ *
+ * A client must only be used by one thread at a time.
+ *
+ * return The client, NULL if curl failed. Free with httpClientFree().
+ */
+HttpClient_t* httpClientNew(void);
+
+/**
+ * brief Close the client's connection and free it.
+ *
+ * param client Client to free, may be NULL.
+ */
+void httpClientFree(HttpClient_t* client);
+
+/**
+ * brief Send a GET request.
+ *
+ * param client The client.
+ * param url Full URL including the query.
+ * param headers Extra request headers, may be NULL.
+ * param response Filled with the answer.
+ * return false if no answer was received, the reason is logged.
+ */
+bool httpClientGet(HttpClient_t* client,
+                   const char* url,
+                   const struct curl_slist* headers,
+                   HttpResponse_t* response);
+
+/**
+ * brief Send a POST request.
+ *
+ * param client The client.
+ * param url Full URL.
+ * param headers Extra request headers, may be NULL.
+ * param body Request body, not copied, must stay valid during the call.
+ * param size Length of the body.
+ * param response Filled with the answer.
+ * return false if no answer was received, the reason is logged.
+ */
+bool httpClientPost(HttpClient_t* client,
+                    const char* url,
+                    const struct curl_slist* headers,
+                    const char* body,
+                    size_t size,
+                    HttpResponse_t* response);
+
+/**
+ * brief Send a POST request with a body read while it is sent.
+ *
+ * The size of the body need not be known up front. Over HTTP/1.1 it goes
+ * out with chunked transfer encoding if headers hold
+ * "Transfer-Encoding: chunked", so only what fits in the upload buffer is
+ * ever held.
+ *
+ * param client The client.
+ * param url Full URL.
+ * param headers Extra request headers, may be NULL.
+ * param source Where the body is read from.
+ * param response Filled with the answer.
+ * return false if no answer was received, the reason is logged.
+ */
+bool httpClientPostStream(HttpClient_t* client,
+                          const char* url,
+                          const struct curl_slist* headers,
+                          const HttpBodySource_t* source,
+                          HttpResponse_t* response);
+
+/**
+ * brief Send several GET requests side by side and wait for all of them.
+ *
+ * Each request runs on a client of its own, so on a connection of its
+ * own, and a batch takes about as long as its slowest request. The
+ * connections are kept by the first client and reused by the next batch
+ * it leads, so a batch should be sent from a single thread with the same
+ * clients every time.
+ *
+ * param clients One client per request.
+ * param urls Full URLs including the query.
+ * param count Number of requests.
+ * param timeoutMs Most milliseconds a request may take, 0 for no limit.
+ * param responses Filled with the answers, status 0 for a request without
+ *        one. The body stays valid until the client is used again.
+ * return Number of requests that got an answer.
+ */
+size_t httpClientGetBatch(HttpClient_t* const* clients,
+                          const char* const* urls,
+                          size_t count,
+                          long timeoutMs,
+                          HttpResponse_t* responses);
+
+/**
+ * brief Set up a GET request without sending it.
+ *
+ * For running the request some other way than httpClientGet(), e.g. on a
+ * curl multi handle, see httpmulti.h. Call httpClientFinish() once it is
+ * done.
+ *
+ * param client The client.
+ * param url Full URL including the query.
+ * param headers Extra request headers, may be NULL. Must stay valid until
+ *        httpClientFinish().
+ * return The client's curl handle, ready to perform.
+ */
+CURL* httpClientBeginGet(HttpClient_t* client, const char* url, const struct curl_slist* headers);
+
+/**
+ * brief Set up a POST request without sending it, see httpClientBeginGet().
+ *
+ * param client The client.
+ * param url Full URL.
+ * param headers Extra request headers, may be NULL. Must stay valid until
+ *        httpClientFinish().
+ * param body Request body, not copied. Must stay valid until
+ *        httpClientFinish().
+ * param size Length of the body.
+ * return The client's curl handle, ready to perform.
+ */
+CURL* httpClientBeginPost(HttpClient_t* client,
+                          const char* url,
+                          const struct curl_slist* headers,
+                          const char* body,
+                          size_t size);
+
+/**
+ * brief Collect the answer to a request started with httpClientBeginGet()
+ * or httpClientBeginPost().
+ *
+ * param client The client.
+ * param result Result of the transfer.
+ * param response Filled with the answer.
+ * return false if no answer was received, the reason is logged.
+ */
+bool httpClientFinish(HttpClient_t* client, CURLcode result, HttpResponse_t* response);
+
+/**
+ * brief URL encode a string for use in a query.
+ *
+ * param client The client, may be NULL.
+ * param text String to encode.
+ * return The encoded string, free with curl_free(). NULL if out of memory.
+ */
+char* httpClientEscape(HttpClient_t* client, const char* text);
+
+/**
+ * brief Get the counters of all clients accumulated so far.
+ *
+ * param stats Filled with the counters.
+ */
+void httpClientGetStats(HttpClientStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
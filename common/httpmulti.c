@@ -0,0 +1,401 @@
+#include "httpmulti.h"
+
+#include <glib-unix.h>
+#include <syslog.h>
+
+// Idle clients kept for the next requests, more are freed
+#define MAX_IDLE_CLIENTS 4
+
+struct HttpMulti {
+    CURLM* multi;
+    GMainContext* context;
+    // Fires when curl wants to be called without socket activity
+    GSource* timer;
+    // Requests in flight, clients ready for the next ones and the watched
+    // sockets
+    GList* requests;
+    GSList* idle;
+    GSList* sockets;
+    guint running;
+    HttpMultiStats_t stats;
+};
+
+typedef struct Request Request_t;
+
+// One attempt at a request, the first one or the hedge
+typedef struct {
+    Request_t* request;
+    HttpClient_t* client;
+    CURL* curl;
+} Transfer_t;
+
+struct Request {
+    HttpMulti_t* multi;
+    char* url;
+    char* hedge_url;
+    const struct curl_slist* headers;
+    HttpRequestOptions_t options;
+    HttpDoneFunc done;
+    void* user_data;
+    // The first attempt and the hedge, NULL when not running
+    Transfer_t* attempts[2];
+    // Fires when the request is to be hedged
+    GSource* hedge_timer;
+    // Monotonic time the answer is due by, 0 for none
+    gint64 deadline;
+    bool hedged;
+};
+
+// The source watching one of curl's sockets
+typedef struct {
+    GSource* source;
+} Socket_t;
+
+static int on_socket_change(CURL* curl, curl_socket_t fd, int what, void* user_data, void* socket_data);
+static int on_timer_change(CURLM* curlm, long timeout_ms, void* user_data);
+static gboolean on_socket(gint fd, GIOCondition condition, gpointer user_data);
+static gboolean on_timeout(gpointer user_data);
+static gboolean on_hedge(gpointer user_data);
+static bool start_attempt(Request_t* request, int index);
+static void send_hedge(Request_t* request);
+static void cancel_attempt(Request_t* request, int index);
+static void free_request(Request_t* request);
+static void finish_transfers(HttpMulti_t* multi);
+static HttpClient_t* take_client(HttpMulti_t* multi);
+static void release_client(HttpMulti_t* multi, HttpClient_t* client);
+static void remove_socket(Socket_t* socket);
+
+HttpMulti_t* httpMultiNew(GMainContext* context) {
+    HttpMulti_t* multi = g_new0(HttpMulti_t, 1);
+
+    multi->multi = curl_multi_init();
+    if (!multi->multi) {
+        syslog(LOG_ERR, "Failed to initialize CURL multi handle");
+        g_free(multi);
+        return NULL;
+    }
+    multi->context = context ? g_main_context_ref(context) : g_main_context_ref(g_main_context_default());
+    curl_multi_setopt(multi->multi, CURLMOPT_SOCKETFUNCTION, on_socket_change);
+    curl_multi_setopt(multi->multi, CURLMOPT_SOCKETDATA, multi);
+    curl_multi_setopt(multi->multi, CURLMOPT_TIMERFUNCTION, on_timer_change);
+    curl_multi_setopt(multi->multi, CURLMOPT_TIMERDATA, multi);
+    return multi;
+}
+
+void httpMultiFree(HttpMulti_t* multi) {
+    if (!multi) {
+        return;
+    }
+    g_list_free_full(multi->requests, (GDestroyNotify)free_request);
+    multi->requests = NULL;
+    g_slist_free_full(multi->idle, (GDestroyNotify)httpClientFree);
+
+    // curl does not always report the sockets it closes here
+    curl_multi_cleanup(multi->multi);
+    for (GSList* item = multi->sockets; item; item = item->next) {
+        remove_socket(item->data);
+        g_free(item->data);
+    }
+    g_slist_free(multi->sockets);
+    if (multi->timer) {
+        g_source_destroy(multi->timer);
+        g_source_unref(multi->timer);
+    }
+    g_main_context_unref(multi->context);
+    g_free(multi);
+}
+
+bool httpMultiGet(HttpMulti_t* multi,
+                  const char* url,
+                  const struct curl_slist* headers,
+                  const HttpRequestOptions_t* options,
+                  HttpDoneFunc done,
+                  void* user_data) {
+    Request_t* request = g_new0(Request_t, 1);
+    request->multi     = multi;
+    request->url       = g_strdup(url);
+    request->headers   = headers;
+    request->done      = done;
+    request->user_data = user_data;
+    if (options) {
+        request->options = *options;
+    } else {
+        request->options.hedgeMs = -1;
+    }
+    request->hedge_url = g_strdup(request->options.hedgeUrl);
+    if (request->options.timeoutMs > 0) {
+        request->deadline = g_get_monotonic_time() + request->options.timeoutMs * 1000;
+    }
+
+    if (!start_attempt(request, 0)) {
+        free_request(request);
+        return false;
+    }
+    // A hedge only helps if it can be sent before the deadline
+    long hedge_ms = request->options.hedgeMs;
+    if (hedge_ms >= 0 && (request->options.timeoutMs <= 0 || hedge_ms < request->options.timeoutMs)) {
+        request->hedge_timer = g_timeout_source_new((guint)hedge_ms);
+        g_source_set_callback(request->hedge_timer, on_hedge, request, NULL);
+        g_source_attach(request->hedge_timer, multi->context);
+    }
+    multi->requests = g_list_prepend(multi->requests, request);
+    return true;
+}
+
+guint httpMultiRunning(const HttpMulti_t* multi) {
+    return multi->running;
+}
+
+void httpMultiGetStats(const HttpMulti_t* multi, HttpMultiStats_t* stats) {
+    *stats = multi->stats;
+}
+
+// Called by curl when a socket needs watching for other events, or no more
+static int on_socket_change(CURL* curl, curl_socket_t fd, int what, void* user_data, void* socket_data) {
+    HttpMulti_t* multi = user_data;
+    Socket_t* socket   = socket_data;
+    (void)curl;
+
+    if (socket) {
+        remove_socket(socket);
+    }
+    if (what == CURL_POLL_REMOVE) {
+        multi->sockets = g_slist_remove(multi->sockets, socket);
+        g_free(socket);
+        return 0;
+    }
+
+    if (!socket) {
+        socket         = g_new0(Socket_t, 1);
+        multi->sockets = g_slist_prepend(multi->sockets, socket);
+        curl_multi_assign(multi->multi, fd, socket);
+    }
+    GIOCondition condition = G_IO_ERR | G_IO_HUP;
+    if (what & CURL_POLL_IN) {
+        condition |= G_IO_IN;
+    }
+    if (what & CURL_POLL_OUT) {
+        condition |= G_IO_OUT;
+    }
+    socket->source = g_unix_fd_source_new(fd, condition);
+    g_source_set_callback(socket->source, G_SOURCE_FUNC(on_socket), multi, NULL);
+    g_source_attach(socket->source, multi->context);
+    return 0;
+}
+
+// Called by curl when it wants to be called back after a while, -1 for no
+// longer
+static int on_timer_change(CURLM* curlm, long timeout_ms, void* user_data) {
+    HttpMulti_t* multi = user_data;
+    (void)curlm;
+
+    if (multi->timer) {
+        g_source_destroy(multi->timer);
+        g_source_unref(multi->timer);
+        multi->timer = NULL;
+    }
+    if (timeout_ms >= 0) {
+        multi->timer = g_timeout_source_new(timeout_ms);
+        g_source_set_callback(multi->timer, on_timeout, multi, NULL);
+        g_source_attach(multi->timer, multi->context);
+    }
+    return 0;
+}
+
+static gboolean on_socket(gint fd, GIOCondition condition, gpointer user_data) {
+    HttpMulti_t* multi = user_data;
+    int events         = 0;
+    int running        = 0;
+
+    if (condition & G_IO_IN) {
+        events |= CURL_CSELECT_IN;
+    }
+    if (condition & G_IO_OUT) {
+        events |= CURL_CSELECT_OUT;
+    }
+    if (condition & (G_IO_ERR | G_IO_HUP)) {
+        events |= CURL_CSELECT_ERR;
+    }
+    // May remove this source through on_socket_change(), which is fine
+    // while it dispatches
+    curl_multi_socket_action(multi->multi, fd, events, &running);
+    finish_transfers(multi);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean on_timeout(gpointer user_data) {
+    HttpMulti_t* multi = user_data;
+    int running        = 0;
+
+    // curl may set a new timer from within the call
+    g_source_unref(multi->timer);
+    multi->timer = NULL;
+    curl_multi_socket_action(multi->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    finish_transfers(multi);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_hedge(gpointer user_data) {
+    Request_t* request = user_data;
+
+    g_source_unref(request->hedge_timer);
+    request->hedge_timer = NULL;
+    send_hedge(request);
+    return G_SOURCE_REMOVE;
+}
+
+// Start the first attempt, index 0, or the hedge, index 1
+static bool start_attempt(Request_t* request, int index) {
+    HttpMulti_t* multi   = request->multi;
+    const char* url      = request->url;
+    long fresh           = 0;
+    long timeout_ms      = 0;
+    HttpClient_t* client = take_client(multi);
+    if (!client) {
+        return false;
+    }
+
+    // A hedge to the same URL must not queue behind the stuck connection
+    if (index == 1) {
+        if (request->hedge_url) {
+            url = request->hedge_url;
+        } else {
+            fresh = 1;
+        }
+    }
+    if (request->deadline) {
+        timeout_ms = (long)((request->deadline - g_get_monotonic_time()) / 1000);
+        if (timeout_ms < 1) {
+            timeout_ms = 1;
+        }
+    }
+
+    Transfer_t* transfer = g_new0(Transfer_t, 1);
+    transfer->request    = request;
+    transfer->client     = client;
+    transfer->curl       = httpClientBeginGet(client, url, request->headers);
+    // Clients are reused, so every option is set on every request
+    curl_easy_setopt(transfer->curl, CURLOPT_FRESH_CONNECT, fresh);
+    curl_easy_setopt(transfer->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    curl_easy_setopt(transfer->curl, CURLOPT_CONNECTTIMEOUT_MS, request->options.connectTimeoutMs);
+    curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+
+    CURLMcode res = curl_multi_add_handle(multi->multi, transfer->curl);
+    if (res != CURLM_OK) {
+        syslog(LOG_ERR, "Failed to start request: %s", curl_multi_strerror(res));
+        release_client(multi, client);
+        g_free(transfer);
+        return false;
+    }
+    request->attempts[index] = transfer;
+    multi->running++;
+    return true;
+}
+
+// Send the request a second time, unless it was already or the deadline
+// has passed
+static void send_hedge(Request_t* request) {
+    if (request->hedged || (request->deadline && g_get_monotonic_time() >= request->deadline)) {
+        return;
+    }
+    request->hedged = true;
+    if (request->hedge_timer) {
+        g_source_destroy(request->hedge_timer);
+        g_source_unref(request->hedge_timer);
+        request->hedge_timer = NULL;
+    }
+    if (start_attempt(request, 1)) {
+        request->multi->stats.hedges++;
+    }
+}
+
+static void cancel_attempt(Request_t* request, int index) {
+    Transfer_t* transfer = request->attempts[index];
+    if (!transfer) {
+        return;
+    }
+    curl_multi_remove_handle(request->multi->multi, transfer->curl);
+    request->multi->running--;
+    release_client(request->multi, transfer->client);
+    g_free(transfer);
+    request->attempts[index] = NULL;
+}
+
+static void free_request(Request_t* request) {
+    cancel_attempt(request, 0);
+    cancel_attempt(request, 1);
+    if (request->hedge_timer) {
+        g_source_destroy(request->hedge_timer);
+        g_source_unref(request->hedge_timer);
+    }
+    g_free(request->url);
+    g_free(request->hedge_url);
+    g_free(request);
+}
+
+// Hand the answers of the finished requests to their callbacks
+static void finish_transfers(HttpMulti_t* multi) {
+    CURLMsg* message;
+    int pending;
+
+    while ((message = curl_multi_info_read(multi->multi, &pending))) {
+        if (message->msg != CURLMSG_DONE) {
+            continue;
+        }
+        Transfer_t* transfer = NULL;
+        CURLcode result      = message->data.result;
+        curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char**)&transfer);
+        Request_t* request = transfer->request;
+        int index          = transfer == request->attempts[0] ? 0 : 1;
+        int other          = 1 - index;
+
+        HttpResponse_t response;
+        httpClientFinish(transfer->client, result, &response);
+
+        // Without an answer, the hedge is sent early or is still awaited
+        if (response.status == 0) {
+            if (!request->hedged && request->options.hedgeMs >= 0) {
+                send_hedge(request);
+            }
+            if (request->attempts[other]) {
+                cancel_attempt(request, index);
+                continue;
+            }
+        } else if (index == 1) {
+            multi->stats.hedgeWins++;
+        }
+
+        // The other attempt is cancelled after the callback, as its answer
+        // would only be dropped
+        multi->requests = g_list_remove(multi->requests, request);
+        request->done(&response, request->user_data);
+        free_request(request);
+    }
+}
+
+// Take an idle client, or make a new one if none is
+static HttpClient_t* take_client(HttpMulti_t* multi) {
+    if (!multi->idle) {
+        return httpClientNew();
+    }
+    HttpClient_t* client = multi->idle->data;
+    multi->idle          = g_slist_delete_link(multi->idle, multi->idle);
+    return client;
+}
+
+// Keep a client for the next request, or free it if enough are kept
+static void release_client(HttpMulti_t* multi, HttpClient_t* client) {
+    if (g_slist_length(multi->idle) < MAX_IDLE_CLIENTS) {
+        multi->idle = g_slist_prepend(multi->idle, client);
+    } else {
+        httpClientFree(client);
+    }
+}
+
+static void remove_socket(Socket_t* socket) {
+    if (socket->source) {
+        g_source_destroy(socket->source);
+        g_source_unref(socket->source);
+        socket->source = NULL;
+    }
+}
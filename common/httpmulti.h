@@ -0,0 +1,124 @@
+/**
+ * HTTP requests run by a GLib main loop instead of blocking a thread.
+ *
+ * Requests are added to a curl multi handle whose sockets and timer are
+ * watched by GLib sources, so the main loop keeps dispatching everything
+ * else while requests are in flight, and any number of requests can be in
+ * flight at once. The answer is handed to a callback on the main loop.
+ *
+ * Each request runs on an HttpClient_t taken from a small pool of idle
+ * ones, so the shared caches of httpclient.h apply. Open connections are
+ * kept by the multi handle, so any request can reuse one left by another.
+ * httpClientGlobalInit() must have been called first.
+ *
+ * A request can have a deadline and be hedged: if no answer has arrived
+ * after a while, the same request is also sent to a second URL, or on a
+ * second connection to the same one, and whichever answers first wins.
+ * This cuts off the long tail of requests stuck on a lossy link.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <glib.h>
+
+#include "httpclient.h"
+
+/**
+ * brief Callback invoked on the main loop when a request is done.
+ *
+ * param response The answer, status 0 if there was none. The body is only
+ *        valid during the call.
+ * param user_data Data passed with the request.
+ */
+typedef void (*HttpDoneFunc)(const HttpResponse_t* response, void* user_data);
+
+/**
+ * brief Limits of a request.
+ */
+typedef struct {
+    /// Most milliseconds to connect, 0 for curl's default.
+    long connectTimeoutMs;
+    /// Most milliseconds until the answer, including a hedge, 0 for no
+    /// limit.
+    long timeoutMs;
+    /// Milliseconds without an answer before the request is hedged,
+    /// negative to never hedge. A request that fails without an answer
+    /// before is hedged right away.
+    long hedgeMs;
+    /// URL to send the hedge to, NULL to open a second connection to the
+    /// same URL.
+    const char* hedgeUrl;
+} HttpRequestOptions_t;
+
+/**
+ * brief Counters of the requests made through a multi handle.
+ */
+typedef struct {
+    /// Requests that were also sent as a hedge.
+    uint64_t hedges;
+    /// Requests answered by the hedge first.
+    uint64_t hedgeWins;
+} HttpMultiStats_t;
+
+typedef struct HttpMulti HttpMulti_t;
+
+/**
+ * brief Create a multi handle run by a main context.
+ *
+ * All functions must be called from the thread running the context.
+ *
+ * param context Context whose loop drives the requests, NULL for the
+ *        default context.
+ * return The handle, NULL if curl failed. Free with httpMultiFree().
+ */
+HttpMulti_t* httpMultiNew(GMainContext* context);
+
+/**
+ * brief Abort the requests in flight, without invoking their callbacks,
+ * and free the handle.
+ *
+ * param multi Handle to free, may be NULL.
+ */
+void httpMultiFree(HttpMulti_t* multi);
+
+/**
+ * brief Start a GET request.
+ *
+ * param multi The handle.
+ * param url Full URL including the query, copied.
+ * param headers Extra request headers, may be NULL. Must stay valid until
+ *        the callback.
+ * param options Deadlines and hedging, NULL for none.
+ * param done Invoked with the first answer, or with the last failure if
+ *        there is none. Never invoked from within this call.
+ * param user_data Passed to done.
+ * return false if the request could not be started, done is then not
+ *         invoked.
+ */
+bool httpMultiGet(HttpMulti_t* multi,
+                  const char* url,
+                  const struct curl_slist* headers,
+                  const HttpRequestOptions_t* options,
+                  HttpDoneFunc done,
+                  void* user_data);
+
+/**
+ * brief Number of transfers in flight, a hedged request counts twice.
+ */
+guint httpMultiRunning(const HttpMulti_t* multi);
+
+/**
+ * brief Get the counters accumulated so far.
+ *
+ * param multi The handle.
+ * param stats Filled with the counters.
+ */
+void httpMultiGetStats(const HttpMulti_t* multi, HttpMultiStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,404 @@
+// pread() and friends are POSIX, the apps compile with -std=c17
+#define _POSIX_C_SOURCE 200809L
+
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#define FILE_MAGIC   "SJRN"
+#define FILE_VERSION 1
+// Longest record, anything longer found in the file is taken as torn
+#define MAX_RECORD_SIZE 65536
+
+// Start of the file
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    // Offset of the first record not consumed
+    uint64_t head;
+    // CRC of the fields above
+    uint32_t crc;
+    uint32_t reserved;
+} FileHeader_t;
+
+// Start of every record, followed by the data
+typedef struct {
+    uint32_t size;
+    // CRC of the time and the data
+    uint32_t crc;
+    int64_t time;
+} RecordHeader_t;
+
+#define HEADER_SIZE ((uint64_t)sizeof(FileHeader_t))
+
+struct Journal {
+    int fd;
+    char* path;
+    size_t max_bytes;
+    uint64_t head;
+    uint64_t end;
+    size_t pending;
+    bool dirty;
+    // End offsets of the records of the last journalRead()
+    uint64_t* read_ends;
+    size_t read_count;
+    size_t read_capacity;
+    // Data of the records of the last journalRead()
+    char* buffer;
+    size_t buffer_capacity;
+    JournalStats_t stats;
+};
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const void* data, size_t size);
+static bool write_header(Journal_t* journal);
+static bool scan(Journal_t* journal, uint64_t size);
+static bool read_record(Journal_t* journal, uint64_t offset, RecordHeader_t* header, size_t at);
+static bool make_room(Journal_t* journal, size_t needed);
+static bool compact(Journal_t* journal);
+
+Journal_t* journalOpen(const char* path, size_t maxBytes) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        syslog(LOG_ERR, "Failed to open journal %s: %m", path);
+        return NULL;
+    }
+
+    Journal_t* journal = calloc(1, sizeof(Journal_t));
+    if (!journal || !(journal->path = strdup(path))) {
+        syslog(LOG_ERR, "Failed to allocate memory for journal %s", path);
+        free(journal);
+        close(fd);
+        return NULL;
+    }
+    journal->fd        = fd;
+    journal->max_bytes = maxBytes;
+    journal->head      = HEADER_SIZE;
+    journal->end       = HEADER_SIZE;
+
+    struct stat info;
+    FileHeader_t header;
+    if (fstat(fd, &info) != 0 || (uint64_t)info.st_size < HEADER_SIZE) {
+        // New file, or one cut off before its header was written
+        if (ftruncate(fd, 0) != 0 || !write_header(journal) || fsync(fd) != 0) {
+            syslog(LOG_ERR, "Failed to create journal %s: %m", path);
+            journalClose(journal);
+            return NULL;
+        }
+        return journal;
+    }
+
+    // A bad header only loses track of what was consumed, everything is
+    // replayed then
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        memcmp(header.magic, FILE_MAGIC, 4) != 0 || header.version != FILE_VERSION ||
+        header.crc != crc32_update(0, &header, offsetof(FileHeader_t, crc)) || header.head < HEADER_SIZE ||
+        header.head > (uint64_t)info.st_size) {
+        syslog(LOG_WARNING, "Journal %s has no valid header, replaying all of it", path);
+        header.head = HEADER_SIZE;
+    }
+    journal->head = header.head;
+    if (!scan(journal, (uint64_t)info.st_size)) {
+        journalClose(journal);
+        return NULL;
+    }
+    syslog(LOG_INFO, "Journal %s holds %zu records", path, journal->pending);
+    return journal;
+}
+
+void journalClose(Journal_t* journal) {
+    if (!journal) {
+        return;
+    }
+    journalSync(journal);
+    close(journal->fd);
+    free(journal->path);
+    free(journal->read_ends);
+    free(journal->buffer);
+    free(journal);
+}
+
+bool journalAppend(Journal_t* journal, int64_t time, const void* data, size_t size) {
+    size_t needed = sizeof(RecordHeader_t) + size;
+    if (size > MAX_RECORD_SIZE || !make_room(journal, needed)) {
+        return false;
+    }
+
+    RecordHeader_t header;
+    header.size = (uint32_t)size;
+    header.time = time;
+    header.crc  = crc32_update(crc32_update(0, &header.time, sizeof(header.time)), data, size);
+    if (pwrite(journal->fd, &header, sizeof(header), (off_t)journal->end) != (ssize_t)sizeof(header) ||
+        pwrite(journal->fd, data, size, (off_t)(journal->end + sizeof(header))) != (ssize_t)size) {
+        syslog(LOG_WARNING, "Failed to append to journal %s: %m", journal->path);
+        return false;
+    }
+    journal->end += needed;
+    journal->pending++;
+    journal->dirty = true;
+    journal->stats.appended++;
+    return true;
+}
+
+bool journalSync(Journal_t* journal) {
+    if (!journal->dirty) {
+        return true;
+    }
+
+    // Once everything is consumed the file starts over
+    if (journal->head == journal->end && journal->end > HEADER_SIZE) {
+        if (ftruncate(journal->fd, (off_t)HEADER_SIZE) != 0) {
+            syslog(LOG_WARNING, "Failed to truncate journal %s: %m", journal->path);
+        } else {
+            journal->head       = HEADER_SIZE;
+            journal->end        = HEADER_SIZE;
+            journal->read_count = 0;
+        }
+    }
+    if (!write_header(journal) || fdatasync(journal->fd) != 0) {
+        syslog(LOG_WARNING, "Failed to sync journal %s: %m", journal->path);
+        return false;
+    }
+    journal->dirty = false;
+    journal->stats.syncs++;
+    return true;
+}
+
+size_t journalRead(Journal_t* journal, JournalRecord_t* records, size_t count) {
+    if (count > journal->read_capacity) {
+        uint64_t* grown = realloc(journal->read_ends, count * sizeof(uint64_t));
+        if (!grown) {
+            syslog(LOG_ERR, "Failed to allocate memory to read journal %s", journal->path);
+            journal->read_count = 0;
+            return 0;
+        }
+        journal->read_ends     = grown;
+        journal->read_capacity = count;
+    }
+
+    // Data is read into one buffer, the pointers are set once it stops
+    // moving
+    uint64_t offset = journal->head;
+    size_t at       = 0;
+    size_t read     = 0;
+    while (read < count && offset < journal->end) {
+        RecordHeader_t header;
+        if (!read_record(journal, offset, &header, at)) {
+            break;
+        }
+        records[read].time = header.time;
+        records[read].data = (const void*)(uintptr_t)at;
+        records[read].size = header.size;
+        at += header.size;
+        offset += sizeof(header) + header.size;
+        journal->read_ends[read++] = offset;
+    }
+    for (size_t i = 0; i < read; i++) {
+        records[i].data = journal->buffer + (uintptr_t)records[i].data;
+    }
+    journal->read_count = read;
+    return read;
+}
+
+void journalAck(Journal_t* journal, size_t count) {
+    if (count > journal->read_count) {
+        count = journal->read_count;
+    }
+    if (count == 0) {
+        return;
+    }
+    journal->head = journal->read_ends[count - 1];
+    journal->pending -= count;
+    journal->stats.acked += count;
+    journal->dirty      = true;
+    journal->read_count = 0;
+}
+
+size_t journalPending(const Journal_t* journal) {
+    return journal->pending;
+}
+
+void journalGetStats(const Journal_t* journal, JournalStats_t* stats) {
+    *stats         = journal->stats;
+    stats->pending = journal->pending;
+}
+
+// CRC-32 as used by zlib, the table is computed on first use
+static uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+
+    if (crc_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320U ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static bool write_header(Journal_t* journal) {
+    FileHeader_t header = {0};
+    memcpy(header.magic, FILE_MAGIC, 4);
+    header.version = FILE_VERSION;
+    header.head    = journal->head;
+    header.crc     = crc32_update(0, &header, offsetof(FileHeader_t, crc));
+    return pwrite(journal->fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+}
+
+// Count the records from the head on and cut off a torn one at the end
+static bool scan(Journal_t* journal, uint64_t size) {
+    uint64_t offset = journal->head;
+    RecordHeader_t header;
+
+    while (offset + sizeof(header) <= size) {
+        if (!read_record(journal, offset, &header, 0) ||
+            offset + sizeof(header) + header.size > size ||
+            header.crc != crc32_update(crc32_update(0, &header.time, sizeof(header.time)),
+                                       journal->buffer,
+                                       header.size)) {
+            break;
+        }
+        offset += sizeof(header) + header.size;
+        journal->pending++;
+    }
+    journal->end = offset;
+
+    if (offset < size) {
+        syslog(LOG_WARNING,
+               "Cutting %llu bytes of a torn record off journal %s",
+               (unsigned long long)(size - offset),
+               journal->path);
+        if (ftruncate(journal->fd, (off_t)offset) != 0) {
+            syslog(LOG_ERR, "Failed to truncate journal %s: %m", journal->path);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read the record at offset, its data into the buffer at at
+static bool read_record(Journal_t* journal, uint64_t offset, RecordHeader_t* header, size_t at) {
+    if (pread(journal->fd, header, sizeof(*header), (off_t)offset) != (ssize_t)sizeof(*header) ||
+        header->size > MAX_RECORD_SIZE) {
+        return false;
+    }
+    if (at + header->size > journal->buffer_capacity) {
+        size_t capacity = (at + header->size) * 2;
+        char* grown     = realloc(journal->buffer, capacity);
+        if (!grown) {
+            syslog(LOG_ERR, "Failed to allocate memory to read journal %s", journal->path);
+            return false;
+        }
+        journal->buffer          = grown;
+        journal->buffer_capacity = capacity;
+    }
+    return pread(journal->fd, journal->buffer + at, header->size, (off_t)(offset + sizeof(*header))) ==
+           (ssize_t)header->size;
+}
+
+// Make sure needed more bytes fit in the file, dropping consumed records
+// and, if that is not enough, the oldest ones
+static bool make_room(Journal_t* journal, size_t needed) {
+    if (journal->end + needed <= journal->max_bytes) {
+        return true;
+    }
+    if (HEADER_SIZE + needed > journal->max_bytes) {
+        syslog(LOG_WARNING, "Record of %zu bytes does not fit in journal %s", needed, journal->path);
+        return false;
+    }
+
+    uint64_t live  = journal->end - journal->head;
+    size_t dropped = 0;
+    while (HEADER_SIZE + live + needed > journal->max_bytes) {
+        RecordHeader_t header;
+        if (pread(journal->fd, &header, sizeof(header), (off_t)journal->head) != (ssize_t)sizeof(header)) {
+            return false;
+        }
+        journal->head += sizeof(header) + header.size;
+        live -= sizeof(header) + header.size;
+        journal->pending--;
+        journal->dirty = true;
+        dropped++;
+    }
+    if (dropped) {
+        journal->stats.dropped += dropped;
+        syslog(LOG_WARNING, "Journal %s is full, dropped its %zu oldest records", journal->path, dropped);
+    }
+    return compact(journal);
+}
+
+// Move the records not consumed to the start of a new file, which then
+// replaces the old one, so a power cut leaves one or the other
+static bool compact(Journal_t* journal) {
+    journal->read_count = 0;
+    if (journal->head == journal->end) {
+        journal->head  = HEADER_SIZE;
+        journal->end   = HEADER_SIZE;
+        journal->dirty = true;
+        return ftruncate(journal->fd, (off_t)HEADER_SIZE) == 0;
+    }
+
+    size_t live = (size_t)(journal->end - journal->head);
+    // The records are copied through the read buffer
+    if (live > journal->buffer_capacity) {
+        char* grown = realloc(journal->buffer, live);
+        if (!grown) {
+            syslog(LOG_ERR, "Failed to allocate memory to compact journal %s", journal->path);
+            return false;
+        }
+        journal->buffer          = grown;
+        journal->buffer_capacity = live;
+    }
+
+    char* temp = malloc(strlen(journal->path) + 5);
+    if (!temp) {
+        syslog(LOG_ERR, "Failed to allocate memory to compact journal %s", journal->path);
+        return false;
+    }
+    sprintf(temp, "%s.new", journal->path);
+    int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        syslog(LOG_WARNING, "Failed to compact journal %s: %m", journal->path);
+        free(temp);
+        return false;
+    }
+    bool copied = pread(journal->fd, journal->buffer, live, (off_t)journal->head) == (ssize_t)live &&
+                  pwrite(fd, journal->buffer, live, (off_t)HEADER_SIZE) == (ssize_t)live;
+
+    // The header is written through the journal, which points to the new
+    // file until it is in place
+    int old_fd    = journal->fd;
+    uint64_t head = journal->head;
+    journal->fd   = fd;
+    journal->head = HEADER_SIZE;
+    copied        = copied && write_header(journal) && fsync(fd) == 0 && rename(temp, journal->path) == 0;
+    if (!copied) {
+        syslog(LOG_WARNING, "Failed to compact journal %s: %s", journal->path, strerror(errno));
+        journal->fd   = old_fd;
+        journal->head = head;
+        close(fd);
+        unlink(temp);
+        free(temp);
+        return false;
+    }
+    close(old_fd);
+    free(temp);
+    journal->end   = HEADER_SIZE + live;
+    journal->dirty = false;
+    return true;
+}
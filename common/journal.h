@@ -0,0 +1,122 @@
+/**
+ * A durable queue of records in an append-only file.
+ *
+ * Records are appended to the end of the file and consumed from the head.
+ * Each record carries a CRC, so a record torn by a power cut is found and
+ * cut off when the file is opened again. The offset of the head is kept in
+ * the file's header and written with the records by journalSync(), so
+ * appends are made durable in batches, one fsync for many records.
+ * Consumed records are dropped once the whole queue is consumed, or by
+ * copying the rest to a new file when the file would grow too large. If
+ * the rest alone is too large, the oldest records are dropped.
+ *
+ * Delivery is at least once: records consumed but not yet synced are read
+ * again after a crash. Not thread safe.
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * brief A record read from the journal.
+ */
+typedef struct {
+    /// Time given when the record was appended.
+    int64_t time;
+    /// The data, valid until the next call to journalRead().
+    const void* data;
+    size_t size;
+} JournalRecord_t;
+
+/**
+ * brief Counters of the records.
+ */
+typedef struct {
+    uint64_t appended;
+    uint64_t acked;
+    /// Records dropped unconsumed to keep the file within its size.
+    uint64_t dropped;
+    uint64_t syncs;
+    /// Records in the queue now.
+    uint64_t pending;
+} JournalStats_t;
+
+typedef struct Journal Journal_t;
+
+/**
+ * brief Open a journal, creating the file if needed.
+ *
+ * param path The file.
+ * param maxBytes Most bytes the file may hold.
+ * return The journal, NULL if the file could not be opened. Close with
+ *        journalClose().
+ */
+Journal_t* journalOpen(const char* path, size_t maxBytes);
+
+/**
+ * brief Sync and close a journal.
+ *
+ * param journal Journal to close, may be NULL.
+ */
+void journalClose(Journal_t* journal);
+
+/**
+ * brief Append a record, durable after the next journalSync().
+ *
+ * param journal The journal.
+ * param time Time to keep with the record, e.g. when it happened.
+ * param data The data.
+ * param size Length of the data.
+ * return false if it could not be written.
+ */
+bool journalAppend(Journal_t* journal, int64_t time, const void* data, size_t size);
+
+/**
+ * brief Make the appended records and the consumed head durable.
+ *
+ * param journal The journal.
+ * return false if the file could not be synced.
+ */
+bool journalSync(Journal_t* journal);
+
+/**
+ * brief Read the oldest records, without consuming them.
+ *
+ * param journal The journal.
+ * param records Filled with up to count records.
+ * param count Most records to read.
+ * return Number of records read.
+ */
+size_t journalRead(Journal_t* journal, JournalRecord_t* records, size_t count);
+
+/**
+ * brief Consume the oldest records of the last journalRead().
+ *
+ * param journal The journal.
+ * param count Records to consume, at most as many as were read.
+ */
+void journalAck(Journal_t* journal, size_t count);
+
+/**
+ * brief Number of records not consumed yet.
+ */
+size_t journalPending(const Journal_t* journal);
+
+/**
+ * brief Get the counters accumulated so far.
+ *
+ * param journal The journal.
+ * param stats Filled with the counters.
+ */
+void journalGetStats(const Journal_t* journal, JournalStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <curl/curl.h>
 #include <syslog.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <sqlite3.h>
 #include <time.h>
@@ -11,12 +12,67 @@
 #include <axsdk/axparameter.h>
 #include <glib.h>
 
+#include "httpclient.h"
+
 #define LOCAL_PATH "/var/spool/storage/areas/SD_DISK/speedmonitor/"
 #define APP_NAME "httpsUpload"
+// Survives restarts and upgrades of the app
+#define CURSOR_PATH "/usr/local/packages/" APP_NAME "/localdata/cursor"
+
+// Room for the JSON of one row and the text around it
+#define ROW_JSON_MAX 1024
+
+// Rows are sent oldest first, so that the cursor can follow the server
+#define TRACK_QUERY                                                                                   \
+    "SELECT internal_id, track_id, profile_id, profile_trigger_id, classification, start_timestamp, " \
+    "duration, min_speed, max_speed, avg_speed, enter_speed, exit_speed, enter_bearing, "             \
+    "exit_bearing, flags FROM track WHERE start_timestamp >= ?1 AND (start_timestamp > ?2 OR "         \
+    "(start_timestamp = ?2 AND internal_id > ?3)) ORDER BY start_timestamp, internal_id LIMIT ?4"
+
+typedef struct {
+    char endpoint[256];
+    char auth[256];
+    int interval;
+    int days;
+    int batchRows;
+    int resyncInterval;
+    int resyncHours;
+} UploadConfig_t;
+
+// Every track row up to (timestamp, id) has been taken by the server
+typedef struct {
+    int64_t timestamp;
+    int64_t id;
+    /// Wall clock time in seconds of the next re-sync.
+    int64_t nextResync;
+} Cursor_t;
+
+// The body of one upload, serialised from the open statement while curl
+// sends it. Only the text of one row is held at a time.
+typedef struct {
+    sqlite3_stmt *stmt;
+    /// Text not yet handed to curl.
+    char pending[ROW_JSON_MAX];
+    size_t pendingSize;
+    size_t pendingOffset;
+    /// Whether the closing "]}" has been queued.
+    bool finished;
+    int rows;
+    /// Cursor the rows follow, and key of the last row read.
+    Cursor_t from;
+    Cursor_t last;
+} EntryStream_t;
 
 // Function prototypes
-static void upload_recent_entries(const char *db_path, const char *endpoint, const char *auth, const int days);
-static int extract_recent_entries(const char *db_path, char **json_data, const int days);
+static void upload_recent_entries(HttpClient_t *client, const char *db_path, const UploadConfig_t *config, Cursor_t *cursor);
+static bool start_entries(EntryStream_t *stream);
+static bool next_entry(EntryStream_t *stream);
+static size_t read_entries(char *buffer, size_t size, void *user_data);
+static bool rewind_entries(void *user_data);
+static bool post_entries(HttpClient_t *client, const char *endpoint, const struct curl_slist *headers, EntryStream_t *stream);
+static bool load_cursor(const char *path, Cursor_t *cursor);
+static bool save_cursor(const char *path, const Cursor_t *cursor);
+static int get_int_parameter(AXParameter *handle, const char *name);
 __attribute__((noreturn)) __attribute__((format(printf, 1, 2))) static void panic(const char *format, ...);
 
 __attribute__((noreturn)) __attribute__((format(printf, 1, 2))) static void panic(const char *format, ...) {
@@ -27,155 +83,271 @@ __attribute__((noreturn)) __attribute__((format(printf, 1, 2))) static void pani
     exit(1);
 }
 
-static int extract_recent_entries(const char *db_path, char **json_data, const int days) {
+// Queue the start of the body and its first row, the statement must be
+// bound
+static bool start_entries(EntryStream_t *stream) {
+    sqlite3_reset(stream->stmt);
+    stream->pendingSize = (size_t)snprintf(stream->pending, sizeof(stream->pending), "{\"entries\":[");
+    stream->pendingOffset = 0;
+    stream->finished = false;
+    stream->rows = 0;
+    stream->last = stream->from;
+    return next_entry(stream);
+}
+
+// Append the next row to the pending text, or the end of the body after
+// the last one
+static bool next_entry(EntryStream_t *stream) {
+    sqlite3_stmt *stmt = stream->stmt;
+    char *text = stream->pending + stream->pendingSize;
+    size_t room = sizeof(stream->pending) - stream->pendingSize;
+
+    int rc = sqlite3_step(stmt);
+    if (rc == SQLITE_DONE) {
+        stream->pendingSize += (size_t)snprintf(text, room, "]}");
+        stream->finished = true;
+        return true;
+    }
+    if (rc != SQLITE_ROW) {
+        syslog(LOG_ERR, "Failed to read data: %s", sqlite3_errmsg(sqlite3_db_handle(stmt)));
+        return false;
+    }
+
+    int64_t start_timestamp = sqlite3_column_int64(stmt, 5);
+    int length = snprintf(text, room, "%s{\"internal_id\":%d,\"track_id\":%d,\"profile_id\":%d,\"profile_trigger_id\":%d,\"classification\":%d,\"start_timestamp\":%" PRId64 ",\"duration\":%d,\"min_speed\":%d,\"max_speed\":%d,\"avg_speed\":%d,\"enter_speed\":%d,\"exit_speed\":%d,\"enter_bearing\":%d,\"exit_bearing\":%d,\"flags\":%d}",
+                          stream->rows ? "," : "",
+                          sqlite3_column_int(stmt, 0),
+                          sqlite3_column_int(stmt, 1),
+                          sqlite3_column_int(stmt, 2),
+                          sqlite3_column_int(stmt, 3),
+                          sqlite3_column_int(stmt, 4),
+                          start_timestamp,
+                          sqlite3_column_int(stmt, 6),
+                          sqlite3_column_int(stmt, 7),
+                          sqlite3_column_int(stmt, 8),
+                          sqlite3_column_int(stmt, 9),
+                          sqlite3_column_int(stmt, 10),
+                          sqlite3_column_int(stmt, 11),
+                          sqlite3_column_int(stmt, 12),
+                          sqlite3_column_int(stmt, 13),
+                          sqlite3_column_int(stmt, 14));
+    if (length < 0 || (size_t)length >= room) {
+        syslog(LOG_ERR, "Entry does not fit in %d bytes", ROW_JSON_MAX);
+        return false;
+    }
+    stream->pendingSize += (size_t)length;
+    stream->last.timestamp = start_timestamp;
+    stream->last.id = sqlite3_column_int64(stmt, 0);
+    stream->rows++;
+    return true;
+}
+
+// Called by curl for more of the body
+static size_t read_entries(char *buffer, size_t size, void *user_data) {
+    EntryStream_t *stream = user_data;
+    size_t written = 0;
+
+    while (written < size) {
+        if (stream->pendingOffset == stream->pendingSize) {
+            if (stream->finished) {
+                break;
+            }
+            stream->pendingSize = 0;
+            stream->pendingOffset = 0;
+            if (!next_entry(stream)) {
+                return CURL_READFUNC_ABORT;
+            }
+        }
+        size_t count = MIN(size - written, stream->pendingSize - stream->pendingOffset);
+        memcpy(buffer + written, stream->pending + stream->pendingOffset, count);
+        stream->pendingOffset += count;
+        written += count;
+    }
+    return written;
+}
+
+// Called by curl to send the body again on a new connection
+static bool rewind_entries(void *user_data) {
+    return start_entries(user_data);
+}
+
+// Send one batch, true if the server took all of it
+static bool post_entries(HttpClient_t *client, const char *endpoint, const struct curl_slist *headers, EntryStream_t *stream) {
+    HttpBodySource_t source = {read_entries, rewind_entries, stream};
+    HttpResponse_t response;
+    if (!httpClientPostStream(client, endpoint, headers, &source, &response)) {
+        return false;
+    }
+    syslog(LOG_DEBUG, "HTTP response code: %ld", response.status);
+    if (response.status != 200) {
+        syslog(LOG_ERR, "Data upload failed, server response code: %ld", response.status);
+        return false;
+    }
+    // An answer before the whole body was sent does not cover the rest
+    if (!stream->finished || stream->pendingOffset != stream->pendingSize) {
+        syslog(LOG_ERR, "Server answered before the upload was complete");
+        return false;
+    }
+    return true;
+}
+
+// Upload the rows after the cursor, in batches, moving the cursor past each
+// batch the server takes. Once per resyncInterval the last resyncHours are
+// sent again, to catch rows written or changed after the cursor passed them.
+static void upload_recent_entries(HttpClient_t *client, const char *db_path, const UploadConfig_t *config, Cursor_t *cursor) {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     int rc = sqlite3_open(db_path, &db);
     if (rc != SQLITE_OK) {
         syslog(LOG_ERR, "Cannot open database: %s", sqlite3_errmsg(db));
-        return rc;
+        sqlite3_close(db);
+        return;
     }
-
-    // Calculate the timestamp for variable days ago
-    time_t now = time(NULL);
-    time_t calc_time_ago = now - (days * 24 * 60 * 60);
-    calc_time_ago *= 1000000; // Converts to microseconds for comparison
-    syslog(LOG_INFO, "Calculated Timestamp: %ld", (long)calc_time_ago);
-    char sql[512];
-    snprintf(sql, sizeof(sql), "SELECT internal_id, track_id, profile_id, profile_trigger_id, classification, start_timestamp, duration, min_speed, max_speed, avg_speed, enter_speed, exit_speed, enter_bearing, exit_bearing, flags FROM track WHERE start_timestamp >= %ld ORDER BY start_timestamp DESC", calc_time_ago);
-
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
+    rc = sqlite3_prepare_v2(db, TRACK_QUERY, -1, &stmt, 0);
     if (rc != SQLITE_OK) {
         syslog(LOG_ERR, "Failed to prepare statement: %s", sqlite3_errmsg(db));
         sqlite3_close(db);
-        return rc;
+        return;
     }
 
-    // Allocate initial memory for JSON data
-    size_t json_size = 4096;
-    *json_data = malloc(json_size);
-    if (*json_data == NULL) {
-        syslog(LOG_ERR, "Failed to allocate memory for JSON data");
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "Content-Type: application/json");
+    headers = curl_slist_append(headers, "Transfer-Encoding: chunked");
+
+    char auth_header[256];
+    if ((size_t)snprintf(auth_header, sizeof(auth_header), "PARKSPLUS_AUTH: %.240s", config->auth) >= sizeof(auth_header)) {
+        syslog(LOG_ERR, "Auth header truncated");
+        curl_slist_free_all(headers);
         sqlite3_finalize(stmt);
         sqlite3_close(db);
-        return 1;
+        return;
+    }
+    headers = curl_slist_append(headers, auth_header);
+
+    // Nothing older than DAYS is sent, with or without a cursor
+    int64_t now = (int64_t)time(NULL);
+    int64_t since = (now - (int64_t)config->days * 24 * 60 * 60) * G_USEC_PER_SEC;
+    Cursor_t from = *cursor;
+    bool resync = config->resyncInterval > 0 && now >= cursor->nextResync;
+    if (resync) {
+        int64_t window = (now - (int64_t)config->resyncHours * 60 * 60) * G_USEC_PER_SEC;
+        if (window <= from.timestamp) {
+            from.timestamp = window - 1;
+            from.id = INT64_MAX;
+        }
+        syslog(LOG_INFO, "Re-sending the last %d hours", config->resyncHours);
     }
 
-    // Start the JSON array
-    strcpy(*json_data, "{\"entries\":[");
-    size_t offset = strlen(*json_data);
-
-    int first_entry = 1;
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        if (!first_entry) {
-            strcat(*json_data, ",");
-            offset += 1;
+    int total = 0;
+    int batches = 0;
+    bool failed = false;
+    for (;;) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int64(stmt, 1, since);
+        sqlite3_bind_int64(stmt, 2, from.timestamp);
+        sqlite3_bind_int64(stmt, 3, from.id);
+        sqlite3_bind_int(stmt, 4, config->batchRows);
+
+        // The first row is read up front, an empty batch is not sent
+        EntryStream_t stream = {.stmt = stmt, .from = from};
+        if (!start_entries(&stream)) {
+            syslog(LOG_ERR, "Failed to extract recent entries");
+            failed = true;
+            break;
         }
-        first_entry = 0;
-
-        int internal_id = sqlite3_column_int(stmt, 0);
-        int track_id = sqlite3_column_int(stmt, 1);
-        int profile_id = sqlite3_column_int(stmt, 2);
-        int profile_trigger_id = sqlite3_column_int(stmt, 3);
-        int classification = sqlite3_column_int(stmt, 4);
-        int64_t start_timestamp = sqlite3_column_int64(stmt, 5);
-        int duration = sqlite3_column_int(stmt, 6);
-        int min_speed = sqlite3_column_int(stmt, 7);
-        int max_speed = sqlite3_column_int(stmt, 8);
-        int avg_speed = sqlite3_column_int(stmt, 9);
-        int enter_speed = sqlite3_column_int(stmt, 10);
-        int exit_speed = sqlite3_column_int(stmt, 11);
-        int enter_bearing = sqlite3_column_int(stmt, 12);
-        int exit_bearing = sqlite3_column_int(stmt, 13);
-        int flags = sqlite3_column_int(stmt, 14);
-
-        size_t entry_size = snprintf(NULL, 0, "{\"internal_id\":%d,\"track_id\":%d,\"profile_id\":%d,\"profile_trigger_id\":%d,\"classification\":%d,\"start_timestamp\":%" PRId64 ",\"duration\":%d,\"min_speed\":%d,\"max_speed\":%d,\"avg_speed\":%d,\"enter_speed\":%d,\"exit_speed\":%d,\"enter_bearing\":%d,\"exit_bearing\":%d,\"flags\":%d}", internal_id, track_id, profile_id, profile_trigger_id, classification, start_timestamp, duration, min_speed, max_speed, avg_speed, enter_speed, exit_speed, enter_bearing, exit_bearing, flags) + 1;
-        if (offset + entry_size > json_size) {
-            json_size *= 2;
-            *json_data = realloc(*json_data, json_size);
-            if (*json_data == NULL) {
-                syslog(LOG_ERR, "Failed to reallocate memory for JSON data");
-                sqlite3_finalize(stmt);
-                sqlite3_close(db);
-                return 1;
-            }
+        if (stream.rows == 0) {
+            break;
+        }
+        if (!post_entries(client, config->endpoint, headers, &stream)) {
+            failed = true;
+            break;
+        }
+        int rows = stream.rows;
+        total += rows;
+        batches++;
+
+        // A re-sync only moves the cursor once it gets past it
+        from.timestamp = stream.last.timestamp;
+        from.id = stream.last.id;
+        if (from.timestamp > cursor->timestamp || (from.timestamp == cursor->timestamp && from.id > cursor->id)) {
+            cursor->timestamp = from.timestamp;
+            cursor->id = from.id;
+            save_cursor(CURSOR_PATH, cursor);
+        }
+        if (rows < config->batchRows) {
+            break;
         }
-
-        offset += snprintf(*json_data + offset, json_size - offset, "{\"internal_id\":%d,\"track_id\":%d,\"profile_id\":%d,\"profile_trigger_id\":%d,\"classification\":%d,\"start_timestamp\":%" PRId64 ",\"duration\":%d,\"min_speed\":%d,\"max_speed\":%d,\"avg_speed\":%d,\"enter_speed\":%d,\"exit_speed\":%d,\"enter_bearing\":%d,\"exit_bearing\":%d,\"flags\":%d}", internal_id, track_id, profile_id, profile_trigger_id, classification, start_timestamp, duration, min_speed, max_speed, avg_speed, enter_speed, exit_speed, enter_bearing, exit_bearing, flags);
     }
 
-    // End the JSON array
-    strcat(*json_data, "]}");
+    // An interrupted re-sync is done again next cycle
+    if (resync && !failed) {
+        cursor->nextResync = now + config->resyncInterval;
+        save_cursor(CURSOR_PATH, cursor);
+    }
+    if (total > 0 || failed) {
+        syslog(failed ? LOG_ERR : LOG_INFO,
+               "Uploaded %d rows in %d batches%s, cursor at %" PRId64 "/%" PRId64,
+               total, batches, failed ? " before failing" : "", cursor->timestamp, cursor->id);
+    }
 
+    curl_slist_free_all(headers);
     sqlite3_finalize(stmt);
     sqlite3_close(db);
+}
 
-    if (rc != SQLITE_DONE) {
-        syslog(LOG_ERR, "Failed to read data: %s", sqlite3_errmsg(db));
-        return rc;
+// Read the cursor, a missing or broken file starts over from DAYS ago
+static bool load_cursor(const char *path, Cursor_t *cursor) {
+    memset(cursor, 0, sizeof(*cursor));
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        syslog(LOG_INFO, "No upload cursor, sending the last DAYS first");
+        return false;
     }
-
-    return 0;
+    Cursor_t read;
+    bool ok = fscanf(file, "%" SCNd64 " %" SCNd64 " %" SCNd64, &read.timestamp, &read.id, &read.nextResync) == 3;
+    fclose(file);
+    if (!ok) {
+        syslog(LOG_WARNING, "Upload cursor %s is broken, sending the last DAYS again", path);
+        return false;
+    }
+    *cursor = read;
+    syslog(LOG_INFO, "Upload cursor at %" PRId64 "/%" PRId64, cursor->timestamp, cursor->id);
+    return true;
 }
 
-static void upload_recent_entries(const char *db_path, const char *endpoint, const char *auth, const int days) {
-    char *json_data = NULL;
+// Replace the cursor file in one step, so a power cut leaves the old or the
+// new one
+static bool save_cursor(const char *path, const Cursor_t *cursor) {
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
 
-    if (extract_recent_entries(db_path, &json_data, days) != 0) {
-        syslog(LOG_ERR, "Failed to extract recent entries");
-        return;
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        syslog(LOG_ERR, "Cannot write upload cursor %s", tmp_path);
+        return false;
     }
+    fprintf(file, "%" PRId64 " %" PRId64 " %" PRId64 "\n", cursor->timestamp, cursor->id, cursor->nextResync);
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        syslog(LOG_ERR, "Cannot write upload cursor %s", path);
+        unlink(tmp_path);
+        return false;
+    }
+    return true;
+}
 
-    CURL *curl;
-    CURLcode res;
-    char error_buffer[CURL_ERROR_SIZE];
-
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-    if(curl) {
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-
-        char auth_header[256];
-        if ((size_t)snprintf(auth_header, sizeof(auth_header), "PARKSPLUS_AUTH: %.240s", auth) >= sizeof(auth_header)) {
-            syslog(LOG_ERR, "Auth header truncated");
-            free(json_data);
-            curl_easy_cleanup(curl);
-            curl_global_cleanup();
-            return;
-        }
-        headers = curl_slist_append(headers, auth_header);
-
-        curl_easy_setopt(curl, CURLOPT_URL, endpoint);
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data);
-        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);  // Follow redirects
-        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);       // Limit the number of redirects to follow
-
-        res = curl_easy_perform(curl);
-        if(res != CURLE_OK) {
-            syslog(LOG_ERR, "curl_easy_perform() failed: %s", error_buffer);
-        } else {
-            long http_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-            syslog(LOG_INFO, "HTTP response code: %ld", http_code);
-            if (http_code == 200) {
-                syslog(LOG_INFO, "Data uploaded successfully");
-            } else {
-                syslog(LOG_ERR, "Data upload failed, server response code: %ld", http_code);
-            }
-        }
+static int get_int_parameter(AXParameter *handle, const char *name) {
+    GError *error = NULL;
+    gchar *param_value = NULL;
 
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
-    } else {
-        syslog(LOG_ERR, "Failed to initialize CURL");
+    if (!ax_parameter_get(handle, name, &param_value, &error)) {
+        panic("Failed to get %s: %s", name, error->message);
     }
-
-    free(json_data);
-    curl_global_cleanup();
+    int value = atoi(param_value);
+    g_free(param_value);
+    syslog(LOG_INFO, "Successfully Retrieved %s", name);
+    return value;
 }
 
 int main(void) {
@@ -187,10 +359,7 @@ int main(void) {
     syslog(LOG_INFO, "Starting FTP Upload App");
 
     // Load configuration parameters
-    char endpoint[256];
-    char auth[256];
-    int interval;
-    int days;
+    UploadConfig_t config;
 
     AXParameter *handle = ax_parameter_new(APP_NAME, &error);
 
@@ -198,8 +367,8 @@ int main(void) {
         gchar *param_value = NULL;
 
         if (ax_parameter_get(handle, "ENDPOINT", &param_value, &error)) {
-            strncpy(endpoint, param_value, sizeof(endpoint) - 1);
-            endpoint[sizeof(endpoint) - 1] = '\0';
+            strncpy(config.endpoint, param_value, sizeof(config.endpoint) - 1);
+            config.endpoint[sizeof(config.endpoint) - 1] = '\0';
             g_free(param_value);
             syslog(LOG_INFO, "Successfully Retrieved ENDPOINT");
         } else {
@@ -207,47 +376,53 @@ int main(void) {
         }
 
         if (ax_parameter_get(handle, "AUTH", &param_value, &error)) {
-            strncpy(auth, param_value, sizeof(auth) - 1);
-            auth[sizeof(auth) - 1] = '\0';
+            strncpy(config.auth, param_value, sizeof(config.auth) - 1);
+            config.auth[sizeof(config.auth) - 1] = '\0';
             g_free(param_value);
             syslog(LOG_INFO, "Successfully Retrieved AUTH");
         } else {
             panic("Failed to get AUTH: %s", error->message);
         }
 
-        if (ax_parameter_get(handle, "INTERVAL", &param_value, &error)) {
-            interval = atoi(param_value);
-            g_free(param_value);
-            syslog(LOG_INFO, "Successfully Retrieved INTERVAL");
-        } else {
-            panic("Failed to get INTERVAL: %s", error->message);
-        }
-
-        if (ax_parameter_get(handle, "DAYS", &param_value, &error)) {
-            days = atoi(param_value);
-            g_free(param_value);
-            syslog(LOG_INFO, "Successfully Retrieved DAYS");
-        } else {
-            panic("Failed to get Days: %s", error->message);
-        }
+        config.interval       = get_int_parameter(handle, "INTERVAL");
+        config.days           = get_int_parameter(handle, "DAYS");
+        config.batchRows      = MAX(get_int_parameter(handle, "BATCH_ROWS"), 1);
+        config.resyncInterval = get_int_parameter(handle, "RESYNC_INTERVAL");
+        config.resyncHours    = get_int_parameter(handle, "RESYNC_HOURS");
 
         ax_parameter_free(handle);
     } else {
         panic("Failed to create AXParameter: %s", error->message);
     }
 
+    // The client keeps the connection and TLS session to the endpoint
+    // between cycles where the server allows it
+    if (!httpClientGlobalInit(NULL)) {
+        panic("Failed to initialize the HTTP client");
+    }
+    HttpClient_t *client = httpClientNew();
+    if (!client) {
+        panic("Failed to create the HTTP client");
+    }
+
+    Cursor_t cursor;
+    load_cursor(CURSOR_PATH, &cursor);
+
     syslog(LOG_INFO, "Entering upload loop");
 
     while (1) {
         syslog(LOG_DEBUG, "Starting data upload cycle");
         const char *db_path = LOCAL_PATH "statistics.db";
-        upload_recent_entries(db_path, endpoint, auth, days);
-        syslog(LOG_DEBUG, "Sleeping for %d seconds", interval);
-        sleep(interval);
+        upload_recent_entries(client, db_path, &config, &cursor);
+        syslog(LOG_DEBUG, "Sleeping for %d seconds", config.interval);
+        sleep(config.interval);
     }
 
     syslog(LOG_INFO, "Stopping FTP Upload App");
 
+    httpClientFree(client);
+    httpClientGlobalCleanup();
+
     // Close syslog
     closelog();
 
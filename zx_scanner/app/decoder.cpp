@@ -0,0 +1,128 @@
+#include "decoder.h"
+
+#include <algorithm>
+
+#include "nv12view.h"
+
+Decoder::Decoder(Pipeline& pipeline)
+    : pipeline_(pipeline),
+      options_(ZXing::ReaderOptions().setFormats(ZXing::BarcodeFormat::QRCode)),
+      budgetTicks_(0),
+      scaleX_(1.0),
+      scaleY_(1.0),
+      frames_(0),
+      budgetExhausted_(0) {
+    for (auto& hits : hits_) {
+        hits = 0;
+    }
+}
+
+void Decoder::setFrameBudget(int ms) {
+    budgetTicks_.store(ms > 0 ? (int64_t)(ms * cv::getTickFrequency() / 1000) : 0, std::memory_order_relaxed);
+}
+
+ZXing::Barcodes Decoder::decode(const cv::Mat& roi) {
+    int64_t start  = cv::getTickCount();
+    int64_t budget = budgetTicks_.load(std::memory_order_relaxed);
+
+    frames_.fetch_add(1, std::memory_order_relaxed);
+    pipeline_.begin(roi);
+
+    // Number of pipeline stages run before each level's decode attempt
+    size_t ends[DECODE_LEVELS];
+    ends[DECODE_LEVEL_RAW]   = 0;
+    ends[DECODE_LEVEL_CLAHE] = pipeline_.stagesThrough("clahe");
+    ends[DECODE_LEVEL_FULL]  = pipeline_.stageCount();
+
+    ZXing::Barcodes barcodes;
+    for (int level = 0; level < DECODE_LEVELS; level++) {
+        // Skip levels that would decode the same image again
+        if (level > 0 && ends[level] <= ends[level - 1]) {
+            continue;
+        }
+        if (level > 0 && budget > 0 && cv::getTickCount() - start > budget) {
+            budgetExhausted_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+
+        if (level == DECODE_LEVEL_FULL && pipeline_.scaleCount() > 1) {
+            barcodes = decodeScales(roi, ends[level], start, budget);
+        } else {
+            cv::Mat image = pipeline_.advance(ends[level]);
+            barcodes      = ZXing::ReadBarcodes(toImageView(image), options_);
+            if (!barcodes.empty()) {
+                noteScale(roi, image);
+            }
+        }
+        if (!barcodes.empty()) {
+            hits_[level].fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+    return barcodes;
+}
+
+// Try each scale of the upscale stage, only the stages from the upscale on
+// are rerun for each
+ZXing::Barcodes Decoder::decodeScales(const cv::Mat& roi, size_t end, int64_t start, int64_t budget) {
+    size_t count = pipeline_.scaleCount();
+    if (scaleOrder_.size() != count) {
+        scaleOrder_.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            scaleOrder_[i] = i;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && budget > 0 && cv::getTickCount() - start > budget) {
+            budgetExhausted_.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+
+        pipeline_.selectScale(scaleOrder_[i]);
+        cv::Mat image            = pipeline_.advance(end);
+        ZXing::Barcodes barcodes = ZXing::ReadBarcodes(toImageView(image), options_);
+        if (!barcodes.empty()) {
+            // The next frame most likely shows the code at the same size
+            std::rotate(scaleOrder_.begin(), scaleOrder_.begin() + i, scaleOrder_.begin() + i + 1);
+            noteScale(roi, image);
+            return barcodes;
+        }
+    }
+    return ZXing::Barcodes();
+}
+
+// Remember how the image the codes were found in maps back to the ROI
+void Decoder::noteScale(const cv::Mat& roi, const cv::Mat& image) {
+    scaleX_ = (double)roi.cols / image.cols;
+    scaleY_ = (double)roi.rows / image.rows;
+}
+
+cv::Rect Decoder::bounds(const ZXing::Barcode& barcode) const {
+    const ZXing::Position& position = barcode.position();
+    int left = position[0].x, right = position[0].x;
+    int top = position[0].y, bottom = position[0].y;
+    for (const auto& point : position) {
+        left   = std::min(left, point.x);
+        right  = std::max(right, point.x);
+        top    = std::min(top, point.y);
+        bottom = std::max(bottom, point.y);
+    }
+
+    int x = (int)(left * scaleX_);
+    int y = (int)(top * scaleY_);
+    return cv::Rect(x, y, (int)((right + 1) * scaleX_) - x, (int)((bottom + 1) * scaleY_) - y);
+}
+
+void Decoder::getStats(DecoderStats_t* stats) const {
+    stats->frames = frames_.load(std::memory_order_relaxed);
+    for (int level = 0; level < DECODE_LEVELS; level++) {
+        stats->hits[level] = hits_[level].load(std::memory_order_relaxed);
+    }
+    stats->budgetExhausted = budgetExhausted_.load(std::memory_order_relaxed);
+}
+
+const char* Decoder::levelName(int level) {
+    static const char* const names[DECODE_LEVELS] = {"raw", "clahe", "full"};
+    return level >= 0 && level < DECODE_LEVELS ? names[level] : "unknown";
+}
@@ -0,0 +1,110 @@
+/**
+ * Cascaded QR decoding of a region of interest.
+ *
+ * In good light most codes decode straight from the raw luma, so the
+ * enhancement pipeline is only run when a cheaper attempt fails: first
+ * ZXing on the raw ROI, then on the ROI after the pipeline's CLAHE stage,
+ * then after the whole pipeline. Each level continues the pipeline where
+ * the previous one stopped, so escalating costs no more than running the
+ * full pipeline up front. Escalation stops once the frame budget is spent.
+ *
+ * When the upscale stage has several scales, the last level tries them in
+ * turn, starting with the one that decoded most recently.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#include <ZXing/ReadBarcode.h>
+
+#include "pipeline.h"
+
+/// The cascade levels, cheapest first.
+typedef enum { DECODE_LEVEL_RAW, DECODE_LEVEL_CLAHE, DECODE_LEVEL_FULL, DECODE_LEVELS } DecodeLevel_t;
+
+/**
+ * brief Counters of where decodes succeed.
+ */
+typedef struct {
+    uint64_t frames;
+    /// Frames decoded at each level.
+    uint64_t hits[DECODE_LEVELS];
+    /// Frames where escalation stopped because the budget was spent.
+    uint64_t budgetExhausted;
+} DecoderStats_t;
+
+/**
+ * brief Runs the cascade for one decode worker.
+ *
+ * Every worker owns a decoder and its pipeline, see workers.h. decode()
+ * must always be called from that worker's thread, the other methods may
+ * be called from any thread.
+ */
+class Decoder {
+public:
+    /**
+     * brief Create a decoder.
+     *
+     * param pipeline Enhancement pipeline used by the higher levels.
+     */
+    explicit Decoder(Pipeline& pipeline);
+
+    /**
+     * brief Set the time a frame may spend in the cascade.
+     *
+     * A level that starts within the budget is always finished.
+     *
+     * param ms Budget in milliseconds, 0 for no limit.
+     */
+    void setFrameBudget(int ms);
+
+    /**
+     * brief Decode QR codes in a greyscale region of interest.
+     *
+     * param roi Greyscale image, may be a view into a VDO buffer.
+     * return The codes found by the first level that found any.
+     */
+    ZXing::Barcodes decode(const cv::Mat& roi);
+
+    /**
+     * brief Bounding box of a code found by the last decode().
+     *
+     * Codes found after the pipeline has enlarged the image are mapped
+     * back. Must be called from the thread calling decode().
+     *
+     * param barcode One of the codes returned by the last decode().
+     * return The box in coordinates of the ROI given to decode().
+     */
+    cv::Rect bounds(const ZXing::Barcode& barcode) const;
+
+    /**
+     * brief Get the counters accumulated so far.
+     *
+     * param stats Filled with the counters.
+     */
+    void getStats(DecoderStats_t* stats) const;
+
+    /// Name of a level for logging.
+    static const char* levelName(int level);
+
+private:
+    ZXing::Barcodes decodeScales(const cv::Mat& roi, size_t end, int64_t start, int64_t budget);
+    void noteScale(const cv::Mat& roi, const cv::Mat& image);
+
+    Pipeline& pipeline_;
+    ZXing::ReaderOptions options_;
+    std::atomic<int64_t> budgetTicks_;
+    /// ROI pixels per pixel of the image the last codes were found in.
+    double scaleX_;
+    double scaleY_;
+    /// Indices of the pipeline's upscale scales, most recently successful
+    /// first.
+    std::vector<size_t> scaleOrder_;
+
+    std::atomic<uint64_t> frames_;
+    std::atomic<uint64_t> hits_[DECODE_LEVELS];
+    std::atomic<uint64_t> budgetExhausted_;
+};
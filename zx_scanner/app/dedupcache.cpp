@@ -0,0 +1,81 @@
+#include "dedupcache.h"
+
+#include <syslog.h>
+
+// Used until configure() is called
+#define DEFAULT_CAPACITY 64
+#define DEFAULT_TTL_MS   10000
+// Limits a typo in the parameter to a sensible size
+#define MAX_CAPACITY 4096
+
+DedupCache::DedupCache()
+    : entries_(DEFAULT_CAPACITY, Entry_t{0, 0}),
+      ttl_((int64_t)DEFAULT_TTL_MS * 1000),
+      admitted_(0),
+      suppressed_(0),
+      evicted_(0) {}
+
+void DedupCache::configure(int capacity, int ttlMs) {
+    if (capacity < 1 || capacity > MAX_CAPACITY) {
+        syslog(LOG_WARNING, "Dedup cache size %d out of range, using %d", capacity, DEFAULT_CAPACITY);
+        capacity = DEFAULT_CAPACITY;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Codes already remembered are kept as far as they fit
+    entries_.resize(capacity, Entry_t{0, 0});
+    ttl_ = ttlMs > 0 ? (int64_t)ttlMs * 1000 : 0;
+}
+
+bool DedupCache::admit(const char* text, size_t size, int64_t now) {
+    uint64_t hash = fnv1a64(text, size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (ttl_ == 0) {
+        admitted_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Find the code, or else the entry to replace: a free or expired one if
+    // there is one, otherwise the one seen least recently
+    Entry_t* victim = &entries_[0];
+    for (Entry_t& entry : entries_) {
+        bool live = entry.seen != 0 && now - entry.seen < ttl_;
+        if (live && entry.hash == hash) {
+            entry.seen = now;
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (!live) {
+            victim = &entry;
+        } else if (victim->seen != 0 && now - victim->seen < ttl_ && entry.seen < victim->seen) {
+            victim = &entry;
+        }
+    }
+
+    if (victim->seen != 0 && now - victim->seen < ttl_) {
+        evicted_.fetch_add(1, std::memory_order_relaxed);
+    }
+    victim->hash = hash;
+    // 0 marks a free entry
+    victim->seen = now != 0 ? now : 1;
+    admitted_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void DedupCache::forget(const char* text, size_t size) {
+    uint64_t hash = fnv1a64(text, size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Entry_t& entry : entries_) {
+        if (entry.seen != 0 && entry.hash == hash) {
+            entry.seen = 0;
+        }
+    }
+}
+
+void DedupCache::getStats(DedupStats_t* stats) const {
+    stats->admitted   = admitted_.load(std::memory_order_relaxed);
+    stats->suppressed = suppressed_.load(std::memory_order_relaxed);
+    stats->evicted    = evicted_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,118 @@
+/**
+ * Remembers the codes checked recently, so repeats are not checked again.
+ *
+ * A visitor holds a pass in front of the camera for a second or two and
+ * every frame decodes it again. Only the first sighting is checked with the
+ * server, later ones are dropped until the code has not been seen for a
+ * while. A different code, e.g. the next visitor in the queue, is checked
+ * right away.
+ *
+ * Codes are keyed by a 64 bit hash of their text. The cache holds a fixed
+ * number of codes, the one seen least recently makes room for a new one.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * brief 64 bit FNV-1a hash of a block of bytes.
+ *
+ * constexpr, so tables of known texts can be hashed at compile time.
+ *
+ * param data Start of the bytes.
+ * param size Number of bytes.
+ * return The hash.
+ */
+constexpr uint64_t fnv1a64(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/**
+ * brief Counters of the codes seen.
+ */
+typedef struct {
+    /// Sightings of a code not in the cache, handed on to be checked.
+    uint64_t admitted;
+    /// Sightings of a code checked recently, dropped.
+    uint64_t suppressed;
+    /// Codes dropped from a full cache before they expired.
+    uint64_t evicted;
+} DedupStats_t;
+
+/**
+ * brief The recently checked codes.
+ *
+ * May be used from any thread, codes arrive from the decode workers and
+ * check results on the main loop.
+ */
+class DedupCache {
+public:
+    DedupCache();
+
+    /**
+     * brief Set the size of the cache and how long codes are remembered.
+     *
+     * param capacity Most codes remembered, at least 1.
+     * param ttlMs Milliseconds after its last sighting a code is checked
+     *        again, 0 to check every sighting.
+     */
+    void configure(int capacity, int ttlMs);
+
+    /**
+     * brief Note a sighting of a code.
+     *
+     * Every sighting restarts the time the code is remembered, so a pass
+     * that stays in view is checked once.
+     *
+     * param text The decoded text.
+     * param size Length of the text.
+     * param now Monotonic time in microseconds.
+     * return True if the code was not seen recently and should be checked.
+     */
+    bool admit(const char* text, size_t size, int64_t now);
+
+    /**
+     * brief Forget a code, so its next sighting is checked again.
+     *
+     * Used when a check got no answer from the server.
+     *
+     * param text The decoded text.
+     * param size Length of the text.
+     */
+    void forget(const char* text, size_t size);
+
+    /**
+     * brief Get the counters accumulated so far.
+     *
+     * param stats Filled with the counters.
+     */
+    void getStats(DedupStats_t* stats) const;
+
+private:
+    typedef struct {
+        uint64_t hash;
+        /// Time of the last sighting, 0 for a free entry.
+        int64_t seen;
+    } Entry_t;
+
+    /// Guards the entries and settings.
+    std::mutex mutex_;
+    /// A short list searched from the front, allocated by configure().
+    std::vector<Entry_t> entries_;
+    int64_t ttl_;
+
+    std::atomic<uint64_t> admitted_;
+    std::atomic<uint64_t> suppressed_;
+    std::atomic<uint64_t> evicted_;
+};
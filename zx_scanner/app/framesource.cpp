@@ -0,0 +1,41 @@
+#include "framesource.h"
+
+#include <syslog.h>
+
+typedef struct {
+    GSource source;
+    ImgProvider_t* provider;
+} FrameSource;
+
+static gboolean frameSourceDispatch(GSource* source, GSourceFunc callback, gpointer userData) {
+    FrameSource* self = (FrameSource*)source;
+
+    if (!callback) {
+        syslog(LOG_WARNING, "%s: Frame source dispatched without callback", __func__);
+        return G_SOURCE_REMOVE;
+    }
+
+    // The eventfd may have been signalled for a frame that has since been
+    // taken, or that turned out to be too old.
+    ImgFrameInfo_t info;
+    VdoBuffer* buffer = getLastFrame(self->provider, &info);
+    if (!buffer) {
+        return G_SOURCE_CONTINUE;
+    }
+
+    return ((FrameSourceFunc)(void (*)(void))callback)(buffer, &info, userData);
+}
+
+// No prepare or check, the source is ready whenever the eventfd is.
+static GSourceFuncs frameSourceFuncs = {NULL, NULL, frameSourceDispatch, NULL, NULL, NULL};
+
+GSource* frameSourceNew(ImgProvider_t* provider) {
+    GSource* source   = g_source_new(&frameSourceFuncs, sizeof(FrameSource));
+    FrameSource* self = (FrameSource*)source;
+
+    g_source_set_name(source, "FrameSource");
+    self->provider = provider;
+    g_source_add_unix_fd(source, getFrameEventFd(provider), G_IO_IN);
+
+    return source;
+}
@@ -0,0 +1,37 @@
+/**
+ * A GLib event source that dispatches when VDO delivers a new frame.
+ *
+ * The source polls the ImgProvider's frame eventfd, so a main loop running
+ * it sleeps until a frame is actually available instead of waking up on a
+ * timer. Attach it to the GMainContext of the thread that is to process the
+ * frames, that thread becomes the provider's client thread.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "imgprovider.h"
+
+/**
+ * brief Callback invoked with every new frame.
+ *
+ * The callback owns the buffer and must hand it back with returnFrame().
+ *
+ * param buffer The frame.
+ * param info Metadata of the frame, only valid during the call.
+ * param user_data Data passed to g_source_set_callback().
+ * return G_SOURCE_CONTINUE to keep receiving frames, G_SOURCE_REMOVE to stop.
+ */
+typedef gboolean (*FrameSourceFunc)(VdoBuffer* buffer, const ImgFrameInfo_t* info, gpointer user_data);
+
+/**
+ * brief Create a source for frames fetched by an ImgProvider.
+ *
+ * Set the callback with g_source_set_callback(), wrapping the
+ * FrameSourceFunc in G_SOURCE_FUNC().
+ *
+ * param provider Provider whose frames to dispatch, must outlive the source.
+ * return A new GSource, free with g_source_unref().
+ */
+GSource* frameSourceNew(ImgProvider_t* provider);
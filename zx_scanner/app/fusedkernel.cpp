@@ -0,0 +1,369 @@
+#include "fusedkernel.h"
+
+#include <algorithm>
+#include <math.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Row or column index for OpenCV's BORDER_REPLICATE (aaaaaa|abcdefgh|hhhhhhh)
+static inline int replicate(int i, int n) {
+    return i < 0 ? 0 : i >= n ? n - 1 : i;
+}
+
+// Row or column index for OpenCV's BORDER_REFLECT_101 (gfedcb|abcdefgh|gfedcba)
+static inline int reflect101(int i, int n) {
+    if (n == 1) {
+        return 0;
+    }
+    while (i < 0 || i >= n) {
+        i = i < 0 ? -i : 2 * n - 2 - i;
+    }
+    return i;
+}
+
+static inline uint8_t vmin(uint8_t a, uint8_t b) {
+    return a < b ? a : b;
+}
+
+static inline uint8_t vmax(uint8_t a, uint8_t b) {
+    return a > b ? a : b;
+}
+
+#if defined(__ARM_NEON)
+static inline uint8x16_t vmin(uint8x16_t a, uint8x16_t b) {
+    return vminq_u8(a, b);
+}
+
+static inline uint8x16_t vmax(uint8x16_t a, uint8x16_t b) {
+    return vmaxq_u8(a, b);
+}
+#endif
+
+// Order a and b so that a <= b
+template <typename V>
+static inline void sort2(V& a, V& b) {
+    V t = vmin(a, b);
+    b   = vmax(a, b);
+    a   = t;
+}
+
+// Median of nine with the 19 exchange network by Paeth, for scalars and
+// NEON vectors alike
+template <typename V>
+static inline V median9(V p0, V p1, V p2, V p3, V p4, V p5, V p6, V p7, V p8) {
+    sort2(p1, p2);
+    sort2(p4, p5);
+    sort2(p7, p8);
+    sort2(p0, p1);
+    sort2(p3, p4);
+    sort2(p6, p7);
+    sort2(p1, p2);
+    sort2(p4, p5);
+    sort2(p7, p8);
+    sort2(p0, p3);
+    sort2(p5, p8);
+    sort2(p4, p7);
+    sort2(p3, p6);
+    sort2(p1, p4);
+    sort2(p2, p5);
+    sort2(p4, p7);
+    sort2(p4, p2);
+    sort2(p6, p4);
+    sort2(p4, p2);
+    return p4;
+}
+
+// 3x3 median like cv::medianBlur(), columns replicated at the edges
+static void medianRow(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, uint8_t* out, int w) {
+    int x = 0;
+
+    auto scalar = [&](int x) {
+        int xl = replicate(x - 1, w);
+        int xr = replicate(x + 1, w);
+        out[x] = median9(r0[xl], r0[x], r0[xr], r1[xl], r1[x], r1[xr], r2[xl], r2[x], r2[xr]);
+    };
+
+    scalar(x++);
+#if defined(__ARM_NEON)
+    for (; x + 17 <= w; x += 16) {
+        vst1q_u8(out + x,
+                 median9(vld1q_u8(r0 + x - 1),
+                         vld1q_u8(r0 + x),
+                         vld1q_u8(r0 + x + 1),
+                         vld1q_u8(r1 + x - 1),
+                         vld1q_u8(r1 + x),
+                         vld1q_u8(r1 + x + 1),
+                         vld1q_u8(r2 + x - 1),
+                         vld1q_u8(r2 + x),
+                         vld1q_u8(r2 + x + 1)));
+    }
+#endif
+    for (; x < w; x++) {
+        scalar(x);
+    }
+}
+
+// Unsharp mask on median output rows m0, m1 and m2: 1.5 * m1 - 0.5 * blur,
+// rounded half to even like cv::addWeighted(). The blur is OpenCV's bit
+// exact 3x3 Gaussian, [1 2 1] x [1 2 1] / 16 rounded half up, with columns
+// reflected at the edges.
+static inline uint8_t sharpen(int m, int sum) {
+    int blur = (sum + 8) >> 4;
+    int v    = 3 * m - blur;
+    int q    = v >> 1;
+    q += v & q & 1;
+    return (uint8_t)std::min(std::max(q, 0), 255);
+}
+
+static void sharpenRow(const uint8_t* m0, const uint8_t* m1, const uint8_t* m2, uint8_t* out, int w) {
+    int x = 0;
+
+    auto scalar = [&](int x) {
+        int xl    = reflect101(x - 1, w);
+        int xr    = reflect101(x + 1, w);
+        int left  = m0[xl] + 2 * m1[xl] + m2[xl];
+        int mid   = m0[x] + 2 * m1[x] + m2[x];
+        int right = m0[xr] + 2 * m1[xr] + m2[xr];
+        out[x]    = sharpen(m1[x], left + 2 * mid + right);
+    };
+
+    scalar(x++);
+#if defined(__ARM_NEON)
+    const int16x8_t one = vdupq_n_s16(1);
+    for (; x + 9 <= w; x += 8) {
+        uint16x8_t left  = vaddq_u16(vaddl_u8(vld1_u8(m0 + x - 1), vld1_u8(m2 + x - 1)),
+                                    vshll_n_u8(vld1_u8(m1 + x - 1), 1));
+        uint16x8_t mid   = vaddq_u16(vaddl_u8(vld1_u8(m0 + x), vld1_u8(m2 + x)),
+                                   vshll_n_u8(vld1_u8(m1 + x), 1));
+        uint16x8_t right = vaddq_u16(vaddl_u8(vld1_u8(m0 + x + 1), vld1_u8(m2 + x + 1)),
+                                     vshll_n_u8(vld1_u8(m1 + x + 1), 1));
+        uint16x8_t sum   = vaddq_u16(vaddq_u16(left, right), vshlq_n_u16(mid, 1));
+        int16x8_t blur   = vreinterpretq_s16_u16(vrshrq_n_u16(sum, 4));
+        int16x8_t m      = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(m1 + x)));
+        int16x8_t v      = vsubq_s16(vaddq_s16(m, vshlq_n_s16(m, 1)), blur);
+        int16x8_t q      = vshrq_n_s16(v, 1);
+        q                = vaddq_s16(q, vandq_s16(vandq_s16(v, q), one));
+        vst1_u8(out + x, vqmovun_s16(q));
+    }
+#endif
+    for (; x < w; x++) {
+        scalar(x);
+    }
+}
+
+// Horizontal pass of the threshold mean, columns replicated at the edges.
+// The kernel is symmetric, mirrored taps are added before they are
+// weighted.
+static void hGaussRow(const uint8_t* s, float* out, int w, const float* weights, int radius) {
+    int x = 0;
+
+    auto scalar = [&](int x) {
+        float acc = s[x] * weights[radius];
+        for (int t = 1; t <= radius; t++) {
+            acc += (s[replicate(x - t, w)] + s[replicate(x + t, w)]) * weights[radius + t];
+        }
+        out[x] = acc;
+    };
+
+    for (; x < std::min(radius, w); x++) {
+        scalar(x);
+    }
+#if defined(__ARM_NEON)
+    for (; x + radius + 8 <= w; x += 8) {
+        uint16x8_t centre = vmovl_u8(vld1_u8(s + x));
+        float32x4_t lo    = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(centre))), weights[radius]);
+        float32x4_t hi    = vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(centre))), weights[radius]);
+        for (int t = 1; t <= radius; t++) {
+            uint16x8_t pair = vaddl_u8(vld1_u8(s + x - t), vld1_u8(s + x + t));
+            lo = vmlaq_n_f32(lo, vcvtq_f32_u32(vmovl_u16(vget_low_u16(pair))), weights[radius + t]);
+            hi = vmlaq_n_f32(hi, vcvtq_f32_u32(vmovl_u16(vget_high_u16(pair))), weights[radius + t]);
+        }
+        vst1q_f32(out + x, lo);
+        vst1q_f32(out + x + 4, hi);
+    }
+#endif
+    for (; x < w; x++) {
+        scalar(x);
+    }
+}
+
+// Vertical pass of the threshold mean and the threshold itself.
+// s - round(m) > -c is the same as m < s + c - 0.5.
+static void thresholdRow(const float* const* rows,
+                         const uint8_t* s,
+                         uint8_t* out,
+                         int w,
+                         const float* weights,
+                         int radius,
+                         int c) {
+    int x = 0;
+
+#if defined(__ARM_NEON)
+    const float32x4_t offset = vdupq_n_f32(c - 0.5f);
+    for (; x + 8 <= w; x += 8) {
+        float32x4_t lo = vmulq_n_f32(vld1q_f32(rows[radius] + x), weights[radius]);
+        float32x4_t hi = vmulq_n_f32(vld1q_f32(rows[radius] + x + 4), weights[radius]);
+        for (int t = 1; t <= radius; t++) {
+            lo = vmlaq_n_f32(
+                lo, vaddq_f32(vld1q_f32(rows[radius - t] + x), vld1q_f32(rows[radius + t] + x)), weights[radius + t]);
+            hi = vmlaq_n_f32(hi,
+                             vaddq_f32(vld1q_f32(rows[radius - t] + x + 4), vld1q_f32(rows[radius + t] + x + 4)),
+                             weights[radius + t]);
+        }
+
+        uint16x8_t sv   = vmovl_u8(vld1_u8(s + x));
+        float32x4_t tlo = vaddq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(sv))), offset);
+        float32x4_t thi = vaddq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(sv))), offset);
+        uint16x8_t below = vcombine_u16(vmovn_u32(vcltq_f32(lo, tlo)), vmovn_u32(vcltq_f32(hi, thi)));
+        vst1_u8(out + x, vmovn_u16(below));
+    }
+#endif
+    for (; x < w; x++) {
+        float acc = rows[radius][x] * weights[radius];
+        for (int t = 1; t <= radius; t++) {
+            acc += (rows[radius - t][x] + rows[radius + t][x]) * weights[radius + t];
+        }
+        out[x] = acc < s[x] + c - 0.5f ? 255 : 0;
+    }
+}
+
+// 3x3 dilation (Max) or erosion (!Max) ignoring pixels outside the image,
+// as cv::dilate() and cv::erode() do by default. Replicating the edge gives
+// the same result for min and max.
+template <bool Max>
+static void morphRow(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, uint8_t* tmp, uint8_t* out, int w) {
+    auto op = [](uint8_t a, uint8_t b) { return Max ? vmax(a, b) : vmin(a, b); };
+    int x   = 0;
+
+#if defined(__ARM_NEON)
+    for (; x + 16 <= w; x += 16) {
+        uint8x16_t a = vld1q_u8(r0 + x);
+        uint8x16_t b = vld1q_u8(r1 + x);
+        uint8x16_t c = vld1q_u8(r2 + x);
+        vst1q_u8(tmp + x, Max ? vmaxq_u8(vmaxq_u8(a, b), c) : vminq_u8(vminq_u8(a, b), c));
+    }
+#endif
+    for (; x < w; x++) {
+        tmp[x] = op(op(r0[x], r1[x]), r2[x]);
+    }
+
+    x = 0;
+    if (w == 1) {
+        out[0] = tmp[0];
+        return;
+    }
+    out[x] = op(tmp[0], tmp[1]);
+    x++;
+#if defined(__ARM_NEON)
+    for (; x + 17 <= w; x += 16) {
+        uint8x16_t a = vld1q_u8(tmp + x - 1);
+        uint8x16_t b = vld1q_u8(tmp + x);
+        uint8x16_t c = vld1q_u8(tmp + x + 1);
+        vst1q_u8(out + x, Max ? vmaxq_u8(vmaxq_u8(a, b), c) : vminq_u8(vminq_u8(a, b), c));
+    }
+#endif
+    for (; x < w - 1; x++) {
+        out[x] = op(op(tmp[x - 1], tmp[x]), tmp[x + 1]);
+    }
+    out[x] = op(tmp[x - 1], tmp[x]);
+}
+
+FusedKernel::FusedKernel(int blockSize, int c)
+    : radius_(blockSize / 2), c_(c), width_(0), capacity_(0), sharpRows_(0), meanRows_(0) {
+    // The kernel cv::getGaussianKernel() uses for sigma 0, which has fixed
+    // tables for the smallest sizes
+    static const double smallKernels[][7] = {{0.25, 0.5, 0.25},
+                                             {0.0625, 0.25, 0.375, 0.25, 0.0625},
+                                             {0.03125, 0.109375, 0.21875, 0.28125, 0.21875, 0.109375, 0.03125}};
+    int n        = 2 * radius_ + 1;
+    double sigma = 0.3 * ((n - 1) * 0.5 - 1) + 0.8;
+    std::vector<double> kernel(n);
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        double d  = i - radius_;
+        kernel[i] = n <= 7 ? smallKernels[radius_ - 1][i] : exp(-d * d / (2 * sigma * sigma));
+        sum += kernel[i];
+    }
+
+    weights_.resize(n);
+    for (int i = 0; i < n; i++) {
+        weights_[i] = (float)(kernel[i] / sum);
+    }
+}
+
+void FusedKernel::allocate(int width) {
+    if (width <= capacity_) {
+        return;
+    }
+    capacity_  = width;
+    sharpRows_ = radius_ + 2;
+    meanRows_  = 2 * radius_ + 2;
+    med_.assign((size_t)MED_ROWS * width, 0);
+    sharp_.assign((size_t)sharpRows_ * width, 0);
+    hmean_.assign((size_t)meanRows_ * width, 0);
+    bin_.assign((size_t)MORPH_ROWS * width, 0);
+    dil_.assign((size_t)MORPH_ROWS * width, 0);
+    morphTmp_.assign(width, 0);
+    meanRowPtrs_.assign(2 * radius_ + 1, NULL);
+}
+
+void FusedKernel::run(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int height) {
+    const int r = radius_;
+    const int h = height;
+    const int w = width;
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    // The rings only ever grow, rows of a narrower image are packed closer
+    if (width > capacity_) {
+        allocate(width);
+    }
+    width_ = width;
+
+    auto srcRow = [&](int y) { return src + (size_t)y * srcStride; };
+
+    // Each step works a fixed number of rows behind the one before it, far
+    // enough that all rows it reads have been produced
+    for (int i = 0; i < h + r + 3; i++) {
+        if (i < h) {
+            medianRow(srcRow(replicate(i - 1, h)), srcRow(i), srcRow(replicate(i + 1, h)), medRow(i), w);
+        }
+
+        int j = i - 1;
+        if (j >= 0 && j < h) {
+            sharpenRow(medRow(reflect101(j - 1, h)), medRow(j), medRow(reflect101(j + 1, h)), sharpRow(j), w);
+            hGaussRow(sharpRow(j), meanRow(j), w, weights_.data(), r);
+        }
+
+        int k = j - r;
+        if (k >= 0 && k < h) {
+            for (int t = -r; t <= r; t++) {
+                meanRowPtrs_[t + r] = meanRow(replicate(k + t, h));
+            }
+            thresholdRow(meanRowPtrs_.data(), sharpRow(k), binRow(k), w, weights_.data(), r, c_);
+        }
+
+        int d = k - 1;
+        if (d >= 0 && d < h) {
+            morphRow<true>(binRow(replicate(d - 1, h)),
+                           binRow(d),
+                           binRow(replicate(d + 1, h)),
+                           morphTmp_.data(),
+                           dilRow(d),
+                           w);
+        }
+
+        int e = d - 1;
+        if (e >= 0 && e < h) {
+            morphRow<false>(dilRow(replicate(e - 1, h)),
+                            dilRow(e),
+                            dilRow(replicate(e + 1, h)),
+                            morphTmp_.data(),
+                            dst + (size_t)e * dstStride,
+                            w);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+/**
+ * Fused median, unsharp mask, adaptive threshold and close.
+ *
+ * After upscaling, the default pipeline runs four full passes over the
+ * image: a 3x3 median, a 3x3 Gaussian unsharp mask, a Gaussian adaptive
+ * threshold and a 3x3 morphological close. This kernel does all of them in
+ * a single sweep down the image, keeping only the few rows each step still
+ * needs in small ring buffers, so every source pixel is read from memory
+ * once and the working set stays in cache.
+ *
+ * It uses NEON on ARM and a scalar version elsewhere. The median and
+ * unsharp mask are done in integer arithmetic and are bit exact with
+ * OpenCV. The threshold mean is computed in float like OpenCV does, but
+ * with the taps added in another order, so a pixel whose mean lies within
+ * about 1e-4 of a rounding boundary may come out differently. make test in
+ * ../host checks that this stays below 1.5e-5 of the pixels. Set
+ * FUSED_VERIFY to compare against the OpenCV stages on the device.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * brief Row ring buffers and weights for one threshold block size.
+ *
+ * Not thread safe.
+ */
+class FusedKernel {
+public:
+    /**
+     * brief Set up the kernel.
+     *
+     * param blockSize Odd neighbourhood size of the Gaussian threshold mean.
+     * param c Constant subtracted from the mean, like cv::adaptiveThreshold().
+     */
+    FusedKernel(int blockSize, int c);
+
+    /**
+     * brief Make the ring buffers large enough for images of the given width.
+     *
+     * The buffers only grow, so after calls with every width to be run,
+     * run() does not allocate. run() grows them itself for a wider image.
+     */
+    void allocate(int width);
+
+    /**
+     * brief Process one greyscale image.
+     *
+     * param src Input rows, must not overlap dst.
+     * param srcStride Bytes between input rows.
+     * param dst Output rows, 0 or 255.
+     * param dstStride Bytes between output rows.
+     * param width Image width in pixels.
+     * param height Image height in rows.
+     */
+    void run(const uint8_t* src, size_t srcStride, uint8_t* dst, size_t dstStride, int width, int height);
+
+private:
+    uint8_t* medRow(int y) { return &med_[(size_t)(y % MED_ROWS) * width_]; }
+    uint8_t* sharpRow(int y) { return &sharp_[(size_t)(y % sharpRows_) * width_]; }
+    float* meanRow(int y) { return &hmean_[(size_t)(y % meanRows_) * width_]; }
+    uint8_t* binRow(int y) { return &bin_[(size_t)(y % MORPH_ROWS) * width_]; }
+    uint8_t* dilRow(int y) { return &dil_[(size_t)(y % MORPH_ROWS) * width_]; }
+
+    static const int MED_ROWS   = 3;
+    static const int MORPH_ROWS = 3;
+
+    int radius_;
+    int c_;
+    /// Gaussian weights of the threshold mean, as cv::getGaussianKernel()
+    /// makes them for float images.
+    std::vector<float> weights_;
+
+    /// Width of the image being run, the stride of the rings, and the
+    /// widest one they have room for.
+    int width_;
+    int capacity_;
+    int sharpRows_;
+    int meanRows_;
+    std::vector<uint8_t> med_;
+    std::vector<uint8_t> sharp_;
+    /// Horizontally filtered sharpened rows.
+    std::vector<float> hmean_;
+    std::vector<uint8_t> bin_;
+    std::vector<uint8_t> dil_;
+    std::vector<uint8_t> morphTmp_;
+    std::vector<const float*> meanRowPtrs_;
+};
@@ -23,7 +23,10 @@
 #include <assert.h>
 #include <errno.h>
 #include <gmodule.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #include "vdo-map.h"
 #include <vdo-channel.h>
@@ -61,40 +64,56 @@ static bool allocateVdoBuffers(ImgProvider_t* provider, VdoStream* vdoStream);
  */
 static void releaseVdoBuffers(ImgProvider_t* provider);
 
+/**
+ * brief Look up the metadata slot of one of the provider's buffers.
+ *
+ * param provider ImageProvider pointer.
+ * param buffer One of the buffers in provider->vdoBuffers.
+ * return Pointer to the buffer's metadata.
+ */
+static ImgFrameInfo_t* findFrameInfo(ImgProvider_t* provider, VdoBuffer* buffer);
+
+/**
+ * brief Make the frame eventfd readable.
+ *
+ * param provider ImageProvider pointer.
+ */
+static void signalFrame(ImgProvider_t* provider);
+
+/**
+ * brief Enqueue a buffer back to VDO from the fetcher thread.
+ *
+ * param provider ImageProvider pointer.
+ * param buffer Buffer to hand back to VDO.
+ */
+static void enqueueToVdo(ImgProvider_t* provider, VdoBuffer* buffer);
+
 /**
  * brief Starting point function for the thread fetching frames.
  *
  * Responsible for fetching buffers/frames from VDO and re-enqueue buffers back
- * to VDO when they are not needed by the application. The ImgProvider always
- * keeps one or several of the most recent frames available in the application.
- * There are two queues involved: deliveredFrames and processedFrames.
- * - deliveredFrames are frames delivered from VDO and
- *   not processed by the client.
- * - processedFrames are frames that the client has consumed and handed
- *   back to the ImgProvider.
+ * to VDO when they are not needed by the application. Frames are exchanged
+ * with the client without locks:
+ * - latestFrame is a single-slot mailbox holding the newest frame the
+ *   client has not taken yet.
+ * - recycleRing holds frames the client has consumed and handed back.
  * The thread works roughly like this:
- * 1. The thread blocks on vdo_stream_get_buffer() until VDO deliver a new
- * frame.
- * 2. The fresh frame is put at the end of the deliveredFrame queue. If the
- *    client want to fetch a frame the item at the end of deliveredFrame
- *    list is returned.
- * 3. If there are any frames in the processedFrames list one of these are
- *    enqueued back to VDO to keep the flow of buffers.
- * 4. If the processedFrames list is empty we instead check if there are
- *    frames available in the deliveredFrames list. We want to make sure
- *    there is at least numAppFrames buffers available to the client to
- *    fetch. If there are more than numAppFrames in deliveredFrames we
- *    pick the first buffer (oldest) in the list and enqueue it to VDO.
+ * 1. Frames in recycleRing are enqueued back to VDO.
+ * 2. The thread blocks on vdo_stream_get_buffer() until VDO deliver a new
+ *    frame.
+ * 3. The fresh frame is swapped into latestFrame. If the mailbox already
+ *    held a frame the client never took, that frame is stale and is
+ *    enqueued back to VDO right away. If the mailbox was empty the client
+ *    is notified through frameEventFd.
+ * The thread never waits for the client, so a slow client only causes
+ * stale frames to be dropped.
 
  * param data Pointer to ImgProvider owning thread.
  * return Pointer to unused return data.
  */
 static void* threadEntry(void* data);
 
-ImgProvider_t*
-createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFormat format) {
-    bool mtxInitialized  = false;
-    bool condInitialized = false;
+ImgProvider_t* createImgProvider(unsigned int w, unsigned int h, VdoFormat format) {
 
     ImgProvider_t* provider = (ImgProvider_t*)calloc(1, sizeof(ImgProvider_t));
     if (!provider) {
@@ -102,33 +121,11 @@ createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFor
         goto errorExit;
     }
 
-    provider->vdoFormat    = format;
-    provider->numAppFrames = numFrames;
+    provider->vdoFormat = format;
 
-    if (pthread_mutex_init(&provider->frameMutex, NULL)) {
-        syslog(LOG_ERR, "%s: Unable to initialize mutex: %s", __func__, strerror(errno));
-        goto errorExit;
-    }
-    mtxInitialized = true;
-
-    if (pthread_cond_init(&provider->frameDeliverCond, NULL)) {
-        syslog(LOG_ERR,
-               "%s: Unable to initialize condition variable: %s",
-               __func__,
-               strerror(errno));
-        goto errorExit;
-    }
-    condInitialized = true;
-
-    provider->deliveredFrames = g_queue_new();
-    if (!provider->deliveredFrames) {
-        syslog(LOG_ERR, "%s: Unable to create deliveredFrames queue!", __func__);
-        goto errorExit;
-    }
-
-    provider->processedFrames = g_queue_new();
-    if (!provider->processedFrames) {
-        syslog(LOG_ERR, "%s: Unable to create processedFrames queue!", __func__);
+    provider->frameEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (provider->frameEventFd < 0) {
+        syslog(LOG_ERR, "%s: Unable to create frame eventfd: %s", __func__, strerror(errno));
         goto errorExit;
     }
 
@@ -140,17 +137,8 @@ createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFor
     return provider;
 
 errorExit:
-    if (mtxInitialized) {
-        pthread_mutex_destroy(&provider->frameMutex);
-    }
-    if (condInitialized) {
-        pthread_cond_destroy(&provider->frameDeliverCond);
-    }
-    if (provider->deliveredFrames) {
-        g_queue_free(provider->deliveredFrames);
-    }
-    if (provider->processedFrames) {
-        g_queue_free(provider->processedFrames);
+    if (provider && provider->frameEventFd >= 0) {
+        close(provider->frameEventFd);
     }
 
     free(provider);
@@ -166,11 +154,7 @@ void destroyImgProvider(ImgProvider_t* provider) {
 
     releaseVdoBuffers(provider);
 
-    pthread_mutex_destroy(&provider->frameMutex);
-    pthread_cond_destroy(&provider->frameDeliverCond);
-
-    g_queue_free(provider->deliveredFrames);
-    g_queue_free(provider->processedFrames);
+    close(provider->frameEventFd);
 
     free(provider);
 }
@@ -213,7 +197,8 @@ bool allocateVdoBuffers(ImgProvider_t* provider, VdoStream* vdoStream) {
         }
     }
 
-    ret = true;
+    provider->buffersInVdo = NUM_VDO_BUFFERS;
+    ret                    = true;
 
 errorExit:
     g_clear_error(&error);
@@ -329,6 +314,30 @@ bool createStream(ImgProvider_t* provider, unsigned int w, unsigned int h) {
         releaseVdoBuffers(provider);
     }
 
+    // Buffers may be padded, so pick up the actual row pitch of the stream.
+    provider->streamWidth  = w;
+    provider->streamHeight = h;
+    provider->streamPitch  = w;
+    VdoMap* info           = vdo_stream_get_info(vdoStream, &error);
+    if (info) {
+        provider->streamWidth  = vdo_map_get_uint32(info, "width", w);
+        provider->streamHeight = vdo_map_get_uint32(info, "height", h);
+        provider->streamPitch  = vdo_map_get_uint32(info, "pitch", provider->streamWidth);
+        g_object_unref(info);
+    } else {
+        syslog(LOG_WARNING,
+               "%s: Failed to get stream info, assuming unpadded buffers: %s",
+               __func__,
+               (error != NULL) ? error->message : "N/A");
+        g_clear_error(&error);
+    }
+    syslog(LOG_INFO,
+           "%s: Stream is %u x %u with pitch %u",
+           __func__,
+           provider->streamWidth,
+           provider->streamHeight,
+           provider->streamPitch);
+
     if (!allocateVdoBuffers(provider, vdoStream)) {
         syslog(LOG_ERR, "%s: Failed setting up VDO buffers!", __func__);
         releaseVdoBuffers(provider);
@@ -364,31 +373,115 @@ static void releaseVdoBuffers(ImgProvider_t* provider) {
     }
 }
 
-VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider) {
-    VdoBuffer* returnBuf = NULL;
-    pthread_mutex_lock(&provider->frameMutex);
-
-    while (g_queue_get_length(provider->deliveredFrames) < 1) {
-        if (pthread_cond_wait(&provider->frameDeliverCond, &provider->frameMutex)) {
-            syslog(LOG_ERR, "%s: Failed to wait on condition: %s", __func__, strerror(errno));
-            goto errorExit;
-        }
+VdoBuffer* getLastFrame(ImgProvider_t* provider, ImgFrameInfo_t* info) {
+    // Clear the frame notification before looking in the mailbox. A frame
+    // published after this point leaves the eventfd readable, so a client
+    // polling the eventfd can never miss one.
+    uint64_t count;
+    if (read(provider->frameEventFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        syslog(LOG_WARNING, "%s: Failed to read frame eventfd: %s", __func__, strerror(errno));
     }
 
-    returnBuf = (VdoBuffer*)g_queue_pop_tail(provider->deliveredFrames);
+    VdoBuffer* returnBuf = provider->latestFrame.exchange(NULL, std::memory_order_acq_rel);
+    if (!returnBuf) {
+        return NULL;
+    }
 
-errorExit:
-    pthread_mutex_unlock(&provider->frameMutex);
+    ImgFrameInfo_t* frameInfo = findFrameInfo(provider, returnBuf);
+    frameInfo->handoutTime    = g_get_monotonic_time();
+    frameInfo->framesSkipped  = provider->haveLastSequenceNbr
+                                   ? frameInfo->sequenceNbr - provider->lastSequenceNbr - 1
+                                   : 0;
+    provider->lastSequenceNbr     = frameInfo->sequenceNbr;
+    provider->haveLastSequenceNbr = true;
+    provider->framesSkipped.fetch_add(frameInfo->framesSkipped, std::memory_order_relaxed);
+
+    int64_t maxAge = provider->maxFrameAgeUs.load(std::memory_order_relaxed);
+    if (maxAge > 0 && frameInfo->handoutTime - frameInfo->captureTime > maxAge) {
+        provider->framesDroppedAged.fetch_add(1, std::memory_order_relaxed);
+        returnFrame(provider, returnBuf);
+        return NULL;
+    }
 
+    if (info) {
+        *info = *frameInfo;
+    }
     return returnBuf;
 }
 
+VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider, ImgFrameInfo_t* info) {
+    struct pollfd pfd = {provider->frameEventFd, POLLIN, 0};
+
+    for (;;) {
+        VdoBuffer* returnBuf = getLastFrame(provider, info);
+        if (returnBuf) {
+            return returnBuf;
+        }
+
+        if (provider->shutDown) {
+            return NULL;
+        }
+
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "%s: Failed to wait for frame: %s", __func__, strerror(errno));
+            return NULL;
+        }
+    }
+}
+
+int getFrameEventFd(ImgProvider_t* provider) {
+    return provider->frameEventFd;
+}
+
+void setMaxFrameAge(ImgProvider_t* provider, unsigned int maxAgeMs) {
+    provider->maxFrameAgeUs.store((int64_t)maxAgeMs * 1000, std::memory_order_relaxed);
+}
+
 void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer) {
-    pthread_mutex_lock(&provider->frameMutex);
+    // Only the client writes recycleTail, and the ring can hold every
+    // buffer there is, so it can never overflow.
+    unsigned int tail = provider->recycleTail.load(std::memory_order_relaxed);
+    provider->recycleRing[tail % NUM_VDO_BUFFERS] = buffer;
+    provider->recycleTail.store(tail + 1, std::memory_order_release);
+}
+
+void getImgProviderStats(ImgProvider_t* provider, ImgProviderStats_t* stats) {
+    stats->framesDelivered    = provider->framesDelivered.load(std::memory_order_relaxed);
+    stats->framesDroppedStale = provider->framesDroppedStale.load(std::memory_order_relaxed);
+    stats->bufferStarvation   = provider->bufferStarvation.load(std::memory_order_relaxed);
+    stats->framesDroppedAged  = provider->framesDroppedAged.load(std::memory_order_relaxed);
+    stats->framesSkipped      = provider->framesSkipped.load(std::memory_order_relaxed);
+}
+
+static ImgFrameInfo_t* findFrameInfo(ImgProvider_t* provider, VdoBuffer* buffer) {
+    size_t i = 0;
+    while (i < NUM_VDO_BUFFERS - 1 && provider->vdoBuffers[i] != buffer) {
+        i++;
+    }
+    assert(provider->vdoBuffers[i] == buffer);
+    return &provider->frameInfo[i];
+}
+
+static void signalFrame(ImgProvider_t* provider) {
+    const uint64_t one = 1;
+    if (write(provider->frameEventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        syslog(LOG_WARNING, "%s: Failed to signal frame: %s", __func__, strerror(errno));
+    }
+}
 
-    g_queue_push_tail(provider->processedFrames, buffer);
+static void enqueueToVdo(ImgProvider_t* provider, VdoBuffer* buffer) {
+    GError* error = NULL;
 
-    pthread_mutex_unlock(&provider->frameMutex);
+    if (!vdo_stream_buffer_enqueue(provider->vdoStream, buffer, &error)) {
+        // Fail but we continue anyway hoping for the best.
+        syslog(LOG_WARNING,
+               "%s: Failed enqueueing buffer to vdo: %s",
+               __func__,
+               (error != NULL) ? error->message : "N/A");
+        g_clear_error(&error);
+        return;
+    }
+    provider->buffersInVdo++;
 }
 
 static void* threadEntry(void* data) {
@@ -396,6 +489,14 @@ static void* threadEntry(void* data) {
     ImgProvider_t* provider = (ImgProvider_t*)data;
 
     while (!provider->shutDown) {
+        // Hand frames the client is done with back to VDO.
+        unsigned int head = provider->recycleHead.load(std::memory_order_relaxed);
+        unsigned int tail = provider->recycleTail.load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            enqueueToVdo(provider, provider->recycleRing[head % NUM_VDO_BUFFERS]);
+        }
+        provider->recycleHead.store(head, std::memory_order_release);
+
         // Block waiting for a frame from VDO
         VdoBuffer* newBuffer = vdo_stream_get_buffer(provider->vdoStream, &error);
 
@@ -408,38 +509,30 @@ static void* threadEntry(void* data) {
             g_clear_error(&error);
             continue;
         }
-        pthread_mutex_lock(&provider->frameMutex);
-
-        g_queue_push_tail(provider->deliveredFrames, newBuffer);
-
-        VdoBuffer* oldBuffer = NULL;
+        g_object_unref(newBuffer);  // Release the ref from vdo_stream_get_buffer
 
-        // First check if there are any frames returned from app
-        // processing
-        if (g_queue_get_length(provider->processedFrames) > 0) {
-            oldBuffer = (VdoBuffer*)g_queue_pop_head(provider->processedFrames);
-        } else {
-            // Client specifies the number-of-recent-frames it needs to collect
-            // in one chunk (numAppFrames). Thus only enqueue buffers back to
-            // VDO if we have collected more buffers than numAppFrames.
-            if (g_queue_get_length(provider->deliveredFrames) > provider->numAppFrames) {
-                oldBuffer = (VdoBuffer*)g_queue_pop_head(provider->deliveredFrames);
-            }
+        if (--provider->buffersInVdo == 0) {
+            provider->bufferStarvation.fetch_add(1, std::memory_order_relaxed);
         }
 
-        if (oldBuffer) {
-            if (!vdo_stream_buffer_enqueue(provider->vdoStream, oldBuffer, &error)) {
-                // Fail but we continue anyway hoping for the best.
-                syslog(LOG_WARNING,
-                       "%s: Failed enqueueing buffer to vdo: %s",
-                       __func__,
-                       (error != NULL) ? error->message : "N/A");
-                g_clear_error(&error);
-            }
+        // Published to the client together with the buffer by the exchange
+        // below.
+        VdoFrame* frame           = vdo_buffer_get_frame(newBuffer);
+        ImgFrameInfo_t* frameInfo = findFrameInfo(provider, newBuffer);
+        frameInfo->sequenceNbr    = vdo_frame_get_sequence_nbr(frame);
+        frameInfo->captureTime    = (int64_t)vdo_frame_get_timestamp(frame);
+        frameInfo->deliveryTime   = g_get_monotonic_time();
+
+        VdoBuffer* staleBuffer = provider->latestFrame.exchange(newBuffer, std::memory_order_acq_rel);
+        provider->framesDelivered.fetch_add(1, std::memory_order_relaxed);
+
+        if (staleBuffer) {
+            // The client never took this one and never will.
+            provider->framesDroppedStale.fetch_add(1, std::memory_order_relaxed);
+            enqueueToVdo(provider, staleBuffer);
+        } else {
+            signalFrame(provider);
         }
-        g_object_unref(newBuffer);  // Release the ref from vdo_stream_get_buffer
-        pthread_cond_signal(&provider->frameDeliverCond);
-        pthread_mutex_unlock(&provider->frameMutex);
     }
     return NULL;
 }
@@ -458,6 +551,8 @@ bool startFrameFetch(ImgProvider_t* provider) {
 
 bool stopFrameFetch(ImgProvider_t* provider) {
     provider->shutDown = true;
+    // Wake up a client blocked in getLastFrameBlocking().
+    signalFrame(provider);
 
     if (pthread_join(provider->fetcherThread, NULL)) {
         syslog(LOG_ERR,
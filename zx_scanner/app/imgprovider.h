@@ -22,6 +22,7 @@
 
 #include <atomic>
 #include <pthread.h>
+#include <stdint.h>
 #define _Atomic(X) std::atomic<X>
 
 #include <stdbool.h>
@@ -31,6 +32,25 @@
 
 #define NUM_VDO_BUFFERS (8)
 
+/**
+ * brief Metadata of a frame handed out by getLastFrame().
+ *
+ * All times are in microseconds on the g_get_monotonic_time() clock.
+ */
+typedef struct ImgFrameInfo {
+    /// VDO sequence number of the frame.
+    unsigned int sequenceNbr;
+    /// Frames captured by VDO between the previously handed out frame and
+    /// this one that the client never saw.
+    unsigned int framesSkipped;
+    /// When VDO captured the frame.
+    int64_t captureTime;
+    /// When the fetcher thread received the frame from VDO.
+    int64_t deliveryTime;
+    /// When the frame was handed to the client.
+    int64_t handoutTime;
+} ImgFrameInfo_t;
+
 /**
  * brief A type representing a provider of frames from VDO.
  *
@@ -41,24 +61,76 @@
 typedef struct ImgProvider {
     /// Stream configuration parameters.
     VdoFormat vdoFormat;
+    /// Geometry of the created stream. Rows of the Y and CbCr planes are
+    /// streamPitch bytes apart, which may be more than streamWidth.
+    unsigned int streamWidth;
+    unsigned int streamHeight;
+    unsigned int streamPitch;
 
     /// Vdo stream and buffers handling.
     VdoStream* vdoStream;
     VdoBuffer* vdoBuffers[NUM_VDO_BUFFERS];
 
-    /// Keeping track of frames' statuses.
-    GQueue* deliveredFrames;
-    GQueue* processedFrames;
-    /// Number of frames to keep in the deliveredFrames queue.
-    unsigned int numAppFrames;
+    /// Latest-frame mailbox. Holds the newest frame delivered by VDO that
+    /// the client has not taken yet, or NULL. The fetcher swaps new frames
+    /// in, the client swaps NULL in to take one.
+    std::atomic<VdoBuffer*> latestFrame;
+    /// eventfd signalled when a frame lands in an empty mailbox. Stays
+    /// readable until the next attempt to take a frame.
+    int frameEventFd;
+
+    /// Single-producer/single-consumer ring of frames the client has handed
+    /// back. Filled by returnFrame(), drained by the fetcher which enqueues
+    /// the buffers to VDO. Never holds more than NUM_VDO_BUFFERS entries.
+    VdoBuffer* recycleRing[NUM_VDO_BUFFERS];
+    std::atomic<unsigned int> recycleHead;
+    std::atomic<unsigned int> recycleTail;
+
+    /// Number of buffers currently enqueued in VDO, owned by the fetcher.
+    unsigned int buffersInVdo;
+
+    /// Per-buffer metadata, indexed like vdoBuffers. Written by the fetcher
+    /// before a frame is published in latestFrame.
+    ImgFrameInfo_t frameInfo[NUM_VDO_BUFFERS];
+    /// Frames older than this are discarded by getLastFrame(),
+    /// 0 disables the check.
+    std::atomic<int64_t> maxFrameAgeUs;
+    /// Sequence number of the last frame handed to the client, owned by
+    /// the client thread.
+    unsigned int lastSequenceNbr;
+    bool haveLastSequenceNbr;
+
+    /// Frame flow counters, see ImgProviderStats_t.
+    std::atomic<uint64_t> framesDelivered;
+    std::atomic<uint64_t> framesDroppedStale;
+    std::atomic<uint64_t> bufferStarvation;
+    std::atomic<uint64_t> framesDroppedAged;
+    std::atomic<uint64_t> framesSkipped;
 
     /// To support fetching frames asynchonously with VDO.
-    pthread_mutex_t frameMutex;
-    pthread_cond_t frameDeliverCond;
     pthread_t fetcherThread;
     std::atomic_bool shutDown;
 } ImgProvider_t;
 
+/**
+ * brief Counters describing how frames flowed through an ImgProvider.
+ */
+typedef struct ImgProviderStats {
+    /// Frames received from VDO and put in the mailbox.
+    uint64_t framesDelivered;
+    /// Frames replaced in the mailbox by a newer one before the client
+    /// took them. These go straight back to VDO.
+    uint64_t framesDroppedStale;
+    /// Frames received while no other buffer was enqueued in VDO, meaning
+    /// the client held on to buffers long enough for VDO to run dry.
+    uint64_t bufferStarvation;
+    /// Frames the client took but that were discarded for being older than
+    /// the maximum frame age.
+    uint64_t framesDroppedAged;
+    /// Sum of ImgFrameInfo_t framesSkipped over all handed out frames.
+    uint64_t framesSkipped;
+} ImgProviderStats_t;
+
 /**
  * brief Find VDO resolution that best fits requirement.
  *
@@ -86,12 +158,10 @@ bool chooseStreamResolution(unsigned int reqWidth,
  *
  * param w Requested output image width.
  * param h Requested ouput image height.
- * param numFrames Number of fetched frames to keep.
  * param vdoFormat Image format to be output by stream.
  * return Pointer to new ImgProvider, or NULL if failed.
  */
-ImgProvider_t*
-createImgProvider(unsigned int w, unsigned int h, unsigned int numFrames, VdoFormat vdoFormat);
+ImgProvider_t* createImgProvider(unsigned int w, unsigned int h, VdoFormat vdoFormat);
 
 /**
  * brief Release VDO buffers and deallocate provider.
@@ -116,13 +186,48 @@ bool startFrameFetch(ImgProvider_t* provider);
  */
 bool stopFrameFetch(ImgProvider_t* provider);
 
+/**
+ * brief Take the most recent frame the thread has fetched from VDO.
+ *
+ * Never blocks. Frames are handed to a single client thread, which must be
+ * the same thread that calls returnFrame(). If a maximum frame age is set,
+ * frames older than that are handed back to VDO instead of returned.
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * param info Filled with the frame's metadata, may be NULL.
+ * return Pointer to an image buffer, or NULL if there is no new frame.
+ */
+VdoBuffer* getLastFrame(ImgProvider_t* provider, ImgFrameInfo_t* info);
+
 /**
  * brief Get the most recent frame the thread has fetched from VDO.
  *
+ * Like getLastFrame() but waits until a new frame is available.
+ *
  * param provider Pointer to an ImgProvider fetching frames.
+ * param info Filled with the frame's metadata, may be NULL.
  * return Pointer to an image buffer on success, otherwise NULL.
  */
-VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider);
+VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider, ImgFrameInfo_t* info);
+
+/**
+ * brief File descriptor that becomes readable when a new frame is available.
+ *
+ * Meant for polling from a main loop, see framesource.h. Readiness is
+ * cleared by getLastFrame(), the descriptor must not be read directly.
+ *
+ * param provider Pointer to an ImgProvider fetching frames.
+ * return An eventfd owned by the provider.
+ */
+int getFrameEventFd(ImgProvider_t* provider);
+
+/**
+ * brief Discard frames older than a given age instead of handing them out.
+ *
+ * param provider Pointer to an ImgProvider.
+ * param maxAgeMs Maximum age since capture in milliseconds, 0 to disable.
+ */
+void setMaxFrameAge(ImgProvider_t* provider, unsigned int maxAgeMs);
 
 /**
  * brief Release reference to an image buffer.
@@ -131,3 +236,11 @@ VdoBuffer* getLastFrameBlocking(ImgProvider_t* provider);
  * param buffer Pointer to the image buffer to be released.
  */
 void returnFrame(ImgProvider_t* provider, VdoBuffer* buffer);
+
+/**
+ * brief Read the frame flow counters of a provider.
+ *
+ * param provider Pointer to an ImgProvider.
+ * param stats Filled with the current counter values.
+ */
+void getImgProviderStats(ImgProvider_t* provider, ImgProviderStats_t* stats);
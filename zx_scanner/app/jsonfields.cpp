@@ -0,0 +1,276 @@
+#include "jsonfields.h"
+
+#include <string.h>
+
+static const char* skip_space(const char* p, const char* end);
+static const char* skip_string(const char* p, const char* end);
+static const char* skip_value(const char* p, const char* end, std::string_view* value);
+static size_t next_char(const char*& p, const char* end, char* out);
+static int hex_value(const char* p, const char* end);
+
+bool jsonFields(std::string_view json, const std::string_view* names, std::string_view* values, size_t count) {
+    const char* end = json.data() + json.size();
+    const char* p   = skip_space(json.data(), end);
+
+    for (size_t i = 0; i < count; i++) {
+        values[i] = std::string_view();
+    }
+    if (p == end || *p != '{') {
+        return false;
+    }
+    p = skip_space(p + 1, end);
+    if (p < end && *p == '}') {
+        return true;
+    }
+
+    for (;;) {
+        // "name" : value
+        if (p == end || *p != '"') {
+            return false;
+        }
+        const char* name_end = skip_string(p + 1, end);
+        if (!name_end) {
+            return false;
+        }
+        std::string_view name(p + 1, name_end - p - 1);
+        p = skip_space(name_end + 1, end);
+        if (p == end || *p != ':') {
+            return false;
+        }
+        std::string_view value;
+        p = skip_value(skip_space(p + 1, end), end, &value);
+        if (!p) {
+            return false;
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (jsonStringEquals(name, names[i], false)) {
+                values[i] = value;
+            }
+        }
+
+        // , or the end of the object
+        p = skip_space(p, end);
+        if (p == end) {
+            return false;
+        }
+        if (*p == '}') {
+            return true;
+        }
+        if (*p != ',') {
+            return false;
+        }
+        p = skip_space(p + 1, end);
+    }
+}
+
+bool jsonStringEquals(std::string_view value, std::string_view text, bool foldCase) {
+    const char* p   = value.data();
+    const char* end = p + value.size();
+    size_t at       = 0;
+    char decoded[4];
+
+    // Names are compared for every field, they rarely hold escapes
+    if (value.empty() || !memchr(p, '\\', value.size())) {
+        if (!foldCase || value.size() != text.size()) {
+            return value == text;
+        }
+        for (size_t i = 0; i < value.size(); i++) {
+            char c = p[i] >= 'A' && p[i] <= 'Z' ? p[i] - 'A' + 'a' : p[i];
+            if (text[i] != c) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    for (size_t size; (size = next_char(p, end, decoded)) > 0;) {
+        for (size_t i = 0; i < size; i++) {
+            char c = foldCase && decoded[i] >= 'A' && decoded[i] <= 'Z' ? decoded[i] - 'A' + 'a' : decoded[i];
+            if (at == text.size() || text[at++] != c) {
+                return false;
+            }
+        }
+    }
+    return at == text.size();
+}
+
+uint64_t jsonStringHash(std::string_view value, bool foldCase) {
+    const char* p   = value.data();
+    const char* end = p + value.size();
+    uint64_t hash   = 0xcbf29ce484222325ULL;
+    char decoded[4];
+
+    if (value.empty() || !memchr(p, '\\', value.size())) {
+        for (; p < end; p++) {
+            char c = foldCase && *p >= 'A' && *p <= 'Z' ? *p - 'A' + 'a' : *p;
+            hash ^= (unsigned char)c;
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    for (size_t size; (size = next_char(p, end, decoded)) > 0;) {
+        for (size_t i = 0; i < size; i++) {
+            char c = foldCase && decoded[i] >= 'A' && decoded[i] <= 'Z' ? decoded[i] - 'A' + 'a' : decoded[i];
+            hash ^= (unsigned char)c;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+static const char* skip_space(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+// Find the closing quote of a string starting at p, NULL if there is none
+static const char* skip_string(const char* p, const char* end) {
+    for (;;) {
+        const char* quote = (const char*)memchr(p, '"', end - p);
+        if (!quote) {
+            return nullptr;
+        }
+        // Escaped if an odd number of backslashes comes before it
+        const char* escape = quote;
+        while (escape > p && escape[-1] == '\\') {
+            escape--;
+        }
+        if ((quote - escape) % 2 == 0) {
+            return quote;
+        }
+        p = quote + 1;
+    }
+}
+
+// Skip the value starting at p, return what follows it or NULL if it is
+// not valid
+static const char* skip_value(const char* p, const char* end, std::string_view* value) {
+    const char* start = p;
+    if (p == end) {
+        return nullptr;
+    }
+
+    if (*p == '"') {
+        const char* close = skip_string(p + 1, end);
+        if (!close) {
+            return nullptr;
+        }
+        *value = std::string_view(p + 1, close - p - 1);
+        return close + 1;
+    }
+
+    // Objects and arrays are skipped whole, strings in them may hold
+    // brackets
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                p = skip_string(p + 1, end);
+                if (!p) {
+                    return nullptr;
+                }
+            } else if (*p == '{' || *p == '[') {
+                depth++;
+            } else if ((*p == '}' || *p == ']') && --depth == 0) {
+                *value = std::string_view(start, p + 1 - start);
+                return p + 1;
+            }
+            p++;
+        }
+        return nullptr;
+    }
+
+    // Numbers, true, false and null
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\n' &&
+           *p != '\r') {
+        p++;
+    }
+    if (p == start) {
+        return nullptr;
+    }
+    *value = std::string_view(start, p - start);
+    return p;
+}
+
+// Decode the next character of an escaped string as UTF-8, return its
+// length in bytes or 0 at the end
+static size_t next_char(const char*& p, const char* end, char* out) {
+    if (p >= end) {
+        return 0;
+    }
+    char c = *p++;
+    if (c != '\\' || p == end) {
+        out[0] = c;
+        return 1;
+    }
+
+    c = *p++;
+    switch (c) {
+    case 'b': out[0] = '\b'; return 1;
+    case 'f': out[0] = '\f'; return 1;
+    case 'n': out[0] = '\n'; return 1;
+    case 'r': out[0] = '\r'; return 1;
+    case 't': out[0] = '\t'; return 1;
+    case 'u': break;
+    default: out[0] = c; return 1;
+    }
+
+    // \uXXXX, a surrogate pair is two of them
+    int code = hex_value(p, end);
+    if (code < 0) {
+        out[0] = 'u';
+        return 1;
+    }
+    p += 4;
+    if (code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+        int low = hex_value(p + 2, end);
+        if (low >= 0xdc00 && low < 0xe000) {
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            p += 6;
+        }
+    }
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xc0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3f));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xe0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (code & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (code & 0x3f));
+    return 4;
+}
+
+// Value of four hex digits, -1 if they are not
+static int hex_value(const char* p, const char* end) {
+    int value = 0;
+
+    if (end - p < 4) {
+        return -1;
+    }
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        int digit = c >= '0' && c <= '9'   ? c - '0'
+                    : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                    : c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                           : -1;
+        if (digit < 0) {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
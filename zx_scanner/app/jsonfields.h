@@ -0,0 +1,52 @@
+/**
+ * Picks a few fields out of a JSON object in a single pass, without
+ * copying or allocating.
+ *
+ * The answers of the endpoint are small objects of which only a couple of
+ * fields are read. Values are returned as views into the text: strings
+ * still escaped and without their quotes, other values as their literal
+ * text. Escapes are resolved while comparing or hashing a string, so a
+ * value is never copied out. Any formatting, escapes and non-string values
+ * are handled.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string_view>
+
+/**
+ * brief Find fields of the top level object of a JSON text.
+ *
+ * Nested objects and arrays are skipped over, including their fields. If a
+ * field occurs more than once the last one counts.
+ *
+ * param json The text.
+ * param names Names of the fields to find.
+ * param values Filled with the value of each field, a view with a NULL
+ *        data() if the field is missing.
+ * param count Number of fields.
+ * return false if the text is not a valid JSON object. Fields found before
+ *         the error are still filled in.
+ */
+bool jsonFields(std::string_view json, const std::string_view* names, std::string_view* values, size_t count);
+
+/**
+ * brief Compare a string value of jsonFields() to a text.
+ *
+ * param value The value, still escaped.
+ * param text Text to compare to, lowercase if foldCase is set.
+ * param foldCase Whether ASCII letters of the value are lowercased first.
+ * return Whether the unescaped value equals text.
+ */
+bool jsonStringEquals(std::string_view value, std::string_view text, bool foldCase);
+
+/**
+ * brief Hash a string value of jsonFields().
+ *
+ * param value The value, still escaped.
+ * param foldCase Whether ASCII letters are lowercased first.
+ * return fnv1a64() of the unescaped value.
+ */
+uint64_t jsonStringHash(std::string_view value, bool foldCase);
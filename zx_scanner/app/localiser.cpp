@@ -0,0 +1,187 @@
+#include "localiser.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+Localiser::Localiser()
+    : maxCandidates_(2),
+      cellsWide_(0),
+      cellsHigh_(0),
+      frames_(0),
+      candidatesFound_(0),
+      framesEmpty_(0) {}
+
+void Localiser::setMaxCandidates(int count) {
+    maxCandidates_.store(count > 0 ? count : 1, std::memory_order_relaxed);
+}
+
+// Average every SCALE x SCALE block, the few rows and columns left over at
+// the right and bottom edges are dropped
+const cv::Mat& Localiser::shrink(const cv::Mat& luma) {
+    frameSize_ = luma.size();
+    int width  = luma.cols / SCALE;
+    int height = luma.rows / SCALE;
+    if (small_.cols != width || small_.rows != height) {
+        small_.create(height, width, CV_8UC1);
+        rowSums_.assign((size_t)width * SCALE, 0);
+    }
+
+    for (int sy = 0; sy < height; sy++) {
+        // Sum SCALE rows first, then SCALE columns of those sums
+        const uint8_t* src = luma.ptr<uint8_t>(sy * SCALE);
+        for (int x = 0; x < width * SCALE; x++) {
+            rowSums_[x] = src[x];
+        }
+        for (int dy = 1; dy < SCALE; dy++) {
+            src = luma.ptr<uint8_t>(sy * SCALE + dy);
+            for (int x = 0; x < width * SCALE; x++) {
+                rowSums_[x] += src[x];
+            }
+        }
+
+        uint8_t* dst = small_.ptr<uint8_t>(sy);
+        for (int sx = 0; sx < width; sx++) {
+            const uint16_t* sums = &rowSums_[(size_t)sx * SCALE];
+            unsigned int sum     = 0;
+            for (int dx = 0; dx < SCALE; dx++) {
+                sum += sums[dx];
+            }
+            dst[sx] = (uint8_t)((sum + SCALE * SCALE / 2) / (SCALE * SCALE));
+        }
+    }
+    return small_;
+}
+
+// Score every whole cell by the smaller of its horizontal and vertical edge
+// counts
+void Localiser::scoreCells() {
+    cellsWide_ = small_.cols / CELL;
+    cellsHigh_ = small_.rows / CELL;
+    size_t cells = (size_t)cellsWide_ * cellsHigh_;
+    if (scores_.size() != cells) {
+        scores_.resize(cells);
+        visited_.resize(cells);
+        edgesX_.resize(cellsWide_);
+        edgesY_.resize(cellsWide_);
+    }
+
+    for (int cy = 0; cy < cellsHigh_; cy++) {
+        std::fill(edgesX_.begin(), edgesX_.end(), 0);
+        std::fill(edgesY_.begin(), edgesY_.end(), 0);
+
+        for (int y = cy * CELL; y < (cy + 1) * CELL; y++) {
+            // Neighbours are clamped at the image border
+            const uint8_t* above = small_.ptr<uint8_t>(std::max(y - 1, 0));
+            const uint8_t* row   = small_.ptr<uint8_t>(y);
+            const uint8_t* below = small_.ptr<uint8_t>(std::min(y + 1, small_.rows - 1));
+            int last             = small_.cols - 1;
+
+            for (int x = 0; x < cellsWide_ * CELL; x++) {
+                int left  = row[std::max(x - 1, 0)];
+                int right = row[std::min(x + 1, last)];
+                edgesX_[x / CELL] += abs(right - left) > EDGE_CONTRAST;
+                edgesY_[x / CELL] += abs((int)below[x] - (int)above[x]) > EDGE_CONTRAST;
+            }
+        }
+
+        for (int cx = 0; cx < cellsWide_; cx++) {
+            scores_[(size_t)cy * cellsWide_ + cx] = std::min(edgesX_[cx], edgesY_[cx]);
+        }
+    }
+}
+
+// Collect 8-connected groups of busy cells
+void Localiser::groupCells() {
+    groups_.clear();
+    std::fill(visited_.begin(), visited_.end(), 0);
+
+    for (int start = 0; start < cellsWide_ * cellsHigh_; start++) {
+        if (visited_[start] || scores_[start] < MIN_CELL_EDGES) {
+            continue;
+        }
+
+        Group_t group = {cellsWide_, cellsHigh_, -1, -1, 0, 0};
+        visited_[start] = 1;
+        stack_.clear();
+        stack_.push_back(start);
+        while (!stack_.empty()) {
+            int cell = stack_.back();
+            stack_.pop_back();
+
+            int cx = cell % cellsWide_;
+            int cy = cell / cellsWide_;
+            group.left   = std::min(group.left, cx);
+            group.top    = std::min(group.top, cy);
+            group.right  = std::max(group.right, cx);
+            group.bottom = std::max(group.bottom, cy);
+            group.edges += scores_[cell];
+
+            for (int ny = std::max(cy - 1, 0); ny <= std::min(cy + 1, cellsHigh_ - 1); ny++) {
+                for (int nx = std::max(cx - 1, 0); nx <= std::min(cx + 1, cellsWide_ - 1); nx++) {
+                    int next = ny * cellsWide_ + nx;
+                    if (!visited_[next] && scores_[next] >= MIN_CELL_EDGES) {
+                        visited_[next] = 1;
+                        stack_.push_back(next);
+                    }
+                }
+            }
+        }
+
+        // QR codes are square, so long thin groups of edges, like a line of
+        // text or the edge of a stripe, rank lower than their edge count
+        int width   = group.right - group.left + 1;
+        int height  = group.bottom - group.top + 1;
+        group.score = group.edges * (uint32_t)std::min(width, height) / (uint32_t)std::max(width, height);
+        groups_.push_back(group);
+    }
+}
+
+const std::vector<cv::Rect>& Localiser::locate(const cv::Size& window) {
+    candidates_.clear();
+    frames_.fetch_add(1, std::memory_order_relaxed);
+
+    scoreCells();
+    groupCells();
+    std::sort(groups_.begin(), groups_.end(), [](const Group_t& a, const Group_t& b) { return a.score > b.score; });
+
+    int width  = std::min(window.width, frameSize_.width);
+    int height = std::min(window.height, frameSize_.height);
+    size_t max = (size_t)maxCandidates_.load(std::memory_order_relaxed);
+    for (const Group_t& group : groups_) {
+        if (candidates_.size() >= max) {
+            break;
+        }
+
+        // Centre a window on the group, moved inside the frame if needed
+        int pixelsPerCell = CELL * SCALE;
+        int centreX       = (group.left + group.right + 1) * pixelsPerCell / 2;
+        int centreY       = (group.top + group.bottom + 1) * pixelsPerCell / 2;
+        int x             = std::min(std::max(centreX - width / 2, 0), frameSize_.width - width);
+        int y             = std::min(std::max(centreY - height / 2, 0), frameSize_.height - height);
+        cv::Rect candidate(x, y, width, height);
+
+        // A group mostly covered by a better candidate adds nothing
+        bool covered = false;
+        for (const cv::Rect& other : candidates_) {
+            if ((candidate & other).area() * 2 > candidate.area()) {
+                covered = true;
+                break;
+            }
+        }
+        if (!covered) {
+            candidates_.push_back(candidate);
+        }
+    }
+
+    candidatesFound_.fetch_add(candidates_.size(), std::memory_order_relaxed);
+    if (candidates_.empty()) {
+        framesEmpty_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return candidates_;
+}
+
+void Localiser::getStats(LocaliserStats_t* stats) const {
+    stats->frames      = frames_.load(std::memory_order_relaxed);
+    stats->candidates  = candidatesFound_.load(std::memory_order_relaxed);
+    stats->framesEmpty = framesEmpty_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,127 @@
+/**
+ * Finds regions of the full frame that may hold a QR code.
+ *
+ * Decoding used to be limited to a fixed crop in the centre of the frame, so
+ * passes held off-centre were never read, and widening the crop would make
+ * the enhancement pipeline far more expensive. Instead the whole Y plane is
+ * shrunk 4x and cut into cells of 8x8 shrunk pixels (32x32 in the frame).
+ * A QR code is dense in strong edges in both directions, unlike most text,
+ * clothing or background, so each cell is scored by the smaller of its
+ * horizontal and vertical edge counts. Connected groups of busy cells are
+ * ranked by their total score, scaled down for groups that are much wider
+ * than high or the other way round, and the best few become candidate
+ * regions.
+ *
+ * Every candidate has the same, fixed size, centred on its group of cells.
+ * That keeps the cost of enhancing and decoding one candidate the same as
+ * that of the old centre crop, and lets the pipeline keep its buffers.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+/**
+ * brief Counters of the candidates found.
+ */
+typedef struct {
+    uint64_t frames;
+    uint64_t candidates;
+    /// Frames without a single candidate, which are not decoded at all.
+    uint64_t framesEmpty;
+} LocaliserStats_t;
+
+/**
+ * brief Candidate localiser with its buffers.
+ *
+ * shrink() and locate() must always be called from the same thread, the
+ * other methods may be called from any thread.
+ */
+class Localiser {
+public:
+    Localiser();
+
+    /**
+     * brief Set the most candidates locate() returns.
+     *
+     * param count Number of candidates, at least 1.
+     */
+    void setMaxCandidates(int count);
+
+    /**
+     * brief Shrink a full Y plane, the first step of locating candidates.
+     *
+     * param luma The full greyscale frame.
+     * return The frame shrunk 4x, valid until the next call.
+     */
+    const cv::Mat& shrink(const cv::Mat& luma);
+
+    /**
+     * brief Find candidate regions in the frame last given to shrink().
+     *
+     * param window Size of every candidate region in frame pixels.
+     * return Candidates in frame coordinates, most promising first, valid
+     *        until the next call. Empty if nothing looks like a code.
+     */
+    const std::vector<cv::Rect>& locate(const cv::Size& window);
+
+    /**
+     * brief Get the counters accumulated so far.
+     *
+     * param stats Filled with the counters.
+     */
+    void getStats(LocaliserStats_t* stats) const;
+
+private:
+    /// Shrink factor of the frame.
+    static const int SCALE = 4;
+    /// Cell size in shrunk pixels.
+    static const int CELL = 8;
+    /// Difference between the neighbours of a shrunk pixel that counts as
+    /// an edge.
+    static const int EDGE_CONTRAST = 24;
+    /// Edges each way a cell needs to be part of a candidate.
+    static const int MIN_CELL_EDGES = 6;
+
+    typedef struct {
+        int left;
+        int top;
+        int right;
+        int bottom;
+        /// Sum of the cell scores.
+        uint32_t edges;
+        /// Edges weighted by how square the group is, used for ranking.
+        uint32_t score;
+    } Group_t;
+
+    void scoreCells();
+    void groupCells();
+
+    std::atomic<int> maxCandidates_;
+
+    /// Owned by the thread calling shrink() and locate().
+    cv::Size frameSize_;
+    cv::Mat small_;
+    std::vector<uint16_t> rowSums_;
+    int cellsWide_;
+    int cellsHigh_;
+    std::vector<uint16_t> scores_;
+    /// Edge counts of one row of cells.
+    std::vector<uint16_t> edgesX_;
+    std::vector<uint16_t> edgesY_;
+    std::vector<uint8_t> visited_;
+    std::vector<int> stack_;
+    std::vector<Group_t> groups_;
+    std::vector<cv::Rect> candidates_;
+
+    std::atomic<uint64_t> frames_;
+    std::atomic<uint64_t> candidatesFound_;
+    std::atomic<uint64_t> framesEmpty_;
+};
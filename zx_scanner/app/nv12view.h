@@ -0,0 +1,53 @@
+/**
+ * Zero-copy views into NV12 frames delivered by VDO.
+ *
+ * The scanner only needs luminance, which VDO already delivers as the Y
+ * plane of every NV12 buffer. These views wrap the buffer memory directly,
+ * honouring the stream pitch, so cropping a region of interest costs
+ * nothing. The chroma plane is never read.
+ */
+
+#pragma once
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+
+#include <ZXing/ImageView.h>
+
+/**
+ * brief A non-owning view of one NV12 frame.
+ *
+ * The view is only valid while the underlying VDO buffer is held, i.e.
+ * until it is handed back with returnFrame().
+ */
+class Nv12View {
+public:
+    Nv12View(void* data, unsigned int width, unsigned int height, unsigned int pitch)
+        : data_(static_cast<uint8_t*>(data)), width_(width), height_(height), pitch_(pitch) {}
+
+    unsigned int width() const { return width_; }
+    unsigned int height() const { return height_; }
+
+    /// The full Y plane.
+    cv::Mat luma() const { return cv::Mat((int)height_, (int)width_, CV_8UC1, data_, pitch_); }
+
+    /// A region of the Y plane, still pointing into the VDO buffer.
+    cv::Mat luma(const cv::Rect& roi) const { return luma()(roi); }
+
+private:
+    uint8_t* data_;
+    unsigned int width_;
+    unsigned int height_;
+    unsigned int pitch_;
+};
+
+/**
+ * brief Wrap a single channel Mat for ZXing without copying.
+ *
+ * Works for ROIs and padded buffers since the row stride is passed along.
+ */
+static inline ZXing::ImageView toImageView(const cv::Mat& grey) {
+    return ZXing::ImageView(grey.data, grey.cols, grey.rows, ZXing::ImageFormat::Lum, (int)grey.step);
+}
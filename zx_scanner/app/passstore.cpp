@@ -0,0 +1,364 @@
+#include "passstore.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "dedupcache.h"
+
+#define FILE_MAGIC   "PSTR"
+#define FILE_VERSION 2
+// Longest cursor that is kept, a longer one makes the next sync a full one
+#define MAX_CURSOR 128
+// Slots of an empty table
+#define MIN_SLOTS 1024
+// Low bits of a slot holding the value instead of the hash
+#define VALUE_MASK 0xfULL
+// Most seconds a sync may take
+#define SYNC_TIMEOUT_S 60
+
+// Start of the saved file, followed by the slots
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t slots;
+    uint32_t count;
+    // Of the header with crc 0 and the slots
+    uint32_t crc;
+    char cursor[MAX_CURSOR];
+} FileHeader_t;
+
+static uint32_t file_crc(FileHeader_t header, const std::vector<uint64_t>& slots);
+static uint32_t crc32_update(uint32_t crc, const void* data, size_t size);
+
+PassStore::PassStore()
+    : slots_(MIN_SLOTS, 0),
+      count_(0),
+      stop_(false),
+      intervalS_(60),
+      hits_(0),
+      misses_(0),
+      syncs_(0),
+      syncFailures_(0) {}
+
+PassStore::~PassStore() {
+    stopSync();
+}
+
+bool PassStore::open(const char* path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        syslog(LOG_INFO, "No stored passes in %s", path);
+        return false;
+    }
+
+    FileHeader_t header;
+    std::vector<uint64_t> slots;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, FILE_MAGIC, 4) == 0 &&
+                 header.version == FILE_VERSION && header.slots >= MIN_SLOTS &&
+                 (header.slots & (header.slots - 1)) == 0 && header.count <= header.slots / 2 &&
+                 header.cursor[MAX_CURSOR - 1] == '\0';
+    if (valid) {
+        slots.resize(header.slots);
+        valid = fread(slots.data(), sizeof(uint64_t), slots.size(), file) == slots.size();
+    }
+    fclose(file);
+
+    // A torn or corrupt table could be full, and find() would never stop
+    if (valid) {
+        size_t used = std::count_if(slots.begin(), slots.end(), [](uint64_t slot) { return slot != 0; });
+        valid       = header.crc == file_crc(header, slots) && used == header.count;
+    }
+    if (!valid) {
+        syslog(LOG_WARNING, "Ignoring invalid stored passes in %s", path);
+        return false;
+    }
+
+    slots_.swap(slots);
+    count_  = header.count;
+    cursor_ = header.cursor;
+    syslog(LOG_INFO, "Loaded %zu stored passes from %s", count_, path);
+    return true;
+}
+
+int PassStore::lookup(const char* text, size_t size) {
+    uint64_t hash = fnv1a64(text, size);
+    int value     = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        value = (int)(slots_[find(hash)] & VALUE_MASK);
+    }
+    if (value) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return value;
+}
+
+void PassStore::startSync(const std::string& url, int intervalS) {
+    url_ = url;
+    setSyncInterval(intervalS);
+    stop_   = false;
+    thread_ = std::thread(&PassStore::run, this);
+}
+
+void PassStore::setSyncInterval(int intervalS) {
+    intervalS_.store(intervalS > 0 ? intervalS : 1, std::memory_order_relaxed);
+}
+
+void PassStore::stopSync() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stop_ = true;
+    }
+    wakeup_.notify_all();
+    thread_.join();
+}
+
+void PassStore::getStats(PassStoreStats_t* stats) {
+    stats->hits         = hits_.load(std::memory_order_relaxed);
+    stats->misses       = misses_.load(std::memory_order_relaxed);
+    stats->syncs        = syncs_.load(std::memory_order_relaxed);
+    stats->syncFailures = syncFailures_.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats->passes = count_;
+}
+
+// The sync thread, syncs right away and then every interval
+void PassStore::run() {
+    HttpClient_t* client = httpClientNew();
+    if (!client) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(wakeMutex_);
+    while (!stop_) {
+        lock.unlock();
+        if (sync(client)) {
+            syncs_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            syncFailures_.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock.lock();
+        wakeup_.wait_for(lock, std::chrono::seconds(intervalS_.load(std::memory_order_relaxed)), [this] {
+            return stop_;
+        });
+    }
+    lock.unlock();
+    httpClientFree(client);
+}
+
+// Fetch the changes since the last sync and apply them
+bool PassStore::sync(HttpClient_t* client) {
+    std::string url = url_;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        char* since = httpClientEscape(client, cursor_.c_str());
+        if (!since) {
+            return false;
+        }
+        url += "&since=";
+        url += since;
+        curl_free(since);
+    }
+
+    // A full list can take a while on a slow link, but must not hang
+    HttpResponse_t response;
+    CURL* curl = httpClientBeginGet(client, url.c_str(), NULL);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)SYNC_TIMEOUT_S);
+    if (!httpClientFinish(client, curl_easy_perform(curl), &response)) {
+        return false;
+    }
+    if (response.status != 200) {
+        syslog(LOG_INFO, "Pass sync answered %ld", response.status);
+        return false;
+    }
+    if (apply(response.body, response.size)) {
+        save();
+    }
+    return true;
+}
+
+// Apply the answer of a sync, true if anything changed
+bool PassStore::apply(const char* body, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const char* end = body + size;
+    bool changed    = false;
+    size_t updates  = 0;
+
+    for (const char* line = body; line < end;) {
+        const char* next = (const char*)memchr(line, '\n', end - line);
+        const char* stop = next ? next : end;
+        size_t length    = stop - line;
+        if (length > 0 && line[length - 1] == '\r') {
+            length--;
+        }
+
+        if (length == 4 && memcmp(line, "full", 4) == 0) {
+            slots_.assign(MIN_SLOTS, 0);
+            count_  = 0;
+            changed = true;
+        } else if (length > 7 && memcmp(line, "cursor ", 7) == 0) {
+            std::string cursor(line + 7, length - 7);
+            if (cursor.size() >= MAX_CURSOR) {
+                syslog(LOG_WARNING, "Pass sync cursor too long, the next sync is a full one");
+                cursor.clear();
+            }
+            changed = changed || cursor != cursor_;
+            cursor_ = cursor;
+        } else if (length > 0) {
+            // <value> <code>, the code may hold spaces of its own
+            int value        = 0;
+            const char* code = line;
+            while (code < line + length && *code >= '0' && *code <= '9' && value <= (int)VALUE_MASK) {
+                value = value * 10 + (*code++ - '0');
+            }
+            if (code == line || code >= line + length || *code != ' ' || value > (int)VALUE_MASK) {
+                syslog(LOG_WARNING, "Ignoring pass sync line: %.*s", (int)std::min(length, (size_t)64), line);
+            } else {
+                code++;
+                uint64_t hash = fnv1a64(code, line + length - code);
+                if (value) {
+                    insert(hash, value);
+                } else {
+                    remove(hash);
+                }
+                changed = true;
+                updates++;
+            }
+        }
+        line = next ? next + 1 : end;
+    }
+    if (updates) {
+        syslog(LOG_INFO, "Pass sync applied %zu changes, %zu passes stored", updates, count_);
+    }
+    return changed;
+}
+
+// Write the table to a new file and move it over the old one, so a power
+// cut leaves one or the other
+void PassStore::save() {
+    FileHeader_t header = {};
+    std::vector<uint64_t> slots;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (path_.empty()) {
+            return;
+        }
+        slots = slots_;
+        memcpy(header.magic, FILE_MAGIC, 4);
+        header.version = FILE_VERSION;
+        header.slots   = (uint32_t)slots.size();
+        header.count   = (uint32_t)count_;
+        strncpy(header.cursor, cursor_.c_str(), MAX_CURSOR - 1);
+    }
+    header.crc = file_crc(header, slots);
+
+    std::string temp = path_ + ".new";
+    FILE* file       = fopen(temp.c_str(), "wb");
+    if (!file) {
+        syslog(LOG_WARNING, "Failed to save passes to %s: %m", temp.c_str());
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(slots.data(), sizeof(uint64_t), slots.size(), file) == slots.size() &&
+                   fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if (fclose(file) != 0 || !written || rename(temp.c_str(), path_.c_str()) != 0) {
+        syslog(LOG_WARNING, "Failed to save passes to %s: %m", path_.c_str());
+        unlink(temp.c_str());
+    }
+}
+
+// Slots are probed linearly from the bits of the hash above the value
+size_t PassStore::find(uint64_t hash) const {
+    size_t mask  = slots_.size() - 1;
+    size_t index = (size_t)(hash >> 4) & mask;
+
+    while (slots_[index] && ((slots_[index] ^ hash) & ~VALUE_MASK) != 0) {
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+void PassStore::insert(uint64_t hash, int value) {
+    size_t index = find(hash);
+    if (!slots_[index]) {
+        // Kept at most half full, so probes stay short
+        if ((count_ + 1) * 2 > slots_.size()) {
+            grow();
+            index = find(hash);
+        }
+        count_++;
+    }
+    slots_[index] = (hash & ~VALUE_MASK) | (uint64_t)value;
+}
+
+// Close the gap left by a removed pass by moving later passes of the same
+// probe run back, so no tombstones are needed
+void PassStore::remove(uint64_t hash) {
+    size_t mask = slots_.size() - 1;
+    size_t hole = find(hash);
+    if (!slots_[hole]) {
+        return;
+    }
+
+    for (size_t next = (hole + 1) & mask; slots_[next]; next = (next + 1) & mask) {
+        size_t home = (size_t)(slots_[next] >> 4) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots_[hole] = slots_[next];
+            hole         = next;
+        }
+    }
+    slots_[hole] = 0;
+    count_--;
+}
+
+void PassStore::grow() {
+    std::vector<uint64_t> old(slots_.size() * 2, 0);
+    old.swap(slots_);
+    for (uint64_t slot : old) {
+        if (slot) {
+            slots_[find(slot)] = slot;
+        }
+    }
+}
+
+static uint32_t file_crc(FileHeader_t header, const std::vector<uint64_t>& slots) {
+    header.crc = 0;
+    return crc32_update(crc32_update(0, &header, sizeof(header)), slots.data(), slots.size() * sizeof(uint64_t));
+}
+
+// CRC-32 as zlib computes it, the table is built once on first use
+static uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> entries = {};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320U ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+        return entries;
+    }();
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
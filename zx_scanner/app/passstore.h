@@ -0,0 +1,137 @@
+/**
+ * The passes of this entrance, kept on the device so scans are resolved
+ * without asking the server.
+ *
+ * Passes are keyed by a 64 bit hash of their text in an open addressing
+ * table, 8 bytes per pass: the hash with its low 4 bits replaced by the
+ * SuccessValue the server would answer. A lookup is a few memory reads.
+ * The table is saved to flash after every change, with a CRC, and loaded
+ * at start, so the device resolves scans before the first sync and while
+ * offline.
+ *
+ * A background thread keeps the table up to date from a sync endpoint. It
+ * sends GET <url>&since=<cursor> and gets a text answer, one item per line:
+ *
+ *     full                 the passes below replace all stored ones
+ *     <value> <code>       the pass is answered with SuccessValue value, 1 to
+ *                          15, or removed with 0
+ *     cursor <token>       sent as since on the next sync
+ *
+ * Without a cursor the server is expected to answer with a full list.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httpclient.h"
+
+/**
+ * brief Counters of the lookups and syncs.
+ */
+typedef struct {
+    /// Lookups of a stored pass.
+    uint64_t hits;
+    /// Lookups of a pass not stored, left to the server.
+    uint64_t misses;
+    /// Syncs answered by the server.
+    uint64_t syncs;
+    /// Syncs that got no answer or not a 200.
+    uint64_t syncFailures;
+    /// Passes stored now.
+    uint64_t passes;
+} PassStoreStats_t;
+
+/**
+ * brief The stored passes and the thread syncing them.
+ *
+ * Lookups may be made from any thread.
+ */
+class PassStore {
+public:
+    PassStore();
+    ~PassStore();
+
+    /**
+     * brief Load the passes saved by an earlier run.
+     *
+     * param path File the passes are saved to from now on.
+     * return false if no valid file was found, the store then starts empty.
+     */
+    bool open(const char* path);
+
+    /**
+     * brief Look up a pass.
+     *
+     * param text The decoded text.
+     * param size Length of the text.
+     * return The SuccessValue stored for the pass, 0 if it is not stored.
+     */
+    int lookup(const char* text, size_t size);
+
+    /**
+     * brief Start syncing in the background.
+     *
+     * httpClientGlobalInit() must have been called first.
+     *
+     * param url Sync endpoint with its query, the cursor is appended.
+     * param intervalS Seconds between syncs.
+     */
+    void startSync(const std::string& url, int intervalS);
+
+    /**
+     * brief Change the time between syncs, from the next one on.
+     *
+     * param intervalS Seconds between syncs, at least 1.
+     */
+    void setSyncInterval(int intervalS);
+
+    /**
+     * brief Stop syncing and wait for the thread to finish.
+     */
+    void stopSync();
+
+    /**
+     * brief Get the counters accumulated so far.
+     *
+     * param stats Filled with the counters.
+     */
+    void getStats(PassStoreStats_t* stats);
+
+private:
+    void run();
+    bool sync(HttpClient_t* client);
+    bool apply(const char* body, size_t size);
+    void save();
+    void insert(uint64_t hash, int value);
+    void remove(uint64_t hash);
+    size_t find(uint64_t hash) const;
+    void grow();
+
+    /// Guards the table and the cursor.
+    std::mutex mutex_;
+    /// Slots of the table, a power of two of them, 0 for a free one.
+    std::vector<uint64_t> slots_;
+    size_t count_;
+    std::string cursor_;
+    std::string path_;
+
+    std::string url_;
+    std::thread thread_;
+    std::mutex wakeMutex_;
+    std::condition_variable wakeup_;
+    bool stop_;
+    std::atomic<int> intervalS_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> syncs_;
+    std::atomic<uint64_t> syncFailures_;
+};
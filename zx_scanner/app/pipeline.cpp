@@ -0,0 +1,531 @@
+#include "pipeline.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "fusedkernel.h"
+
+const char* const pipelineParameterNames[] = {"PIPELINE",
+                                              "CLAHE_CLIP_LIMIT",
+                                              "CLAHE_TILES",
+                                              "UPSCALE_FACTOR",
+                                              "UPSCALE_SCALES",
+                                              "MEDIAN_KSIZE",
+                                              "UNSHARP_AMOUNT",
+                                              "THRESHOLD_BLOCK_SIZE",
+                                              "THRESHOLD_C",
+                                              "CLOSE_KSIZE",
+                                              "FUSED_KERNEL",
+                                              "FUSED_VERIFY",
+                                              NULL};
+
+bool setPipelineParameter(PipelineConfig_t& config, const char* name, const char* value) {
+    if (!strcmp(name, "PIPELINE")) {
+        config.stages = value;
+    } else if (!strcmp(name, "CLAHE_CLIP_LIMIT")) {
+        config.claheClipLimit = atof(value);
+    } else if (!strcmp(name, "CLAHE_TILES")) {
+        config.claheTiles = atoi(value);
+    } else if (!strcmp(name, "UPSCALE_FACTOR")) {
+        config.upscaleFactor = atoi(value);
+    } else if (!strcmp(name, "UPSCALE_SCALES")) {
+        config.upscaleScales = value;
+    } else if (!strcmp(name, "MEDIAN_KSIZE")) {
+        config.medianKsize = atoi(value);
+    } else if (!strcmp(name, "UNSHARP_AMOUNT")) {
+        config.unsharpAmount = atof(value);
+    } else if (!strcmp(name, "THRESHOLD_BLOCK_SIZE")) {
+        config.thresholdBlockSize = atoi(value);
+    } else if (!strcmp(name, "THRESHOLD_C")) {
+        config.thresholdC = atoi(value);
+    } else if (!strcmp(name, "CLOSE_KSIZE")) {
+        config.closeKsize = atoi(value);
+    } else if (!strcmp(name, "FUSED_KERNEL")) {
+        config.fusedKernel = atoi(value) != 0;
+    } else if (!strcmp(name, "FUSED_VERIFY")) {
+        config.fusedVerify = std::max(atoi(value), 0);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Clamp a kernel size to an odd number of at least 3
+static int oddKsize(const char* name, int ksize) {
+    int fixed = ksize < 3 ? 3 : ksize | 1;
+    if (fixed != ksize) {
+        syslog(LOG_WARNING, "%s %d is not an odd number >= 3, using %d", name, ksize, fixed);
+    }
+    return fixed;
+}
+
+// A view of the given size into store, which grows to hold it if needed.
+// Stages keep scratch images this way, so that running at several scales
+// does not reallocate them frame after frame.
+static cv::Mat scratch(cv::Mat& store, const cv::Size& size, int type) {
+    if (store.type() != type || store.total() < (size_t)size.area()) {
+        store.create(1, size.area(), type);
+    }
+    return cv::Mat(size, type, store.data);
+}
+
+// Contrast Limited Adaptive Histogram Equalization
+class ClaheStage : public Stage {
+public:
+    ClaheStage(double clipLimit, int tiles)
+        : clahe_(cv::createCLAHE(clipLimit > 0 ? clipLimit : 2.0,
+                                 cv::Size(std::max(tiles, 1), std::max(tiles, 1)))) {}
+    const char* name() const override { return "clahe"; }
+    void apply(const cv::Mat& src, cv::Mat& dst) override { clahe_->apply(src, dst); }
+
+private:
+    cv::Ptr<cv::CLAHE> clahe_;
+};
+
+// Enlarge small codes for better resolution. With several scales
+// configured, the pipeline sets the output size per scale, which may also
+// be smaller than the input.
+class UpscaleStage : public Stage {
+public:
+    UpscaleStage(int factor) : factor_(std::min(std::max(factor, 1), 4)) {
+        if (factor_ != factor) {
+            syslog(LOG_WARNING, "UPSCALE_FACTOR %d out of range 1-4, using %d", factor, factor_);
+        }
+    }
+    const char* name() const override { return "upscale"; }
+    cv::Size outputSize(const cv::Size& inputSize) const override {
+        return cv::Size(inputSize.width * factor_, inputSize.height * factor_);
+    }
+    void apply(const cv::Mat& src, cv::Mat& dst) override {
+        if (dst.size() == src.size()) {
+            src.copyTo(dst);
+        } else {
+            cv::resize(src, dst, dst.size(), 0, 0, dst.cols < src.cols ? cv::INTER_AREA : cv::INTER_CUBIC);
+        }
+    }
+
+private:
+    int factor_;
+};
+
+// Noise reduction
+class MedianStage : public Stage {
+public:
+    MedianStage(int ksize) : ksize_(oddKsize("MEDIAN_KSIZE", ksize)) {}
+    const char* name() const override { return "median"; }
+    void apply(const cv::Mat& src, cv::Mat& dst) override { cv::medianBlur(src, dst, ksize_); }
+
+private:
+    int ksize_;
+};
+
+// Sharpening using unsharp mask, the sharpened image replaces the blurred
+// one in place
+class UnsharpStage : public Stage {
+public:
+    UnsharpStage(double amount) : amount_(amount) {}
+    const char* name() const override { return "unsharp"; }
+    void apply(const cv::Mat& src, cv::Mat& dst) override {
+        cv::GaussianBlur(src, dst, cv::Size(3, 3), 0);
+        cv::addWeighted(src, 1.0 + amount_, dst, -amount_, 0, dst);
+    }
+
+private:
+    double amount_;
+};
+
+// Adaptive thresholding (better for varying lighting). This is
+// cv::adaptiveThreshold(ADAPTIVE_THRESH_GAUSSIAN_C, THRESH_BINARY) with the
+// scratch images kept between frames. The mean is computed in float like
+// OpenCV does to keep the output identical.
+class ThresholdStage : public Stage {
+public:
+    ThresholdStage(int blockSize, int c) : blockSize_(oddKsize("THRESHOLD_BLOCK_SIZE", blockSize)) {
+        for (int i = 0; i < 768; i++) {
+            tab_[i] = (uchar)(i - 255 > -c ? 255 : 0);
+        }
+    }
+    const char* name() const override { return "threshold"; }
+    void allocate(const cv::Size& inputSize) override {
+        scratch(srcFloat_, inputSize, CV_32FC1);
+        scratch(meanFloat_, inputSize, CV_32FC1);
+    }
+    void apply(const cv::Mat& src, cv::Mat& dst) override {
+        cv::Mat srcFloat  = scratch(srcFloat_, src.size(), CV_32FC1);
+        cv::Mat meanFloat = scratch(meanFloat_, src.size(), CV_32FC1);
+        src.convertTo(srcFloat, CV_32F);
+        cv::GaussianBlur(srcFloat,
+                         meanFloat,
+                         cv::Size(blockSize_, blockSize_),
+                         0,
+                         0,
+                         cv::BORDER_REPLICATE | cv::BORDER_ISOLATED);
+        for (int y = 0; y < src.rows; y++) {
+            const uchar* s = src.ptr<uchar>(y);
+            const float* m = meanFloat.ptr<float>(y);
+            uchar* d       = dst.ptr<uchar>(y);
+            for (int x = 0; x < src.cols; x++) {
+                d[x] = tab_[s[x] - cv::saturate_cast<uchar>(m[x]) + 255];
+            }
+        }
+    }
+
+private:
+    int blockSize_;
+    /// Lookup on src - mean + 255, the table cv::adaptiveThreshold() builds
+    uchar tab_[768];
+    cv::Mat srcFloat_;
+    cv::Mat meanFloat_;
+};
+
+// Morphological closing (removes gaps in QR patterns)
+class CloseStage : public Stage {
+public:
+    CloseStage(int ksize) {
+        ksize   = oddKsize("CLOSE_KSIZE", ksize);
+        kernel_ = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(ksize, ksize));
+    }
+    const char* name() const override { return "close"; }
+    void allocate(const cv::Size& inputSize) override { scratch(dilated_, inputSize, CV_8UC1); }
+    void apply(const cv::Mat& src, cv::Mat& dst) override {
+        cv::Mat dilated = scratch(dilated_, src.size(), CV_8UC1);
+        cv::dilate(src, dilated, kernel_);
+        cv::erode(dilated, dst, kernel_);
+    }
+
+private:
+    cv::Mat kernel_;
+    cv::Mat dilated_;
+};
+
+// median, unsharp, threshold and close in a single pass, see fusedkernel.h.
+// Every verifyInterval frames the result is compared to the separate
+// stages. blockSize must already be odd.
+class FusedStage : public Stage {
+public:
+    FusedStage(int blockSize, int c, int verifyInterval)
+        : kernel_(blockSize, c),
+          verifyInterval_(verifyInterval),
+          frames_(0),
+          median_(3),
+          unsharp_(0.5),
+          threshold_(blockSize, c),
+          close_(3) {}
+    const char* name() const override { return "fused"; }
+    void allocate(const cv::Size& inputSize) override {
+        kernel_.allocate(inputSize.width);
+        if (verifyInterval_ > 0) {
+            scratch(refA_, inputSize, CV_8UC1);
+            scratch(refB_, inputSize, CV_8UC1);
+            threshold_.allocate(inputSize);
+            close_.allocate(inputSize);
+        }
+    }
+    void apply(const cv::Mat& src, cv::Mat& dst) override {
+        kernel_.run(src.data, src.step, dst.data, dst.step, src.cols, src.rows);
+        if (verifyInterval_ > 0 && ++frames_ % verifyInterval_ == 0) {
+            verify(src, dst);
+        }
+    }
+
+private:
+    void verify(const cv::Mat& src, const cv::Mat& dst) {
+        cv::Mat refA = scratch(refA_, src.size(), CV_8UC1);
+        cv::Mat refB = scratch(refB_, src.size(), CV_8UC1);
+        median_.apply(src, refA);
+        unsharp_.apply(refA, refB);
+        threshold_.apply(refB, refA);
+        close_.apply(refA, refB);
+
+        int differ = 0;
+        for (int y = 0; y < dst.rows; y++) {
+            const uchar* a = dst.ptr<uchar>(y);
+            const uchar* b = refB.ptr<uchar>(y);
+            for (int x = 0; x < dst.cols; x++) {
+                differ += a[x] != b[x];
+            }
+        }
+        syslog(LOG_INFO,
+               "Fused kernel differs from the separate stages in %d of %d pixels",
+               differ,
+               dst.rows * dst.cols);
+    }
+
+    FusedKernel kernel_;
+    int verifyInterval_;
+    unsigned int frames_;
+    /// The stages the kernel replaces, only run to verify it
+    MedianStage median_;
+    UnsharpStage unsharp_;
+    ThresholdStage threshold_;
+    CloseStage close_;
+    cv::Mat refA_;
+    cv::Mat refB_;
+};
+
+static Stage* createStage(const std::string& name, const PipelineConfig_t& config) {
+    if (name == "clahe") {
+        return new ClaheStage(config.claheClipLimit, config.claheTiles);
+    } else if (name == "upscale") {
+        return new UpscaleStage(config.upscaleFactor);
+    } else if (name == "median") {
+        return new MedianStage(config.medianKsize);
+    } else if (name == "unsharp") {
+        return new UnsharpStage(config.unsharpAmount);
+    } else if (name == "threshold") {
+        return new ThresholdStage(config.thresholdBlockSize, config.thresholdC);
+    } else if (name == "close") {
+        return new CloseStage(config.closeKsize);
+    } else if (name == "fused") {
+        return new FusedStage(oddKsize("THRESHOLD_BLOCK_SIZE", config.thresholdBlockSize),
+                              config.thresholdC,
+                              config.fusedVerify);
+    }
+    return NULL;
+}
+
+Pipeline::Pipeline() : configChanged_(true), done_(0), upscale_(0), scale_(0), steadyStateAllocations_(0) {}
+
+// Parse a comma separated list of scales, dropping invalid ones
+static std::vector<double> parseScales(const std::string& list) {
+    std::vector<double> scales;
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string item = list.substr(start, end - start);
+        start            = end + 1;
+
+        double scale = atof(item.c_str());
+        if (scale >= 0.25 && scale <= 4) {
+            scales.push_back(scale);
+        } else if (item.find_first_not_of(' ') != std::string::npos) {
+            syslog(LOG_WARNING, "UPSCALE_SCALES: scale '%s' not in range 0.25-4 ignored", item.c_str());
+        }
+    }
+    return scales;
+}
+
+void Pipeline::configure(const PipelineConfig_t& config) {
+    std::lock_guard<std::mutex> lock(configMutex_);
+    pendingConfig_ = config;
+    configChanged_.store(true, std::memory_order_release);
+}
+
+void Pipeline::rebuild() {
+    PipelineConfig_t config;
+    {
+        std::lock_guard<std::mutex> lock(configMutex_);
+        config = pendingConfig_;
+        configChanged_.store(false, std::memory_order_relaxed);
+    }
+
+    std::vector<std::string> names;
+    size_t start = 0;
+    while (start <= config.stages.size()) {
+        size_t end = config.stages.find(',', start);
+        if (end == std::string::npos) {
+            end = config.stages.size();
+        }
+        std::string name = config.stages.substr(start, end - start);
+        name.erase(0, name.find_first_not_of(' '));
+        name.erase(name.find_last_not_of(' ') + 1);
+        start = end + 1;
+
+        if (!name.empty()) {
+            names.push_back(name);
+        }
+    }
+
+    // The fused kernel implements the default settings of these stages
+    static const char* const fusable[] = {"median", "unsharp", "threshold", "close"};
+    if (config.fusedKernel && config.medianKsize == 3 && config.closeKsize == 3 &&
+        fabs(config.unsharpAmount - 0.5) < 1e-9) {
+        for (size_t i = 0; i + 4 <= names.size(); i++) {
+            if (std::equal(fusable, fusable + 4, names.begin() + i)) {
+                names.erase(names.begin() + i + 1, names.begin() + i + 4);
+                names[i] = "fused";
+            }
+        }
+    }
+
+    stages_.clear();
+    for (const auto& name : names) {
+        Stage* stage = createStage(name, config);
+        if (!stage) {
+            syslog(LOG_WARNING, "%s: Unknown pipeline stage '%s' ignored", __func__, name.c_str());
+            continue;
+        }
+        stages_.emplace_back(stage);
+    }
+
+    std::string used;
+    for (const auto& stage : stages_) {
+        used += used.empty() ? "" : ",";
+        used += stage->name();
+    }
+    syslog(LOG_INFO, "%s: Pipeline stages: %s", __func__, used.empty() ? "none" : used.c_str());
+
+    {
+        std::lock_guard<std::mutex> lock(timesMutex_);
+        times_.clear();
+        for (const auto& stage : stages_) {
+            times_.push_back({stage->name(), 0, 0});
+        }
+    }
+    frameTicks_.assign(stages_.size(), 0);
+
+    // Several scales only make sense with an upscale stage to apply them
+    scales_ = parseScales(config.upscaleScales);
+    upscale_ = stagesThrough("upscale");
+    if (upscale_ == 0) {
+        if (!scales_.empty()) {
+            syslog(LOG_WARNING, "%s: UPSCALE_SCALES ignored, there is no upscale stage", __func__);
+        }
+        scales_.clear();
+    } else {
+        upscale_--;
+    }
+    scale_ = 0;
+    outputs_.assign(scaleCount(), std::vector<cv::Mat>(stages_.size()));
+
+    // Force buffers to be set up for the new stages
+    roiSize_ = cv::Size();
+}
+
+void Pipeline::allocate(const cv::Size& roiSize) {
+    syslog(LOG_INFO,
+           "%s: Allocating pipeline buffers for %d x %d ROI",
+           __func__,
+           roiSize.width,
+           roiSize.height);
+
+    // Each stage alternates between the first two buffers, except that
+    // with several scales the input of the upscale stage gets the third.
+    // Find the largest image each of them has to hold at any scale.
+    auto storeOf = [this](size_t stage) {
+        return !scales_.empty() && stage + 1 == upscale_ ? 2 : stage % 2;
+    };
+    auto outputSize = [this](size_t stage, size_t scale, const cv::Size& input) {
+        if (!scales_.empty() && stage == upscale_) {
+            return cv::Size((int)lround(input.width * scales_[scale]), (int)lround(input.height * scales_[scale]));
+        }
+        return stages_[stage]->outputSize(input);
+    };
+
+    size_t largest[3] = {0, 0, 0};
+    for (size_t scale = 0; scale < scaleCount(); scale++) {
+        cv::Size size = roiSize;
+        for (size_t i = 0; i < stages_.size(); i++) {
+            if (scale == 0 || i >= upscale_) {
+                stages_[i]->allocate(size);
+            }
+            size                = outputSize(i, scale, size);
+            largest[storeOf(i)] = std::max(largest[storeOf(i)], (size_t)size.area());
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (largest[i] > store_[i].total()) {
+            store_[i].create(1, (int)largest[i], CV_8UC1);
+        }
+    }
+
+    // Continuous views into the stores with the output size of each stage
+    for (size_t scale = 0; scale < scaleCount(); scale++) {
+        cv::Size size = roiSize;
+        for (size_t i = 0; i < stages_.size(); i++) {
+            size                  = outputSize(i, scale, size);
+            outputs_[scale][i] = cv::Mat(size, CV_8UC1, store_[storeOf(i)].data);
+        }
+    }
+    roiSize_ = roiSize;
+}
+
+void Pipeline::begin(const cv::Mat& roi) {
+    uint64_t allocationsBefore = allocCounterRead ? allocCounterRead() : 0;
+
+    if (configChanged_.load(std::memory_order_acquire)) {
+        rebuild();
+    }
+    if (roi.size() != roiSize_) {
+        allocate(roi.size());
+    } else if (allocCounterRead) {
+        steadyStateAllocations_.fetch_add(allocCounterRead() - allocationsBefore, std::memory_order_relaxed);
+    }
+
+    input_ = roi;
+    done_  = 0;
+}
+
+void Pipeline::selectScale(size_t index) {
+    if (index == scale_ || index >= scaleCount()) {
+        return;
+    }
+    // Later stages ran at the old scale, their input is still in its store
+    if (done_ > upscale_) {
+        done_ = upscale_;
+    }
+    scale_ = index;
+}
+
+cv::Mat Pipeline::advance(size_t end) {
+    uint64_t allocationsBefore = allocCounterRead ? allocCounterRead() : 0;
+    size_t first               = done_;
+
+    end = std::min(end, stages_.size());
+    for (; done_ < end; done_++) {
+        int64_t start = cv::getTickCount();
+        stages_[done_]->apply(done_ ? outputs_[scale_][done_ - 1] : input_, outputs_[scale_][done_]);
+        frameTicks_[done_] = cv::getTickCount() - start;
+    }
+
+    if (first < done_) {
+        std::lock_guard<std::mutex> lock(timesMutex_);
+        for (size_t i = first; i < done_; i++) {
+            times_[i].runs++;
+            times_[i].ticks += frameTicks_[i];
+        }
+    }
+
+    if (allocCounterRead) {
+        steadyStateAllocations_.fetch_add(allocCounterRead() - allocationsBefore, std::memory_order_relaxed);
+    }
+    return done_ ? outputs_[scale_][done_ - 1] : input_;
+}
+
+size_t Pipeline::stagesThrough(const char* name) const {
+    for (size_t i = 0; i < stages_.size(); i++) {
+        if (!strcmp(stages_[i]->name(), name)) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+void Pipeline::logStageTimes(const char* label) {
+    std::string line;
+    {
+        std::lock_guard<std::mutex> lock(timesMutex_);
+        for (auto& time : times_) {
+            char entry[64];
+            snprintf(entry,
+                     sizeof(entry),
+                     "%s%s %.2f",
+                     line.empty() ? "" : ", ",
+                     time.name,
+                     time.runs ? time.ticks * 1000.0 / cv::getTickFrequency() / time.runs : 0.0);
+            line += entry;
+            time.runs  = 0;
+            time.ticks = 0;
+        }
+    }
+    if (!line.empty()) {
+        syslog(LOG_INFO, "%s ms per frame: %s", label, line.c_str());
+    }
+}
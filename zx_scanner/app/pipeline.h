@@ -0,0 +1,247 @@
+/**
+ * The image enhancement pipeline run on the region of interest before decoding.
+ *
+ * An ordered list of stages taken from the PIPELINE parameter, by default
+ * CLAHE, 2x cubic upscale, 3x3 median, unsharp mask, Gaussian adaptive
+ * threshold and a 3x3 morphological close. Each stage has its own
+ * parameters and is timed separately, so stages that cost more CPU than
+ * they gain in decode rate can be dropped on site without a rebuild. With
+ * the default settings median, unsharp, threshold and close are replaced by
+ * a single fused pass, see fusedkernel.h.
+ *
+ * Instead of a fixed upscale factor, the upscale stage can try a short list
+ * of scales, e.g. 0.5x, 1x and 2x, rerunning only the stages from the
+ * upscale on for each one. Large codes held close to the lens then decode
+ * with the heavy filters at native resolution or below.
+ *
+ * Every intermediate image is allocated once for a given configuration and
+ * ROI size and then reused: two buffers large enough for the biggest stage
+ * output take turns as source and destination, so the pipeline keeps a
+ * small working set and does not touch the heap frame after frame.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/imgproc.hpp>
+#pragma GCC diagnostic pop
+
+/**
+ * brief Number of heap allocations made so far by the calling thread.
+ *
+ * Only defined when an allocation counter is linked in, like the one in the
+ * host build (make ALLOC_HOOK=1), otherwise the address is NULL.
+ */
+extern "C" uint64_t allocCounterRead(void) __attribute__((weak));
+
+/**
+ * brief Settings of the pipeline, one field per AXParameter.
+ *
+ * The defaults reproduce the original hard-coded chain.
+ */
+typedef struct PipelineConfig {
+    /// Comma separated stage names: clahe, upscale, median, unsharp,
+    /// threshold, close and fused, in any order.
+    std::string stages         = "clahe,upscale,median,unsharp,threshold,close";
+    double claheClipLimit      = 2.0;
+    int claheTiles             = 8;
+    int upscaleFactor          = 2;
+    /// Comma separated scales for the upscale stage to try in turn instead
+    /// of upscaleFactor, e.g. "0.5,1,2". Empty for the fixed factor.
+    std::string upscaleScales;
+    int medianKsize            = 3;
+    /// Weight of the blurred image subtracted by the unsharp mask.
+    double unsharpAmount       = 0.5;
+    int thresholdBlockSize     = 25;
+    int thresholdC             = 2;
+    int closeKsize             = 3;
+    /// Run median,unsharp,threshold,close as one fused pass when their
+    /// settings allow it.
+    bool fusedKernel           = true;
+    /// Compare the fused pass to the separate stages every this many
+    /// frames, 0 never.
+    int fusedVerify            = 0;
+} PipelineConfig_t;
+
+/// AXParameter names of the PipelineConfig_t fields, NULL terminated.
+extern const char* const pipelineParameterNames[];
+
+/**
+ * brief Update one setting from its AXParameter value.
+ *
+ * param config Settings to update.
+ * param name Parameter name, see pipelineParameterNames.
+ * param value New value as a string.
+ * return False if name is not a pipeline parameter.
+ */
+bool setPipelineParameter(PipelineConfig_t& config, const char* name, const char* value);
+
+/**
+ * brief One step of the pipeline.
+ */
+class Stage {
+public:
+    virtual ~Stage() {}
+
+    /// Name as used in the PIPELINE parameter.
+    virtual const char* name() const = 0;
+
+    /// Size of the output for an input of the given size.
+    virtual cv::Size outputSize(const cv::Size& inputSize) const { return inputSize; }
+
+    /// Set up scratch buffers for inputs of the given size. May be called
+    /// with several sizes, the buffers must then fit the largest.
+    virtual void allocate(const cv::Size& inputSize) { (void)inputSize; }
+
+    /**
+     * brief Process one image.
+     *
+     * param src Input, never the same image as dst.
+     * param dst Output, already of outputSize() and type CV_8UC1.
+     */
+    virtual void apply(const cv::Mat& src, cv::Mat& dst) = 0;
+};
+
+/**
+ * brief The configured stages with their buffers and timings.
+ *
+ * begin(), advance() and run() must always be called from the same thread,
+ * configure() and logStageTimes() may be called from any thread.
+ */
+class Pipeline {
+public:
+    Pipeline();
+
+    /**
+     * brief Replace the stages, taking effect on the next run().
+     *
+     * param config New settings, invalid values are corrected and logged.
+     */
+    void configure(const PipelineConfig_t& config);
+
+    /**
+     * brief Start enhancing a new greyscale region of interest.
+     *
+     * Applies a pending configuration and (re)allocates buffers if the
+     * configuration or ROI size changed. No stage is run yet.
+     *
+     * param roi Greyscale image, may be a view into a VDO buffer. Must stay
+     *        valid until the next begin().
+     */
+    void begin(const cv::Mat& roi);
+
+    /**
+     * brief Run stages until the given one, continuing where the previous
+     * call for the same ROI stopped.
+     *
+     * param end Index of the first stage not to run, clamped to
+     *        stageCount().
+     * return The output of the last stage run, valid until the next
+     *         begin(). The ROI itself if no stage has run.
+     */
+    cv::Mat advance(size_t end);
+
+    /**
+     * brief Enhance a greyscale region of interest with all stages.
+     *
+     * param roi Greyscale image, may be a view into a VDO buffer.
+     * return The enhanced image, valid until the next call. The ROI itself
+     *        if no stages are configured.
+     */
+    cv::Mat run(const cv::Mat& roi) {
+        begin(roi);
+        return advance(stageCount());
+    }
+
+    /// Number of configured stages, only valid after begin().
+    size_t stageCount() const { return stages_.size(); }
+
+    /**
+     * brief Number of scales the upscale stage can run at, 1 unless
+     * upscale scales are configured. Only valid after begin().
+     */
+    size_t scaleCount() const { return scales_.empty() ? 1 : scales_.size(); }
+
+    /**
+     * brief Choose the scale for the upscale stage and the stages after it.
+     *
+     * If those stages already ran at another scale for this ROI, the next
+     * advance() reruns them from the upscale stage on. The stages before it
+     * are not run again.
+     *
+     * param index Index into the configured scales, below scaleCount().
+     */
+    void selectScale(size_t index);
+
+    /**
+     * brief Number of stages up to and including the first one with the
+     * given name, 0 if there is none. Only valid after begin().
+     */
+    size_t stagesThrough(const char* name) const;
+
+    /**
+     * brief Log the average time spent in each stage since the last call.
+     *
+     * param label Start of the log line, to tell pipelines apart.
+     */
+    void logStageTimes(const char* label = "Pipeline");
+
+    /**
+     * brief Heap allocations made by run() calls that did not have to
+     * allocate buffers, i.e. in steady state.
+     *
+     * Always 0 unless allocCounterRead() is available. May be read from any
+     * thread. make test in ../host fails if it is not 0 for the stages that
+     * do not call into OpenCV.
+     */
+    uint64_t steadyStateAllocations() const { return steadyStateAllocations_.load(std::memory_order_relaxed); }
+
+private:
+    typedef struct {
+        const char* name;
+        uint64_t runs;
+        int64_t ticks;
+    } StageTime_t;
+
+    void rebuild();
+    void allocate(const cv::Size& roiSize);
+
+    /// Settings handed over by configure(), guarded by configMutex_.
+    std::mutex configMutex_;
+    PipelineConfig_t pendingConfig_;
+    std::atomic<bool> configChanged_;
+
+    /// Owned by the thread calling run().
+    std::vector<std::unique_ptr<Stage>> stages_;
+    /// The ROI given to begin() and the number of stages run on it.
+    cv::Mat input_;
+    size_t done_;
+    cv::Size roiSize_;
+    /// Scales of the upscale stage, empty for its fixed factor, the index
+    /// of that stage and the selected scale.
+    std::vector<double> scales_;
+    size_t upscale_;
+    size_t scale_;
+    /// Backing store of the two ping-pong buffers, sized for the largest
+    /// stage output. With several scales, the input of the upscale stage
+    /// is kept in the third so the later stages can be rerun.
+    cv::Mat store_[3];
+    /// Views of store_ with the exact output size of each stage, one set
+    /// per scale.
+    std::vector<std::vector<cv::Mat>> outputs_;
+
+    /// Accumulated per-stage times, guarded by timesMutex_.
+    std::mutex timesMutex_;
+    std::vector<StageTime_t> times_;
+    std::vector<int64_t> frameTicks_;
+
+    std::atomic<uint64_t> steadyStateAllocations_;
+};
@@ -24,7 +24,10 @@
 #include <opencv2/imgproc.hpp>
 #pragma GCC diagnostic pop
 #include <opencv2/video.hpp>
+#include <atomic>
+#include <iterator>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 #include <opencv2/imgcodecs.hpp>
 #include <curl/curl.h>
@@ -36,9 +39,44 @@
 
 #include <ZXing/ReadBarcode.h>
 #include "send_event.h"
+#include "decoder.h"
+#include "dedupcache.h"
+#include "histogram.h"
+#include "httpmulti.h"
 #include "imgprovider.h"
+#include "jsonfields.h"
+#include "localiser.h"
+#include "passstore.h"
+#include "scanjournal.h"
+#include "framesource.h"
+#include "nv12view.h"
+#include "pipeline.h"
+#include "scenegate.h"
+#include "tracker.h"
+#include "workers.h"
 
 #define APP_NAME "ParkspassQRScanner"
+// How often frame flow statistics are written to the app log
+#define STATS_INTERVAL_S 60
+
+// Checks answered before the hedge delay follows their p95
+#define HEDGE_MIN_SAMPLES 20
+// Hedge delay until enough checks were answered
+#define HEDGE_FALLBACK_MS 1000
+// Hedge no sooner than this, so a fast server is not asked twice
+#define HEDGE_FLOOR_MS 100
+
+// SuccessValue of the event for each outcome of a check
+enum {
+    CHECK_PASS_FOUND = 1,
+    CHECK_PASS_NOT_FOUND,
+    CHECK_INVALID_FORMAT,
+    CHECK_CHECKIN_FAILED,
+    CHECK_PASS_EXPIRED,
+    CHECK_UNKNOWN_ERROR,
+    CHECK_TIMED_OUT,
+    CHECK_NO_ANSWER,
+};
 
 using namespace cv;
 
@@ -48,17 +86,105 @@ static ImgProvider_t* provider = nullptr;
 static unsigned int streamWidth;
 static unsigned int streamHeight;
 static std::string endpoint;
+static std::string endpoint_secondary;
 static std::string auth;
 static std::string location;
 static std::string entrance;
-static gboolean delay_in_progress = FALSE;
-
-static int uploadRecentEntries(const std::string& json_data, const std::string& endpoint, const std::string& auth, const std::string location, const std::string entrance);
-static bool retrieveAxParameters(std::string& endpoint, std::string& auth, std::string& location, std::string& entrance, AXParameter* handle);
-static gboolean process_frame(AppData* app_data);
-static gboolean reset_delay_flag(gpointer user_data);
-static void toLowerCase(std::string& str);
-static std::string extractValue(const std::string& json, const std::string& key);
+// Frames are processed on their own thread and main context
+static GMainContext* frame_context = nullptr;
+static GMainLoop* frame_loop = nullptr;
+static GSource* frame_source = nullptr;
+// Current pipeline settings, only used on the main loop
+static PipelineConfig_t pipeline_config;
+// Enhance and decode the regions picked by the frame thread
+static void decode_done(const FrameJob_t* job, const ZXing::Barcodes& barcodes, const cv::Rect& bounds, void* user_data);
+static DecodeWorkers workers(decode_done, NULL);
+// Checks decoded passes with the server, run by the main loop. Any number
+// of checks can be in flight.
+static HttpMulti_t* checks = nullptr;
+// Deadlines and hedging of the checks, changed on the main loop
+static HttpRequestOptions_t check_options;
+static int check_hedge_ms;
+// Latency of the answered checks, decayed every stats interval to set the
+// hedge delay, and since the last stats
+static Histogram_t check_latency;
+static Histogram_t check_latency_interval;
+static uint64_t checks_timed_out;
+// The event sent with the result of every check
+static AppData* event_data = nullptr;
+// Codes checked recently, later sightings of them are dropped
+static DedupCache dedup_cache;
+// Passes of this entrance resolved without asking the server
+static PassStore pass_store;
+// Checks without an answer, replayed once the server is back. A pass held
+// in view is only journaled once.
+static ScanJournal scan_journal;
+static DedupCache journal_seen;
+// Current dedup cache settings, only used on the main loop
+static int dedup_ttl_ms;
+static int dedup_entries;
+// Finds candidate regions in the whole frame, run on the frame thread
+static Localiser localiser;
+// Follows a decoded code so later frames only decode around it, asked by
+// the frame thread and fed by the decode workers
+static Tracker tracker;
+// Whether to decode candidate regions from the whole frame (ROI_MODE full)
+// or only the fixed centre crop (ROI_MODE center)
+static std::atomic<bool> roi_full_frame(true);
+// Skips decoding while the ROI does not change, run on the frame thread
+static SceneGate scene_gate;
+// Current scene gate settings, only used on the main loop
+static int scene_threshold;
+static int scene_hold_frames;
+
+// A decision handed to the main loop for sending
+typedef struct {
+    AppData* app_data;
+    gint value;
+    ImgFrameInfo_t info;
+} Decision;
+
+// Codes decoded in one frame, handed from a decode worker to the main loop
+typedef struct {
+    ImgFrameInfo_t info;
+    std::vector<std::string> texts;
+} Scan;
+
+// One code being checked with the server
+typedef struct {
+    ImgFrameInfo_t info;
+    std::string text;
+    int64_t started;
+    /// Resolved on the device, the server only records the check-in.
+    bool local;
+} Check;
+
+static bool uploadRecentEntries(HttpMulti_t* multi, const std::string& json_data, const std::string& endpoint, const std::string& auth, const std::string location, const std::string entrance, Check* check);
+static long hedgeDelay(void);
+static int checkResult(const HttpResponse_t* http_response);
+static bool retrieveAxParameters(std::string& endpoint, std::string& endpoint_secondary, std::string& auth, std::string& location, std::string& entrance, AXParameter* handle);
+static gboolean process_frame(VdoBuffer* buf, const ImgFrameInfo_t* info, gpointer user_data);
+static gpointer run_frame_loop(gpointer user_data);
+static void post_decision(AppData* app_data, gint value, const ImgFrameInfo_t* info);
+static gboolean send_decision(gpointer user_data);
+static gboolean start_checks(gpointer user_data);
+static void check_done(const HttpResponse_t* response, void* user_data);
+static void finish_check(Check* check, int successValue);
+static gboolean log_frame_stats(gpointer user_data);
+static int getIntParameter(AXParameter* handle, const char* name, int fallback);
+static std::string getStringParameter(AXParameter* handle, const char* name);
+static std::string entranceQuery(void);
+static void maxFrameAgeChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void pipelineParameterChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void frameBudgetChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void sceneGateChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void roiParameterChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void trackMissesChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void tileCodeSizeChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void dedupChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void checkLimitsChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void syncIntervalChanged(const gchar* name, const gchar* value, gpointer user_data);
+static void setRoiMode(const gchar* value);
 
 int main(void) {
     GMainLoop* main_loop = NULL;
@@ -80,7 +206,7 @@ int main(void) {
     auto paramCleanup = [&]() { ax_parameter_free(handle); };
 
     // Retrieve the AxParameters from manifest file
-    if (!retrieveAxParameters(endpoint, auth, location, entrance, handle)) {
+    if (!retrieveAxParameters(endpoint, endpoint_secondary, auth, location, entrance, handle)) {
         return EXIT_FAILURE;
     }
 
@@ -101,28 +227,181 @@ int main(void) {
            "Creating VDO image provider and creating stream %d x %d",
            streamWidth,
            streamHeight);
-    provider = createImgProvider(streamWidth, streamHeight, 2, VDO_FORMAT_YUV);
+    provider = createImgProvider(streamWidth, streamHeight, VDO_FORMAT_YUV);
     if (!provider) {
         syslog(LOG_ERR, "%s: Failed to create ImgProvider", __func__);
         exit(2);
     }
 
+    // Optionally skip frames that are too old to be worth decoding
+    setMaxFrameAge(provider, MAX(getIntParameter(handle, "MAX_FRAME_AGE_MS", 0), 0));
+    if (!ax_parameter_register_callback(handle, "MAX_FRAME_AGE_MS", maxFrameAgeChanged, NULL, &error)) {
+        syslog(LOG_WARNING, "Failed to register MAX_FRAME_AGE_MS callback: %s", error->message);
+        g_clear_error(&error);
+    }
+
+    // Set up the enhancement pipeline and follow changes made on the device
+    for (const char* const* name = pipelineParameterNames; *name; name++) {
+        gchar* param_value = NULL;
+        if (ax_parameter_get(handle, *name, &param_value, &error)) {
+            syslog(LOG_INFO, "%s: %s", *name, param_value);
+            setPipelineParameter(pipeline_config, *name, param_value);
+            g_free(param_value);
+        } else {
+            syslog(LOG_ERR, "Failed to retrieve %s, using default", *name);
+            g_clear_error(&error);
+        }
+        if (!ax_parameter_register_callback(handle, *name, pipelineParameterChanged, NULL, &error)) {
+            syslog(LOG_WARNING, "Failed to register %s callback: %s", *name, error->message);
+            g_clear_error(&error);
+        }
+    }
+    workers.configure(pipeline_config);
+
+    // Optionally limit how far the decode cascade escalates per frame
+    workers.setFrameBudget(getIntParameter(handle, "FRAME_BUDGET_MS", 0));
+    if (!ax_parameter_register_callback(handle, "FRAME_BUDGET_MS", frameBudgetChanged, NULL, &error)) {
+        syslog(LOG_WARNING, "Failed to register FRAME_BUDGET_MS callback: %s", error->message);
+        g_clear_error(&error);
+    }
+
+    // Choose where in the frame to look for codes
+    gchar* roi_mode = NULL;
+    if (ax_parameter_get(handle, "ROI_MODE", &roi_mode, &error)) {
+        setRoiMode(roi_mode);
+        g_free(roi_mode);
+    } else {
+        syslog(LOG_ERR, "Failed to retrieve ROI_MODE, using full");
+        g_clear_error(&error);
+    }
+    localiser.setMaxCandidates(getIntParameter(handle, "ROI_CANDIDATES", 2));
+    for (const char* name : {"ROI_MODE", "ROI_CANDIDATES"}) {
+        if (!ax_parameter_register_callback(handle, name, roiParameterChanged, NULL, &error)) {
+            syslog(LOG_WARNING, "Failed to register %s callback: %s", name, error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    // Follow decoded codes from frame to frame in full frame mode
+    tracker.setMaxMisses(getIntParameter(handle, "TRACK_MISSES", 3));
+    if (!ax_parameter_register_callback(handle, "TRACK_MISSES", trackMissesChanged, NULL, &error)) {
+        syslog(LOG_WARNING, "Failed to register TRACK_MISSES callback: %s", error->message);
+        g_clear_error(&error);
+    }
+
+    // Skip decoding while nothing moves in the region of interest
+    scene_threshold   = getIntParameter(handle, "SCENE_THRESHOLD", 4);
+    scene_hold_frames = getIntParameter(handle, "SCENE_HOLD_FRAMES", 15);
+    scene_gate.configure(scene_threshold, scene_hold_frames);
+    for (const char* name : {"SCENE_THRESHOLD", "SCENE_HOLD_FRAMES"}) {
+        if (!ax_parameter_register_callback(handle, name, sceneGateChanged, NULL, &error)) {
+            syslog(LOG_WARNING, "Failed to register %s callback: %s", name, error->message);
+            g_clear_error(&error);
+        }
+    }
+
     syslog(LOG_INFO, "Start fetching video frames from VDO");
     if (!startFrameFetch(provider)) {
         syslog(LOG_ERR, "%s: Failed to fetch frames from VDO", __func__);
         exit(3);
     }
 
+    // Check each pass once while it is held in view, other passes right away
+    dedup_ttl_ms  = getIntParameter(handle, "DEDUP_TTL_MS", 10000);
+    dedup_entries = getIntParameter(handle, "DEDUP_ENTRIES", 64);
+    dedup_cache.configure(dedup_entries, dedup_ttl_ms);
+    journal_seen.configure(dedup_entries, dedup_ttl_ms);
+    for (const char* name : {"DEDUP_TTL_MS", "DEDUP_ENTRIES"}) {
+        if (!ax_parameter_register_callback(handle, name, dedupChanged, NULL, &error)) {
+            syslog(LOG_WARNING, "Failed to register %s callback: %s", name, error->message);
+            g_clear_error(&error);
+        }
+    }
+
     // Set up event
-    AppData* app_data = create_event();
-    syslog(LOG_INFO, "New event created with ID: %d", app_data->event_id);
+    event_data = create_event();
+    syslog(LOG_INFO, "New event created with ID: %d", event_data->event_id);
+
+    // Decoded passes are checked with the server without blocking the main
+    // loop, so a slow server holds up neither decoding nor events. The
+    // connections are kept open, so a check costs a single round trip.
+    if (!httpClientGlobalInit(NULL) || !(checks = httpMultiNew(NULL))) {
+        exit(4);
+    }
+
+    // A check that has not been answered within the usual time is sent
+    // again, to the secondary endpoint if there is one, and the first
+    // answer wins. A check that runs out of time gets an answer of its own.
+    check_options.timeoutMs        = getIntParameter(handle, "CHECK_TIMEOUT_MS", 5000);
+    check_options.connectTimeoutMs = getIntParameter(handle, "CHECK_CONNECT_TIMEOUT_MS", 2000);
+    check_hedge_ms                 = getIntParameter(handle, "CHECK_HEDGE_MS", 0);
+    for (const char* name : {"CHECK_TIMEOUT_MS", "CHECK_CONNECT_TIMEOUT_MS", "CHECK_HEDGE_MS"}) {
+        if (!ax_parameter_register_callback(handle, name, checkLimitsChanged, NULL, &error)) {
+            syslog(LOG_WARNING, "Failed to register %s callback: %s", name, error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    // Passes of this entrance are kept on the device, so a stored pass gets
+    // its decision at once and the check-in is sent behind it. Passes not
+    // stored are still checked with the server.
+    std::string sync_endpoint = getStringParameter(handle, "SYNC_ENDPOINT");
+    if (!sync_endpoint.empty()) {
+        pass_store.open(getStringParameter(handle, "PASS_STORE_FILE").c_str());
+        pass_store.startSync(sync_endpoint + entranceQuery(), getIntParameter(handle, "SYNC_INTERVAL_S", 60));
+        if (!ax_parameter_register_callback(handle, "SYNC_INTERVAL_S", syncIntervalChanged, NULL, &error)) {
+            syslog(LOG_WARNING, "Failed to register SYNC_INTERVAL_S callback: %s", error->message);
+            g_clear_error(&error);
+        }
+    }
+
+    // Checks that got no answer are kept on the SD card and replayed in
+    // the background, so the server learns of every check-in
+    std::string journal_file = getStringParameter(handle, "JOURNAL_FILE");
+    if (!journal_file.empty()) {
+        scan_journal.start(journal_file.c_str(),
+                           (size_t)MAX(getIntParameter(handle, "JOURNAL_MAX_KB", 1024), 1) * 1024,
+                           endpoint + entranceQuery(),
+                           getIntParameter(handle, "JOURNAL_BATCH", 8));
+    }
+
+    // Regions are enhanced and decoded on a pool of workers, one frame per
+    // worker, using the other cores. Large regions are optionally split
+    // into tiles that are decoded in parallel.
+    workers.setTileCodeSize(getIntParameter(handle, "TILE_CODE_SIZE", 0));
+    if (!ax_parameter_register_callback(handle, "TILE_CODE_SIZE", tileCodeSizeChanged, NULL, &error)) {
+        syslog(LOG_WARNING, "Failed to register TILE_CODE_SIZE callback: %s", error->message);
+        g_clear_error(&error);
+    }
+    workers.start(getIntParameter(handle, "WORKER_THREADS", 2));
+
+    // Frames are taken on a thread of their own that sleeps until VDO
+    // delivers a frame, keeping the main loop free for parameter callbacks,
+    // event completions and timers
+    frame_context = g_main_context_new();
+    frame_loop = g_main_loop_new(frame_context, FALSE);
+    frame_source = frameSourceNew(provider);
+    g_source_set_callback(frame_source, G_SOURCE_FUNC(process_frame), NULL, NULL);
+    g_source_attach(frame_source, frame_context);
+    GThread* frame_thread = g_thread_new("frames", run_frame_loop, NULL);
 
     // Setup and start running main loop
-    g_timeout_add(10, (GSourceFunc)process_frame, app_data);
+    g_timeout_add_seconds(STATS_INTERVAL_S, log_frame_stats, NULL);
     main_loop = g_main_loop_new(NULL, FALSE);
     g_main_loop_run(main_loop);
 
     // Application cleanup
+    g_main_loop_quit(frame_loop);
+    g_thread_join(frame_thread);
+    workers.stop();
+    pass_store.stopSync();
+    scan_journal.stop();
+    httpMultiFree(checks);
+    httpClientGlobalCleanup();
+    g_source_destroy(frame_source);
+    g_source_unref(frame_source);
+    g_main_loop_unref(frame_loop);
+    g_main_context_unref(frame_context);
     event_cleanup();
     paramCleanup();
     destroyImgProvider(provider);
@@ -131,200 +410,324 @@ int main(void) {
     return EXIT_SUCCESS;
 }
 
-static gboolean process_frame(AppData* app_data) {
-    // Do not process frame if delay is in progress
-    if (delay_in_progress) {
+// Runs the frame source until the application exits
+static gpointer run_frame_loop(gpointer user_data) {
+    g_main_context_push_thread_default(frame_context);
+    g_main_loop_run(frame_loop);
+    g_main_context_pop_thread_default(frame_context);
+    return NULL;
+}
+
+// Called on the frame thread with every new NV12 frame from VDO
+static gboolean process_frame(VdoBuffer* buf, const ImgFrameInfo_t* info, gpointer user_data) {
+    // Work on the Y plane of the NV12 buffer directly, no colour conversion
+    // or copy is needed to get a greyscale image.
+    Nv12View frame(vdo_buffer_get_data(buf),
+                   provider->streamWidth,
+                   provider->streamHeight,
+                   provider->streamPitch);
+
+    // The fixed region of interest (ROI) in the centre of the frame, also
+    // the size of every candidate region found in the whole frame
+    cv::Rect roi;
+    roi = cv::Rect(frame.width() * 3 / 8, frame.height() * 3 / 8, frame.width() * 2 / 8, frame.height() * 2 / 8);
+    bool full_frame = roi_full_frame.load(std::memory_order_relaxed);
+
+    // A code tracked from the last frames is decoded whether it moved or not
+    cv::Rect tracked;
+    bool tracking = full_frame && tracker.region(cv::Size(frame.width(), frame.height()), roi.size(), &tracked);
+
+    // Nothing to decode if the scene has not changed. In full frame mode
+    // the shrunk frame the localiser works on is watched.
+    cv::Mat watched = full_frame ? localiser.shrink(frame.luma()) : frame.luma(roi);
+    if (!scene_gate.check(watched, tracking)) {
+        returnFrame(provider, buf);
         return TRUE;
     }
-    // Get the latest NV12 image frame from VDO using the imageprovider
-    VdoBuffer* buf = getLastFrameBlocking(provider);
-    if (!buf) {
-        syslog(LOG_INFO, "No more frames available, exiting");
-        return FALSE;
-    }
 
-    // Extract raw NV12 image data
-    Mat nv12_mat;
-    nv12_mat = Mat(streamHeight  * 3 / 2, streamWidth, CV_8UC1);
-    nv12_mat.data = static_cast<uint8_t*>(vdo_buffer_get_data(buf));
+    // Pick the regions to decode: around the tracked code if one was
+    // decoded recently, the candidates found in the whole frame once the
+    // track is lost, or the fixed ROI if there are none
+    FrameJob_t* job = workers.acquire();
+    job->info = *info;
+
+    // The regions are copied out so the buffer can go straight back to VDO
+    // while the workers enhance and decode them
+    auto add_region = [&](const cv::Rect& region) {
+        if (job->regions.size() <= job->count) {
+            job->regions.resize(job->count + 1);
+            job->rects.resize(job->count + 1);
+        }
+        frame.luma(region).copyTo(job->regions[job->count]);
+        job->rects[job->count] = region;
+        job->count++;
+    };
+
+    if (tracking) {
+        add_region(tracked);
+        job->tracked = true;
+    } else if (full_frame) {
+        for (const cv::Rect& candidate : localiser.locate(roi.size())) {
+            add_region(candidate);
+        }
+    }
+    // A code too faint for the localiser may still be decoded by the
+    // enhancing levels of the cascade
+    if (job->count == 0) {
+        add_region(roi);
+    }
+    returnFrame(provider, buf);
 
-    // Convert NV12 to BGR
-    Mat bgr_mat;
-    bgr_mat  = Mat(streamHeight, streamWidth, CV_8UC3);
-    cvtColor(nv12_mat, bgr_mat, COLOR_YUV2BGR_NV12, 3);
+    workers.submit(job);
+    return TRUE;
+}
 
-    // Convert BGR to grayscale
-    Mat grey_mat;
-    cvtColor(bgr_mat, grey_mat, COLOR_BGR2GRAY);
+// Called on a decode worker with the result of every job
+static void decode_done(const FrameJob_t* job, const ZXing::Barcodes& barcodes, const cv::Rect& bounds, void* user_data) {
+    // Keep the track going, or start one
+    if (!barcodes.empty()) {
+        tracker.found(bounds);
+    } else if (job->tracked) {
+        tracker.missed();
+    }
 
-    // Crop to the region of interest (ROI) for QR detection
-    cv::Rect roi;
-    roi = cv::Rect(streamWidth * 3 / 8, streamHeight * 3 / 8, streamWidth * 2 / 8, streamHeight * 2 / 8);
-    cv::Mat cropped = grey_mat(roi);
-
-    // Apply CLAHE (Contrast Limited Adaptive Histogram Equalization)
-    cv::Mat clahe_result;
-    cv::Ptr<cv::CLAHE> clahe = cv::createCLAHE(2.0, cv::Size(8,8));
-    clahe->apply(cropped, clahe_result);
-
-    // Resize the cropped image for better resolution
-    cv::Mat resized;
-    cv::resize(clahe_result, resized, cv::Size(), 2.0, 2.0, cv::INTER_CUBIC);  // 2x enlargement
-
-    // Noise reduction (using median filter)
-    cv::Mat denoised;
-    cv::medianBlur(resized, denoised, 3);  // 3x3 kernel
-
-    // Sharpening using Unsharp Mask
-    cv::Mat blurred, sharpened;
-    GaussianBlur(denoised, blurred, cv::Size(3, 3), 0);
-    cv::addWeighted(denoised, 1.5, blurred, -0.5, 0, sharpened);
-
-    // Adaptive thresholding (better for varying lighting)
-    cv::Mat binary;
-    cv::adaptiveThreshold(sharpened, binary, 255, 
-                        cv::ADAPTIVE_THRESH_GAUSSIAN_C, cv::THRESH_BINARY, 25, 2);
-
-    // Optional Morphological Closing (removes gaps in QR patterns)
-    cv::Mat morph;
-    cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3));
-    cv::morphologyEx(binary, morph, cv::MORPH_CLOSE, kernel);
-
-    // Use the processed image for ZXing QR detection
-    auto image = ZXing::ImageView(morph.data, morph.cols, morph.rows, ZXing::ImageFormat::Lum);
-    auto options = ZXing::ReaderOptions().setFormats(ZXing::BarcodeFormat::QRCode);
-    auto barcodes = ZXing::ReadBarcodes(image, options);
-
-    // Upload any barcode data to the endpoint
+    // Codes checked recently are dropped, so a pass is checked once while
+    // it is in view and scanning never stops for the next one
+    int64_t now = g_get_monotonic_time();
+    Scan* scan  = NULL;
     for (const auto& b : barcodes) {
+        if (!dedup_cache.admit(b.text().data(), b.text().size(), now)) {
+            continue;
+        }
         syslog(LOG_INFO, "%s: %s", ZXing::ToString(b.format()).c_str(), b.text().c_str());
+        if (!scan) {
+            scan       = new Scan;
+            scan->info = job->info;
+        }
+        scan->texts.push_back(b.text());
+    }
+    if (scan) {
+        g_main_context_invoke(NULL, start_checks, scan);
+    }
+}
 
-        int successValue = uploadRecentEntries(b.text(), endpoint, auth, location, entrance);
-
-        // imwrite("final_img.png", morph);
-        // syslog(LOG_INFO, "Final photo saved to final_img.png");
+// Called on the main loop, starts checking the codes of a frame with the
+// endpoint
+static gboolean start_checks(gpointer user_data) {
+    Scan* scan = (Scan*)user_data;
+
+    for (const std::string& text : scan->texts) {
+        Check* check   = new Check;
+        check->info    = scan->info;
+        check->text    = text;
+        check->started = g_get_monotonic_time();
+        check->local   = false;
+
+        // A stored pass is decided here, only a valid one is checked in
+        int value = pass_store.lookup(text.data(), text.size());
+        if (value) {
+            syslog(LOG_INFO, "Pass resolved on the device: %d", value);
+            post_decision(event_data, value, &check->info);
+            if (value != CHECK_PASS_FOUND) {
+                delete check;
+                continue;
+            }
+            check->local = true;
+        }
+        scan_journal.liveCheckStarted();
+        if (!uploadRecentEntries(checks, text, endpoint, auth, location, entrance, check)) {
+            finish_check(check, CHECK_NO_ANSWER);
+        }
+    }
+    delete scan;
+    return G_SOURCE_REMOVE;
+}
 
-        if(successValue == 1) {
-            app_data->value = 1;
-            send_event(app_data);
+// Called on the main loop with the answer to a check
+static void check_done(const HttpResponse_t* response, void* user_data) {
+    Check* check = (Check*)user_data;
+
+    // Only answers count towards the latency, a timeout is counted apart
+    if (response->status != 0) {
+        int64_t latency = g_get_monotonic_time() - check->started;
+        histogramAdd(&check_latency, latency);
+        histogramAdd(&check_latency_interval, latency);
+    } else if (response->timedOut) {
+        checks_timed_out++;
+    }
+    finish_check(check, checkResult(response));
+}
 
+// Send the decision for a checked code
+static void finish_check(Check* check, int successValue) {
+    scan_journal.liveCheckFinished();
 
-            // Turn on delay
-            // Set a timer for turning off the delay flag
-            delay_in_progress = TRUE;
-            g_timeout_add(3000, reset_delay_flag, NULL);
-        } else {
-            app_data->value = 2;
-            send_event(app_data);
+    // The scan is replayed with the time it was made
+    if ((successValue == CHECK_TIMED_OUT || successValue == CHECK_NO_ANSWER) &&
+        journal_seen.admit(check->text.data(), check->text.size(), g_get_monotonic_time())) {
+        int64_t age = g_get_monotonic_time() - check->info.captureTime;
+        scan_journal.record(check->text.data(), check->text.size(), (g_get_real_time() - age) / G_USEC_PER_SEC);
+    }
 
-            delay_in_progress = TRUE;
-            g_timeout_add(3000, reset_delay_flag, NULL);
+    if (check->local) {
+        if (successValue != CHECK_PASS_FOUND) {
+            syslog(LOG_INFO, "Check-in of a pass found on the device answered %d", successValue);
         }
+        delete check;
+        return;
     }
+    post_decision(event_data, successValue, &check->info);
 
-    returnFrame(provider, buf);
-    return TRUE;
+    // Without an answer from the server, the next sighting tries again
+    if (successValue == CHECK_TIMED_OUT || successValue == CHECK_NO_ANSWER) {
+        dedup_cache.forget(check->text.data(), check->text.size());
+    }
+    delete check;
 }
 
-// Write callback is called in uploadRecentEntries()
-// Collects the response from the server
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* response) {
-    size_t totalSize = size * nmemb;
-    response->append((char*)contents, totalSize);
-    return totalSize;
+// Events are sent from the main loop, where the event handler lives
+static void post_decision(AppData* app_data, gint value, const ImgFrameInfo_t* info) {
+    Decision* decision = g_new0(Decision, 1);
+    decision->app_data = app_data;
+    decision->value = value;
+    decision->info = *info;
+    g_main_context_invoke(NULL, send_decision, decision);
 }
 
-static int uploadRecentEntries(const std::string& json_data, const std::string& endpoint, const std::string& auth, const std::string location, const std::string entrance) {
+static gboolean send_decision(gpointer user_data) {
+    Decision* decision = (Decision*)user_data;
 
-    // Construct the URL with query parameters
-    std::string url = endpoint + "?park_abbr=" + curl_easy_escape(nullptr, location.c_str(), 0) +
-                      "&entrance=" + curl_easy_escape(nullptr, entrance.c_str(), 0) +
-                      "&scandata=" + curl_easy_escape(nullptr, json_data.c_str(), 0);
+    decision->app_data->value = decision->value;
+    send_event(decision->app_data);
 
-    // initialize CURL and curl buffer
-    CURL* curl;
-    CURLcode res;
-    char error_buffer[CURL_ERROR_SIZE];
-    std::string response;
+    // Capture-to-decision latency is what the visitor at the gate feels
+    syslog(LOG_INFO,
+           "Decision for frame %u sent %lld ms after capture (frame waited %lld ms)",
+           decision->info.sequenceNbr,
+           (long long)(g_get_monotonic_time() - decision->info.captureTime) / 1000,
+           (long long)(decision->info.handoutTime - decision->info.captureTime) / 1000);
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-    if (curl) {
-        struct curl_slist* headers = NULL;
+    g_free(decision);
+    return G_SOURCE_REMOVE;
+}
+
+// Start checking a code with the endpoint, check_done() is called with the
+// answer
+static bool uploadRecentEntries(HttpMulti_t* multi, const std::string& json_data, const std::string& endpoint, const std::string& auth, const std::string location, const std::string entrance, Check* check) {
+    // Construct the URL with query parameters
+    char* park_abbr = httpClientEscape(NULL, location.c_str());
+    char* gate      = httpClientEscape(NULL, entrance.c_str());
+    char* scandata  = httpClientEscape(NULL, json_data.c_str());
+    std::string url;
+    if (park_abbr && gate && scandata) {
+        url = endpoint + "?park_abbr=" + park_abbr + "&entrance=" + gate + "&scandata=" + scandata;
+    }
+    curl_free(park_abbr);
+    curl_free(gate);
+    curl_free(scandata);
+    if (url.empty()) {
+        syslog(LOG_ERR, "Failed to encode the scan");
+        return false;
+    }
 
     // In the case that we add Authorization Headers
-        // std::string auth_header = "PARKSPLUS_AUTH: " + auth;
-        // headers = curl_slist_append(headers, auth_header.c_str());
-
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());  // Use the URL with params
-        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);  // Follow redirects
-        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);       // Limit the number of redirects
-
-        // Set up the write function to capture response
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-
-        // Check the response from the server
-        res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            syslog(LOG_INFO, "curl_easy_perform() failed");
-        } else {
-            // Get http server response code
-            long http_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-            if (http_code == 200) {
-                int returnValue = 0;
-                std::string result = extractValue(response, "result");
-                std::string message = extractValue(response, "message");
-                toLowerCase(result);
-                toLowerCase(message);
-                if (result == "success" || message == "pass found") {
-                    std::string checkin = extractValue(response, "checkin");
-                    syslog(LOG_INFO, "Result: %s; Message: %s; Check-In: %s", result.c_str(), message.c_str(), checkin.c_str());
-                    returnValue = 1;
-                } else {
-                    syslog(LOG_INFO, "Result: %s; Message: %s", result.c_str(), message.c_str());
-                    if (message == "pass not found") {
-                        syslog(LOG_INFO, "Pass was not found");
-                        returnValue = 2;
-                    } else if (message == "invalid format") {
-                        syslog(LOG_INFO, "QR Code data is not in a recongnizable format");
-                        returnValue = 3;
-                    } else if (message == "checkin failed") {
-                        syslog(LOG_INFO, "Was not able to check the visitor in");
-                        returnValue = 4;
-                    } else if (message == "pass expired") {
-                        syslog(LOG_INFO, "Pass is expired");
-                        returnValue = 5;
-                    } else {
-                        syslog(LOG_INFO, "Unknown pass validation error");
-                        returnValue = 6;
-                    }
-                }
-                curl_slist_free_all(headers);
-                curl_easy_cleanup(curl);
-                curl_global_cleanup();
-                return returnValue;
-            } else {
-                syslog(LOG_INFO, "Data was not successfully uploaded");
-            }
+    // std::string auth_header = "PARKSPLUS_AUTH: " + auth;
+    // headers = curl_slist_append(headers, auth_header.c_str());
+
+    // The hedge goes to the same path and query on the secondary endpoint
+    HttpRequestOptions_t options = check_options;
+    std::string hedge_url;
+    options.hedgeMs = hedgeDelay();
+    if (!endpoint_secondary.empty()) {
+        hedge_url        = endpoint_secondary + url.substr(endpoint.size());
+        options.hedgeUrl = hedge_url.c_str();
+    }
+    return httpMultiGet(multi, url.c_str(), NULL, &options, check_done, check);
+}
+
+// Milliseconds without an answer before a check is hedged, negative for
+// never
+static long hedgeDelay(void) {
+    if (check_hedge_ms != 0) {
+        return check_hedge_ms;
+    }
+    if (check_latency.total < HEDGE_MIN_SAMPLES) {
+        return HEDGE_FALLBACK_MS;
+    }
+    return MAX(histogramPercentile(&check_latency, 0.95) / 1000, HEDGE_FLOOR_MS);
+}
+
+// Map the answer of the endpoint to the SuccessValue of the event
+static int checkResult(const HttpResponse_t* http_response) {
+    if (http_response->status == 0) {
+        syslog(LOG_INFO, "Check %s", http_response->timedOut ? "timed out" : "got no answer");
+        return http_response->timedOut ? CHECK_TIMED_OUT : CHECK_NO_ANSWER;
+    }
+    syslog(LOG_INFO,
+           "Check took %lld ms%s",
+           (long long)http_response->totalUs / 1000,
+           http_response->newConnection ? " on a new connection" : "");
+    if (http_response->status != 200) {
+        syslog(LOG_INFO, "Data was not successfully uploaded");
+        return CHECK_NO_ANSWER;
+    }
+
+    // Only the fields read are picked out, in place
+    static const std::string_view names[] = {"result", "message", "checkin"};
+    std::string_view values[3];
+    if (!jsonFields(std::string_view(http_response->body, http_response->size), names, values, 3)) {
+        syslog(LOG_INFO, "Answer of the endpoint is not a JSON object");
+    }
+    const std::string_view& result  = values[0];
+    const std::string_view& message = values[1];
+    const std::string_view& checkin = values[2];
+
+    // Known messages are found by the hash of the lowercased text
+    struct Message_t {
+        std::string_view message;
+        uint64_t hash;
+        int value;
+        const char* note;
+    };
+#define MESSAGE(text, value, note) {text, fnv1a64(text, sizeof(text) - 1), value, note}
+    static constexpr Message_t messages[] = {
+        MESSAGE("pass found", CHECK_PASS_FOUND, "Pass was found"),
+        MESSAGE("pass not found", CHECK_PASS_NOT_FOUND, "Pass was not found"),
+        MESSAGE("invalid format", CHECK_INVALID_FORMAT, "QR Code data is not in a recongnizable format"),
+        MESSAGE("checkin failed", CHECK_CHECKIN_FAILED, "Was not able to check the visitor in"),
+        MESSAGE("pass expired", CHECK_PASS_EXPIRED, "Pass is expired"),
+    };
+#undef MESSAGE
+
+    int returnValue  = CHECK_UNKNOWN_ERROR;
+    const char* note = "Unknown pass validation error";
+    uint64_t hash    = jsonStringHash(message, true);
+    for (size_t i = 0; i < std::size(messages); i++) {
+        if (messages[i].hash == hash && jsonStringEquals(message, messages[i].message, true)) {
+            returnValue = messages[i].value;
+            note        = messages[i].note;
+            break;
         }
+    }
+    if (jsonStringEquals(result, "success", true)) {
+        returnValue = CHECK_PASS_FOUND;
+    }
 
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
+    if (returnValue == CHECK_PASS_FOUND) {
+        syslog(LOG_INFO,
+               "Result: %.*s; Message: %.*s; Check-In: %.*s",
+               (int)result.size(), result.data(),
+               (int)message.size(), message.data(),
+               (int)checkin.size(), checkin.data());
     } else {
-        syslog(LOG_ERR, "Failed to initialize CURL");
+        syslog(LOG_INFO, "Result: %.*s; Message: %.*s", (int)result.size(), result.data(), (int)message.size(), message.data());
+        syslog(LOG_INFO, "%s", note);
     }
-
-    curl_global_cleanup();
-    return false;
+    return returnValue;
 }
 
 // Collect the parameters defined in the manifest.json file of the application
-static bool retrieveAxParameters(std::string& endpoint, std::string& auth, std::string& location, std::string& entrance, AXParameter* handle) {
+static bool retrieveAxParameters(std::string& endpoint, std::string& endpoint_secondary, std::string& auth, std::string& location, std::string& entrance, AXParameter* handle) {
     GError* error = nullptr;
 
     try {
@@ -337,6 +740,12 @@ static bool retrieveAxParameters(std::string& endpoint, std::string& auth, std::
         } else {
             syslog(LOG_ERR, "Failed to retrieve ENDPOINT");
         }
+        if (ax_parameter_get(handle, "ENDPOINT_SECONDARY", &param_value, &error)) {
+            endpoint_secondary = param_value;
+            g_free(param_value);
+        } else {
+            syslog(LOG_ERR, "Failed to retrieve ENDPOINT_SECONDARY");
+        }
         if (ax_parameter_get(handle, "AUTH", &param_value, &error)) {
             auth = param_value;
             g_free(param_value);
@@ -358,6 +767,7 @@ static bool retrieveAxParameters(std::string& endpoint, std::string& auth, std::
 
         // Log parameters for debugging
         syslog(LOG_INFO, "Endpoint: %s", endpoint.c_str());
+        syslog(LOG_INFO, "Secondary endpoint: %s", endpoint_secondary.c_str());
         syslog(LOG_INFO, "Auth: %s", auth.c_str());
         syslog(LOG_INFO, "Location: %s", location.c_str());
         syslog(LOG_INFO, "Entrance: %s", entrance.c_str());
@@ -371,34 +781,326 @@ static bool retrieveAxParameters(std::string& endpoint, std::string& auth, std::
     return true;
 }
 
-// Turn off delay, allowing passes to be scanned again
-static gboolean reset_delay_flag(gpointer user_data) {
-    delay_in_progress = FALSE;
-    return FALSE;
+// Read an integer parameter, falling back to a default if it is missing
+static int getIntParameter(AXParameter* handle, const char* name, int fallback) {
+    GError* error = nullptr;
+    gchar* param_value = NULL;
+
+    if (!ax_parameter_get(handle, name, &param_value, &error)) {
+        syslog(LOG_ERR, "Failed to retrieve %s, using %d", name, fallback);
+        if (error) g_error_free(error);
+        return fallback;
+    }
+    int value = atoi(param_value);
+    g_free(param_value);
+    syslog(LOG_INFO, "%s: %d", name, value);
+    return value;
 }
 
-static void toLowerCase(std::string& str) {
-    for (char& c : str) {
-        c = std::tolower(c);
+// Read a string parameter, empty if it is missing
+static std::string getStringParameter(AXParameter* handle, const char* name) {
+    GError* error = nullptr;
+    gchar* param_value = NULL;
+
+    if (!ax_parameter_get(handle, name, &param_value, &error)) {
+        syslog(LOG_ERR, "Failed to retrieve %s", name);
+        if (error) g_error_free(error);
+        return std::string();
     }
+    std::string value(param_value);
+    g_free(param_value);
+    syslog(LOG_INFO, "%s: %s", name, value.c_str());
+    return value;
 }
 
-// Extract values from the json data returned by the server
-static std::string extractValue(const std::string& json, const std::string& key) {
-    // Format the key to match JSON format
-    std::string searchKey = "\"" + key + "\":\""; 
-    size_t start = json.find(searchKey);
+// The query naming this entrance, for the endpoints to append to
+static std::string entranceQuery(void) {
+    char* park_abbr = httpClientEscape(NULL, location.c_str());
+    char* gate      = httpClientEscape(NULL, entrance.c_str());
+    std::string query;
+    if (park_abbr && gate) {
+        query = std::string("?park_abbr=") + park_abbr + "&entrance=" + gate;
+    }
+    curl_free(park_abbr);
+    curl_free(gate);
+    return query;
+}
 
-    // Key not found
-    if (start == std::string::npos) return ""; 
+// Called when MAX_FRAME_AGE_MS is changed on the device
+static void maxFrameAgeChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    setMaxFrameAge(provider, MAX(atoi(value), 0));
+}
 
-    // Move to the start of the value
-    start += searchKey.length(); 
-    // Find the closing quote
-    size_t end = json.find("\"", start); 
+// Called when one of the pipeline parameters is changed on the device, the
+// new stages are used from the next frame on
+static void pipelineParameterChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    // Callbacks get the full name, e.g. root.ParkspassQRScanner.PIPELINE
+    const gchar* short_name = strrchr(name, '.') ? strrchr(name, '.') + 1 : name;
 
-    // Malformed JSON
-    if (end == std::string::npos) return ""; 
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    if (setPipelineParameter(pipeline_config, short_name, value)) {
+        workers.configure(pipeline_config);
+    }
+}
 
-    return json.substr(start, end - start);
+// Called when FRAME_BUDGET_MS is changed on the device
+static void frameBudgetChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    workers.setFrameBudget(atoi(value));
+}
+
+// Called when SCENE_THRESHOLD or SCENE_HOLD_FRAMES is changed on the device
+static void sceneGateChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    const gchar* short_name = strrchr(name, '.') ? strrchr(name, '.') + 1 : name;
+
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    if (strcmp(short_name, "SCENE_THRESHOLD") == 0) {
+        scene_threshold = atoi(value);
+    } else {
+        scene_hold_frames = atoi(value);
+    }
+    scene_gate.configure(scene_threshold, scene_hold_frames);
+}
+
+// Called when ROI_MODE or ROI_CANDIDATES is changed on the device
+static void roiParameterChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    const gchar* short_name = strrchr(name, '.') ? strrchr(name, '.') + 1 : name;
+
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    if (strcmp(short_name, "ROI_MODE") == 0) {
+        setRoiMode(value);
+    } else {
+        localiser.setMaxCandidates(atoi(value));
+    }
+}
+
+// Called when TILE_CODE_SIZE is changed on the device
+static void tileCodeSizeChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    workers.setTileCodeSize(atoi(value));
+}
+
+// Called when TRACK_MISSES is changed on the device
+static void trackMissesChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    tracker.setMaxMisses(atoi(value));
+}
+
+// Called when DEDUP_TTL_MS or DEDUP_ENTRIES is changed on the device
+static void dedupChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    const gchar* short_name = strrchr(name, '.') ? strrchr(name, '.') + 1 : name;
+
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    if (strcmp(short_name, "DEDUP_TTL_MS") == 0) {
+        dedup_ttl_ms = atoi(value);
+    } else {
+        dedup_entries = atoi(value);
+    }
+    dedup_cache.configure(dedup_entries, dedup_ttl_ms);
+    journal_seen.configure(dedup_entries, dedup_ttl_ms);
+}
+
+// Called when CHECK_TIMEOUT_MS, CHECK_CONNECT_TIMEOUT_MS or CHECK_HEDGE_MS
+// is changed on the device, used from the next check on
+static void checkLimitsChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    const gchar* short_name = strrchr(name, '.') ? strrchr(name, '.') + 1 : name;
+
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    if (strcmp(short_name, "CHECK_TIMEOUT_MS") == 0) {
+        check_options.timeoutMs = atoi(value);
+    } else if (strcmp(short_name, "CHECK_CONNECT_TIMEOUT_MS") == 0) {
+        check_options.connectTimeoutMs = atoi(value);
+    } else {
+        check_hedge_ms = atoi(value);
+    }
+}
+
+// Called when SYNC_INTERVAL_S is changed on the device
+static void syncIntervalChanged(const gchar* name, const gchar* value, gpointer user_data) {
+    syslog(LOG_INFO, "%s changed to %s", name, value);
+    pass_store.setSyncInterval(atoi(value));
+}
+
+// Decode candidates from the whole frame unless ROI_MODE is center
+static void setRoiMode(const gchar* value) {
+    bool full_frame = g_ascii_strcasecmp(value, "center") != 0;
+
+    if (full_frame && g_ascii_strcasecmp(value, "full") != 0) {
+        syslog(LOG_WARNING, "Unknown ROI_MODE %s, using full", value);
+    }
+    syslog(LOG_INFO, "ROI_MODE: %s", full_frame ? "full" : "center");
+    roi_full_frame.store(full_frame, std::memory_order_relaxed);
+}
+
+// Log how frames flowed from VDO since the last call
+static gboolean log_frame_stats(gpointer user_data) {
+    static ImgProviderStats_t last = {};
+    ImgProviderStats_t stats;
+
+    getImgProviderStats(provider, &stats);
+    syslog(LOG_INFO,
+           "Frames last %ds: delivered %llu, dropped as stale %llu, skipped %llu, "
+           "dropped as too old %llu, buffer starvation %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(stats.framesDelivered - last.framesDelivered),
+           (unsigned long long)(stats.framesDroppedStale - last.framesDroppedStale),
+           (unsigned long long)(stats.framesSkipped - last.framesSkipped),
+           (unsigned long long)(stats.framesDroppedAged - last.framesDroppedAged),
+           (unsigned long long)(stats.bufferStarvation - last.bufferStarvation));
+    last = stats;
+
+    // How many frames the scene gate spared the decoder
+    static SceneGateStats_t last_gate = {};
+    SceneGateStats_t gate_stats;
+    scene_gate.getStats(&gate_stats);
+    syslog(LOG_INFO,
+           "Scene gate last %ds: gated %llu, decoded %llu, changes %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(gate_stats.framesGated - last_gate.framesGated),
+           (unsigned long long)(gate_stats.framesPassed - last_gate.framesPassed),
+           (unsigned long long)(gate_stats.changes - last_gate.changes));
+    last_gate = gate_stats;
+
+    // How many frames the workers decoded and how many they had to skip
+    static WorkerStats_t last_workers = {};
+    WorkerStats_t worker_stats;
+    workers.getStats(&worker_stats);
+    syslog(LOG_INFO,
+           "Workers last %ds: frames submitted %llu, superseded %llu, decoded %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(worker_stats.jobsSubmitted - last_workers.jobsSubmitted),
+           (unsigned long long)(worker_stats.jobsSuperseded - last_workers.jobsSuperseded),
+           (unsigned long long)(worker_stats.jobsDecoded - last_workers.jobsDecoded));
+    last_workers = worker_stats;
+
+    // How many regions the localiser handed to the decoder
+    static LocaliserStats_t last_localiser = {};
+    LocaliserStats_t localiser_stats;
+    localiser.getStats(&localiser_stats);
+    syslog(LOG_INFO,
+           "Localiser last %ds: frames %llu, candidates %llu, frames without candidates %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(localiser_stats.frames - last_localiser.frames),
+           (unsigned long long)(localiser_stats.candidates - last_localiser.candidates),
+           (unsigned long long)(localiser_stats.framesEmpty - last_localiser.framesEmpty));
+    last_localiser = localiser_stats;
+
+    static TrackerStats_t last_tracker = {};
+    TrackerStats_t tracker_stats;
+    tracker.getStats(&tracker_stats);
+    syslog(LOG_INFO,
+           "Tracker last %ds: frames tracked %llu, found again %llu, tracks lost %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(tracker_stats.framesTracked - last_tracker.framesTracked),
+           (unsigned long long)(tracker_stats.hits - last_tracker.hits),
+           (unsigned long long)(tracker_stats.lost - last_tracker.lost));
+    last_tracker = tracker_stats;
+
+    // How many sightings of passes were checked and how many were repeats
+    static DedupStats_t last_dedup = {};
+    DedupStats_t dedup_stats;
+    dedup_cache.getStats(&dedup_stats);
+    syslog(LOG_INFO,
+           "Passes last %ds: checked %llu, repeats dropped %llu, evicted %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(dedup_stats.admitted - last_dedup.admitted),
+           (unsigned long long)(dedup_stats.suppressed - last_dedup.suppressed),
+           (unsigned long long)(dedup_stats.evicted - last_dedup.evicted));
+    last_dedup = dedup_stats;
+
+    // How long checks with the server took and how often a connection had
+    // to be opened
+    static HttpClientStats_t last_http = {};
+    HttpClientStats_t http_stats;
+    httpClientGetStats(&http_stats);
+    uint64_t requests = http_stats.requests - last_http.requests;
+    syslog(LOG_INFO,
+           "Checks last %ds: requests %llu, failed %llu, new connections %llu, average %llu ms",
+           STATS_INTERVAL_S,
+           (unsigned long long)requests,
+           (unsigned long long)(http_stats.failures - last_http.failures),
+           (unsigned long long)(http_stats.connects - last_http.connects),
+           (unsigned long long)(requests ? (http_stats.totalUs - last_http.totalUs) / requests / 1000 : 0));
+    last_http = http_stats;
+
+    // How long answered checks took, how many ran out of time and how
+    // often a hedge was sent and answered first
+    static HttpMultiStats_t last_multi = {};
+    static uint64_t last_timed_out = 0;
+    HttpMultiStats_t multi_stats;
+    httpMultiGetStats(checks, &multi_stats);
+    syslog(LOG_INFO,
+           "Check latency last %ds: p50 %lld ms, p95 %lld ms, p99 %lld ms, timed out %llu, "
+           "hedged %llu, hedge first %llu, hedge delay %ld ms",
+           STATS_INTERVAL_S,
+           (long long)histogramPercentile(&check_latency_interval, 0.50) / 1000,
+           (long long)histogramPercentile(&check_latency_interval, 0.95) / 1000,
+           (long long)histogramPercentile(&check_latency_interval, 0.99) / 1000,
+           (unsigned long long)(checks_timed_out - last_timed_out),
+           (unsigned long long)(multi_stats.hedges - last_multi.hedges),
+           (unsigned long long)(multi_stats.hedgeWins - last_multi.hedgeWins),
+           hedgeDelay());
+    last_multi     = multi_stats;
+    last_timed_out = checks_timed_out;
+    check_latency_interval = {};
+    histogramDecay(&check_latency);
+
+    // How many scans were resolved on the device and how syncing went
+    static PassStoreStats_t last_store = {};
+    PassStoreStats_t store_stats;
+    pass_store.getStats(&store_stats);
+    syslog(LOG_INFO,
+           "Pass store last %ds: resolved %llu, not stored %llu, syncs %llu, failed syncs %llu, passes %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(store_stats.hits - last_store.hits),
+           (unsigned long long)(store_stats.misses - last_store.misses),
+           (unsigned long long)(store_stats.syncs - last_store.syncs),
+           (unsigned long long)(store_stats.syncFailures - last_store.syncFailures),
+           (unsigned long long)store_stats.passes);
+    last_store = store_stats;
+
+    // How many checks were journaled for replay and how replay went
+    static ScanJournalStats_t last_journal = {};
+    ScanJournalStats_t journal_stats;
+    scan_journal.getStats(&journal_stats);
+    syslog(LOG_INFO,
+           "Journal last %ds: recorded %llu, replayed %llu, failed replays %llu, given up %llu, dropped %llu, "
+           "pending %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(journal_stats.journal.appended - last_journal.journal.appended),
+           (unsigned long long)(journal_stats.journal.acked - last_journal.journal.acked -
+                                (journal_stats.replayGivenUp - last_journal.replayGivenUp)),
+           (unsigned long long)(journal_stats.replayFailures - last_journal.replayFailures),
+           (unsigned long long)(journal_stats.replayGivenUp - last_journal.replayGivenUp),
+           (unsigned long long)(journal_stats.journal.dropped - last_journal.journal.dropped),
+           (unsigned long long)journal_stats.journal.pending);
+    last_journal = journal_stats;
+
+    workers.logStageTimes();
+
+    // Where in the decode cascade codes were found
+    static DecoderStats_t last_decoder = {};
+    DecoderStats_t decoder_stats;
+    workers.getDecoderStats(&decoder_stats);
+    syslog(LOG_INFO,
+           "Decodes last %ds: frames %llu, %s %llu, %s %llu, %s %llu, out of budget %llu",
+           STATS_INTERVAL_S,
+           (unsigned long long)(decoder_stats.frames - last_decoder.frames),
+           Decoder::levelName(DECODE_LEVEL_RAW),
+           (unsigned long long)(decoder_stats.hits[DECODE_LEVEL_RAW] - last_decoder.hits[DECODE_LEVEL_RAW]),
+           Decoder::levelName(DECODE_LEVEL_CLAHE),
+           (unsigned long long)(decoder_stats.hits[DECODE_LEVEL_CLAHE] - last_decoder.hits[DECODE_LEVEL_CLAHE]),
+           Decoder::levelName(DECODE_LEVEL_FULL),
+           (unsigned long long)(decoder_stats.hits[DECODE_LEVEL_FULL] - last_decoder.hits[DECODE_LEVEL_FULL]),
+           (unsigned long long)(decoder_stats.budgetExhausted - last_decoder.budgetExhausted));
+    last_decoder = decoder_stats;
+
+    // Only counted when an allocation counter is linked in
+    if (allocCounterRead) {
+        syslog(LOG_INFO,
+               "Pipeline heap allocations in steady state: %llu",
+               (unsigned long long)workers.steadyStateAllocations());
+    }
+    return TRUE;
 }
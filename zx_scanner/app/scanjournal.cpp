@@ -0,0 +1,227 @@
+#include "scanjournal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <syslog.h>
+
+#include "dedupcache.h"
+
+// Recorded scans are appended and synced to the card this often, one sync
+// for all of them
+#define SYNC_INTERVAL_MS 500
+// Wait after a replay got no answer, doubled up to the most
+#define MIN_BACKOFF_MS 1000
+#define MAX_BACKOFF_MS 60000
+// Most milliseconds a replay request may take
+#define REPLAY_TIMEOUT_MS 10000
+// Limits a typo in the parameter
+#define MAX_BATCH 32
+// Failed replays of a scan, while the server answers others, before it is
+// given up on
+#define MAX_REPLAY_ATTEMPTS 5
+
+ScanJournal::ScanJournal()
+    : journal_(nullptr),
+      journalStats_(),
+      stop_(false),
+      live_(0),
+      replayed_(0),
+      replayFailures_(0),
+      replayGivenUp_(0) {}
+
+ScanJournal::~ScanJournal() {
+    stop();
+}
+
+bool ScanJournal::start(const char* path, size_t maxBytes, const std::string& url, int batch) {
+    journal_ = journalOpen(path, maxBytes);
+    if (!journal_) {
+        return false;
+    }
+    journalGetStats(journal_, &journalStats_);
+
+    url_ = url;
+    clients_.clear();
+    for (int i = 0; i < std::min(std::max(batch, 1), MAX_BATCH); i++) {
+        HttpClient_t* client = httpClientNew();
+        if (client) {
+            clients_.push_back(client);
+        }
+    }
+    stop_   = false;
+    thread_ = std::thread(&ScanJournal::run, this);
+    return true;
+}
+
+void ScanJournal::stop() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wakeup_.notify_all();
+        thread_.join();
+    }
+    for (HttpClient_t* client : clients_) {
+        httpClientFree(client);
+    }
+    clients_.clear();
+    replays_.clear();
+    journalClose(journal_);
+    journal_ = nullptr;
+}
+
+void ScanJournal::record(const char* text, size_t size, int64_t time) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (journal_) {
+        scans_.push_back(Scan_t{std::string(text, size), time});
+    }
+}
+
+void ScanJournal::liveCheckStarted() {
+    live_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ScanJournal::liveCheckFinished() {
+    live_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ScanJournal::getStats(ScanJournalStats_t* stats) {
+    stats->replayed       = replayed_.load(std::memory_order_relaxed);
+    stats->replayFailures = replayFailures_.load(std::memory_order_relaxed);
+    stats->replayGivenUp  = replayGivenUp_.load(std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats->journal = journalStats_;
+}
+
+// The journal thread, owns the journal
+void ScanJournal::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto retry_at  = std::chrono::steady_clock::now();
+    int backoff_ms = 0;
+    bool more      = false;
+
+    for (;;) {
+        // Right after a full batch the next one goes out at once
+        if (!more) {
+            wakeup_.wait_for(lock, std::chrono::milliseconds(SYNC_INTERVAL_MS), [this] { return stop_; });
+        }
+        std::vector<Scan_t> scans;
+        scans.swap(scans_);
+        bool stopping = stop_;
+        lock.unlock();
+
+        for (const Scan_t& scan : scans) {
+            journalAppend(journal_, scan.time, scan.text.data(), scan.text.size());
+        }
+        journalSync(journal_);
+
+        more = false;
+        auto now = std::chrono::steady_clock::now();
+        if (!stopping && journalPending(journal_) > 0 && live_.load(std::memory_order_relaxed) == 0 &&
+            now >= retry_at) {
+            if (replay()) {
+                backoff_ms = 0;
+                more       = journalPending(journal_) > 0;
+            } else {
+                backoff_ms = backoff_ms ? std::min(backoff_ms * 2, MAX_BACKOFF_MS) : MIN_BACKOFF_MS;
+                retry_at   = now + std::chrono::milliseconds(backoff_ms);
+            }
+            journalSync(journal_);
+        }
+
+        lock.lock();
+        journalGetStats(journal_, &journalStats_);
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+// Send the oldest scans the server has not taken, true if the head of the
+// journal moved on
+bool ScanJournal::replay() {
+    std::vector<JournalRecord_t> records(clients_.size());
+    size_t count = journalRead(journal_, records.data(), records.size());
+    if (count == 0) {
+        return false;
+    }
+
+    // Records keep their state from the last read, one dropped from the
+    // journal since loses it
+    std::vector<Replay_t> replays(count);
+    for (size_t i = 0; i < count; i++) {
+        Replay_t replay = {records[i].time, fnv1a64((const char*)records[i].data, records[i].size), 0, false};
+        for (const Replay_t& known : replays_) {
+            if (known.time == replay.time && known.hash == replay.hash) {
+                replay = known;
+                break;
+            }
+        }
+        replays[i] = replay;
+    }
+
+    // The scan time goes along, the check-in happened then and not now
+    std::vector<size_t> sent;
+    std::vector<std::string> urls;
+    for (size_t i = 0; i < count; i++) {
+        if (replays[i].done) {
+            continue;
+        }
+        std::string text((const char*)records[i].data, records[i].size);
+        char* scandata = httpClientEscape(clients_[sent.size()], text.c_str());
+        urls.push_back(url_ + "&scandata=" + (scandata ? scandata : "") + "&scanned=" +
+                       std::to_string((long long)records[i].time));
+        sent.push_back(i);
+        curl_free(scandata);
+    }
+    std::vector<const char*> url_list(urls.size());
+    for (size_t i = 0; i < urls.size(); i++) {
+        url_list[i] = urls[i].c_str();
+    }
+
+    std::vector<HttpResponse_t> responses(sent.size());
+    httpClientGetBatch(clients_.data(), url_list.data(), sent.size(), REPLAY_TIMEOUT_MS, responses.data());
+
+    // A 4xx will not change on a retry. Other failures only count against
+    // a scan while the server answers, not while it cannot be reached.
+    bool reachable  = std::any_of(responses.begin(), responses.end(), [](const HttpResponse_t& response) {
+        return response.status != 0;
+    });
+    size_t failed   = 0;
+    size_t given_up = 0;
+    for (size_t i = 0; i < sent.size(); i++) {
+        Replay_t& replay = replays[sent[i]];
+        long status      = responses[i].status;
+        if (status == 200) {
+            replay.done = true;
+            continue;
+        }
+        failed++;
+        if (status >= 400 && status < 500) {
+            syslog(LOG_WARNING, "Server refused a journaled scan with %ld, giving it up", status);
+            replay.done = true;
+        } else if (reachable && ++replay.attempts >= MAX_REPLAY_ATTEMPTS) {
+            syslog(LOG_WARNING, "Journaled scan failed %d times, giving it up", replay.attempts);
+            replay.done = true;
+        }
+        given_up += replay.done;
+    }
+
+    // The journal is consumed from the head, scans done behind one still
+    // retried wait there and are not sent again. After a restart they are.
+    size_t acked = 0;
+    while (acked < count && replays[acked].done) {
+        acked++;
+    }
+    replays_.assign(replays.begin() + acked, replays.end());
+    replayed_.fetch_add(sent.size(), std::memory_order_relaxed);
+    replayFailures_.fetch_add(failed, std::memory_order_relaxed);
+    replayGivenUp_.fetch_add(given_up, std::memory_order_relaxed);
+    journalAck(journal_, acked);
+    if (acked) {
+        syslog(LOG_INFO, "Replayed %zu journaled scans, %zu left", acked, journalPending(journal_));
+    }
+    return acked > 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * Scans the server did not get, kept on the SD card until it is reachable
+ * again.
+ *
+ * A check that got no answer is recorded in a journal (see journal.h) so
+ * the server still learns about the check-in after an outage. Records are
+ * handed to a thread of their own, which appends them, syncs them to the
+ * card in batches and replays them to the endpoint in batches of requests
+ * sent side by side. Replay waits while live checks are in flight and backs
+ * off while the server cannot be reached, so it never holds up a visitor at
+ * the gate.
+ *
+ * A scan the server refuses with a 4xx answer is given up on, and so is one
+ * that failed MAX_REPLAY_ATTEMPTS times while the server was answering
+ * others, so a single bad scan cannot hold up the rest for good. Scans the
+ * server took are not sent again while an older one is still retried.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httpclient.h"
+#include "journal.h"
+
+/**
+ * brief Counters of the journal, see JournalStats_t.
+ */
+typedef struct {
+    JournalStats_t journal;
+    /// Replay requests sent.
+    uint64_t replayed;
+    /// Replay requests without an answer.
+    uint64_t replayFailures;
+    /// Scans given up on, also counted as acked by the journal.
+    uint64_t replayGivenUp;
+} ScanJournalStats_t;
+
+/**
+ * brief The journal and the thread replaying it.
+ *
+ * May be used from any thread.
+ */
+class ScanJournal {
+public:
+    ScanJournal();
+    ~ScanJournal();
+
+    /**
+     * brief Open the journal and start the thread.
+     *
+     * httpClientGlobalInit() must have been called first.
+     *
+     * param path The journal file.
+     * param maxBytes Most bytes the file may hold.
+     * param url Endpoint with its query, the scan is appended as scandata.
+     * param batch Most replay requests sent at once.
+     * return false if the journal could not be opened.
+     */
+    bool start(const char* path, size_t maxBytes, const std::string& url, int batch);
+
+    /**
+     * brief Stop the thread, after syncing what was recorded.
+     */
+    void stop();
+
+    /**
+     * brief Record a scan for replay.
+     *
+     * param text The decoded text.
+     * param size Length of the text.
+     * param time Wall clock time of the scan in seconds.
+     */
+    void record(const char* text, size_t size, int64_t time);
+
+    /**
+     * brief Note that a live check was started or finished, replay waits
+     * while any are in flight.
+     */
+    void liveCheckStarted();
+    void liveCheckFinished();
+
+    /**
+     * brief Get the counters accumulated so far.
+     *
+     * param stats Filled with the counters.
+     */
+    void getStats(ScanJournalStats_t* stats);
+
+private:
+    typedef struct {
+        std::string text;
+        int64_t time;
+    } Scan_t;
+
+    /// Replay state of a scan behind the head of the journal, which is
+    /// only known by its time and text.
+    typedef struct {
+        int64_t time;
+        uint64_t hash;
+        int attempts;
+        /// Taken by the server or given up on, not to be sent again.
+        bool done;
+    } Replay_t;
+
+    void run();
+    bool replay();
+
+    Journal_t* journal_;
+    std::string url_;
+    std::vector<HttpClient_t*> clients_;
+    /// Replay state of the records read last, from the head on.
+    std::vector<Replay_t> replays_;
+
+    std::thread thread_;
+    /// Guards the scans not yet appended, the stats copy and stop_.
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::vector<Scan_t> scans_;
+    JournalStats_t journalStats_;
+    bool stop_;
+
+    std::atomic<int> live_;
+    std::atomic<uint64_t> replayed_;
+    std::atomic<uint64_t> replayFailures_;
+    std::atomic<uint64_t> replayGivenUp_;
+};
@@ -0,0 +1,99 @@
+#include "scenegate.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+SceneGate::SceneGate()
+    : threshold_(0),
+      holdFrames_(0),
+      blocksWide_(0),
+      blocksHigh_(0),
+      holdLeft_(0),
+      framesGated_(0),
+      framesPassed_(0),
+      changes_(0) {}
+
+void SceneGate::configure(int threshold, int holdFrames) {
+    threshold_.store(threshold > 0 ? threshold : 0, std::memory_order_relaxed);
+    holdFrames_.store(holdFrames > 0 ? holdFrames : 0, std::memory_order_relaxed);
+}
+
+// Sum the pixels of every whole block, the few rows and columns left over at
+// the right and bottom edges are ignored
+void SceneGate::sumBlocks(const cv::Mat& roi) {
+    std::fill(sums_.begin(), sums_.end(), 0);
+    for (int y = 0; y < blocksHigh_ * BLOCK; y++) {
+        const uint8_t* row = roi.ptr<uint8_t>(y);
+        uint32_t* sums     = &sums_[(size_t)(y / BLOCK) * blocksWide_];
+        for (int bx = 0; bx < blocksWide_; bx++) {
+            const uint8_t* p = row + bx * BLOCK;
+            uint32_t sum     = 0;
+            for (int x = 0; x < BLOCK; x++) {
+                sum += p[x];
+            }
+            sums[bx] += sum;
+        }
+    }
+}
+
+bool SceneGate::check(const cv::Mat& roi, bool keepOpen) {
+    int threshold = threshold_.load(std::memory_order_relaxed);
+    bool changed  = false;
+
+    if (threshold == 0) {
+        framesPassed_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    if (roi.size() != size_) {
+        // First frame or new ROI, nothing to compare with
+        size_       = roi.size();
+        blocksWide_ = roi.cols / BLOCK;
+        blocksHigh_ = roi.rows / BLOCK;
+        sums_.assign((size_t)blocksWide_ * blocksHigh_, 0);
+        sumBlocks(roi);
+        reference_.resize(sums_.size());
+        for (size_t i = 0; i < sums_.size(); i++) {
+            reference_[i] = sums_[i] * REFERENCE_WEIGHT;
+        }
+        changed = true;
+    } else {
+        sumBlocks(roi);
+        uint32_t limit = (uint32_t)threshold * BLOCK * BLOCK * REFERENCE_WEIGHT;
+        for (size_t i = 0; i < sums_.size(); i++) {
+            if ((uint32_t)abs((int32_t)(sums_[i] * REFERENCE_WEIGHT - reference_[i])) > limit) {
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (changed) {
+        changes_.fetch_add(1, std::memory_order_relaxed);
+        holdLeft_ = holdFrames_.load(std::memory_order_relaxed);
+    } else if (keepOpen) {
+        changed = true;
+    } else if (holdLeft_ > 0) {
+        holdLeft_--;
+        changed = true;
+    }
+
+    // A ROI too small for a single block is never gated
+    if (!changed && !reference_.empty()) {
+        framesGated_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Only frames let through move the reference, so a slow change adds up
+    for (size_t i = 0; i < sums_.size(); i++) {
+        reference_[i] += (int32_t)(sums_[i] * REFERENCE_WEIGHT - reference_[i]) / REFERENCE_WEIGHT;
+    }
+    framesPassed_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void SceneGate::getStats(SceneGateStats_t* stats) const {
+    stats->framesGated  = framesGated_.load(std::memory_order_relaxed);
+    stats->framesPassed = framesPassed_.load(std::memory_order_relaxed);
+    stats->changes      = changes_.load(std::memory_order_relaxed);
+}
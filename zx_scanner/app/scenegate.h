@@ -0,0 +1,102 @@
+/**
+ * Scene-change gate in front of the decode cascade.
+ *
+ * Most of the day nobody stands at the gate and the region of interest
+ * shows the same empty scene frame after frame. The gate sums the ROI over
+ * 16x16 blocks and compares the block sums to a reference. Only when the
+ * mean of some block is further from the reference than the threshold is
+ * the frame decoded, and for a number of frames after that. The frame in
+ * which a code appears always differs from the reference, so the gate opens
+ * on that very frame.
+ *
+ * The reference only follows the frames let through, and slowly, so a code
+ * moved in too slowly to change much from one frame to the next still
+ * opens the gate, and one held still keeps it open for a while after the
+ * hold frames.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+/**
+ * brief Counters of gated and decoded frames.
+ */
+typedef struct {
+    /// Frames skipped because the ROI had not changed.
+    uint64_t framesGated;
+    /// Frames let through to the decoder.
+    uint64_t framesPassed;
+    /// Frames in which a change was detected.
+    uint64_t changes;
+} SceneGateStats_t;
+
+/**
+ * brief Block-sum change detector.
+ *
+ * check() must always be called from the same thread, the other methods
+ * may be called from any thread.
+ */
+class SceneGate {
+public:
+    SceneGate();
+
+    /**
+     * brief Set how sensitive the gate is.
+     *
+     * param threshold Change of the mean grey level of a block that counts
+     *        as a change of the scene, 0 to let every frame through.
+     * param holdFrames Number of frames let through after the last change.
+     */
+    void configure(int threshold, int holdFrames);
+
+    /**
+     * brief Decide whether a region of interest is worth decoding.
+     *
+     * param roi Greyscale image, may be a view into a VDO buffer.
+     * param keepOpen Let the frame through even if nothing changed, e.g.
+     *        while a code is tracked.
+     * return True if the frame should be decoded.
+     */
+    bool check(const cv::Mat& roi, bool keepOpen);
+
+    /**
+     * brief Get the counters accumulated so far.
+     *
+     * param stats Filled with the counters.
+     */
+    void getStats(SceneGateStats_t* stats) const;
+
+private:
+    static const int BLOCK = 16;
+    /// The reference moves 1/REFERENCE_WEIGHT of the way to every frame let
+    /// through.
+    static const int REFERENCE_WEIGHT = 16;
+
+    void sumBlocks(const cv::Mat& roi);
+
+    std::atomic<int> threshold_;
+    std::atomic<int> holdFrames_;
+
+    /// Owned by the thread calling check().
+    cv::Size size_;
+    int blocksWide_;
+    int blocksHigh_;
+    std::vector<uint32_t> sums_;
+    /// Running average of the block sums of the frames let through, times
+    /// REFERENCE_WEIGHT.
+    std::vector<uint32_t> reference_;
+    /// Frames still to let through after the last change.
+    int holdLeft_;
+
+    std::atomic<uint64_t> framesGated_;
+    std::atomic<uint64_t> framesPassed_;
+    std::atomic<uint64_t> changes_;
+};
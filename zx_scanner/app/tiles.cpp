@@ -0,0 +1,136 @@
+#include "tiles.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+TileDecoder::TileDecoder() : codeSize_(0), budgetMs_(0) {}
+
+void TileDecoder::setCodeSize(int pixels) {
+    codeSize_.store(pixels > 0 ? pixels : 0, std::memory_order_relaxed);
+}
+
+void TileDecoder::configure(const PipelineConfig_t& config) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    config_ = config;
+    for (auto& tile : tiles_) {
+        tile->pipeline.configure(config);
+    }
+}
+
+void TileDecoder::setFrameBudget(int ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budgetMs_ = ms;
+    for (auto& tile : tiles_) {
+        tile->decoder.setFrameBudget(ms);
+    }
+}
+
+bool TileDecoder::wants(const cv::Size& size) const {
+    int tile = 2 * codeSize_.load(std::memory_order_relaxed);
+    return tile > 0 && (size.width > tile || size.height > tile);
+}
+
+// Tile starts along one axis, a step apart, the last one moved back to end
+// at the edge
+void TileDecoder::layout(int length, int tile, int step, std::vector<int>* starts) {
+    starts->clear();
+    if (length <= tile) {
+        starts->push_back(0);
+        return;
+    }
+    for (int start = 0; start + tile < length; start += step) {
+        starts->push_back(start);
+    }
+    starts->push_back(length - tile);
+}
+
+ZXing::Barcodes TileDecoder::decode(const cv::Mat& region, std::vector<cv::Rect>* bounds) {
+    int codeSize = codeSize_.load(std::memory_order_relaxed);
+    int tileSize = 2 * codeSize;
+    if (tileSize == 0) {
+        // Turned off since wants() was asked, decode in one piece
+        tileSize = std::max(region.cols, region.rows);
+        codeSize = tileSize;
+    }
+
+    layout(region.cols, tileSize, codeSize, &xs_);
+    layout(region.rows, tileSize, codeSize, &ys_);
+    size_t count = xs_.size() * ys_.size();
+
+    if (tiles_.size() < count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        while (tiles_.size() < count) {
+            tiles_.emplace_back(new Tile_t());
+            tiles_.back()->pipeline.configure(config_);
+            tiles_.back()->decoder.setFrameBudget(budgetMs_);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        int x = xs_[i % xs_.size()];
+        int y = ys_[i / xs_.size()];
+        tiles_[i]->rect = cv::Rect(x, y, std::min(tileSize, region.cols), std::min(tileSize, region.rows));
+    }
+
+    cv::parallel_for_(cv::Range(0, (int)count), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            Tile_t* tile   = tiles_[i].get();
+            tile->barcodes = tile->decoder.decode(region(tile->rect));
+            tile->bounds.clear();
+            for (const auto& barcode : tile->barcodes) {
+                tile->bounds.push_back(tile->decoder.bounds(barcode) + tile->rect.tl());
+            }
+        }
+    });
+
+    // A code inside the overlap of two tiles is found in both
+    ZXing::Barcodes barcodes;
+    bounds->clear();
+    for (size_t i = 0; i < count; i++) {
+        const Tile_t* tile = tiles_[i].get();
+        for (size_t j = 0; j < tile->barcodes.size(); j++) {
+            bool duplicate = false;
+            for (size_t k = 0; k < barcodes.size(); k++) {
+                if (barcodes[k].text() == tile->barcodes[j].text() && ((*bounds)[k] & tile->bounds[j]).area() > 0) {
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (!duplicate) {
+                barcodes.push_back(tile->barcodes[j]);
+                bounds->push_back(tile->bounds[j]);
+            }
+        }
+    }
+    return barcodes;
+}
+
+void TileDecoder::addDecoderStats(DecoderStats_t* stats) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& tile : tiles_) {
+        DecoderStats_t tile_stats;
+        tile->decoder.getStats(&tile_stats);
+        stats->frames += tile_stats.frames;
+        for (int level = 0; level < DECODE_LEVELS; level++) {
+            stats->hits[level] += tile_stats.hits[level];
+        }
+        stats->budgetExhausted += tile_stats.budgetExhausted;
+    }
+}
+
+uint64_t TileDecoder::steadyStateAllocations() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t allocations = 0;
+    for (auto& tile : tiles_) {
+        allocations += tile->pipeline.steadyStateAllocations();
+    }
+    return allocations;
+}
+
+void TileDecoder::logStageTimes(const char* label) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < tiles_.size(); i++) {
+        char tile_label[64];
+        snprintf(tile_label, sizeof(tile_label), "%s tile %zu", label, i);
+        tiles_[i]->pipeline.logStageTimes(tile_label);
+    }
+}
@@ -0,0 +1,119 @@
+/**
+ * Tile-parallel decoding of large regions.
+ *
+ * With wide regions or 1080p streams, enhancing and decoding one region is
+ * a single long call that uses one core. Instead the region can be split
+ * into square tiles twice the size of the largest expected code, each
+ * overlapping its neighbours by one code size, so every code lies wholly
+ * inside at least one tile. The tiles are enhanced and decoded in parallel
+ * with cv::parallel_for_, each with its own pipeline, and codes found in
+ * more than one tile are merged by text and position.
+ *
+ * Tiles at the right and bottom edges are moved inwards rather than cut
+ * short, so all tiles have the same size and the pipelines keep their
+ * buffers.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include <ZXing/ReadBarcode.h>
+
+#include "decoder.h"
+#include "pipeline.h"
+
+/**
+ * brief Decodes regions tile by tile on all cores.
+ *
+ * wants() and decode() must always be called from the same thread, the
+ * other methods may be called from any thread.
+ */
+class TileDecoder {
+public:
+    TileDecoder();
+
+    /**
+     * brief Set the largest code expected, which sets the tile size.
+     *
+     * param pixels Side of the largest code in region pixels, 0 to turn
+     *        tiling off.
+     */
+    void setCodeSize(int pixels);
+
+    /**
+     * brief Configure the pipeline of every tile.
+     */
+    void configure(const PipelineConfig_t& config);
+
+    /**
+     * brief Set the decode cascade budget of every tile.
+     */
+    void setFrameBudget(int ms);
+
+    /**
+     * brief Whether a region is large enough to be split.
+     *
+     * param size Size of the region.
+     * return True if tiling is on and the region is larger than one tile.
+     */
+    bool wants(const cv::Size& size) const;
+
+    /**
+     * brief Decode a region tile by tile.
+     *
+     * param region Greyscale image.
+     * param bounds Filled with the bounding box of each returned code, in
+     *        region coordinates.
+     * return The codes found in all tiles, without duplicates.
+     */
+    ZXing::Barcodes decode(const cv::Mat& region, std::vector<cv::Rect>* bounds);
+
+    /**
+     * brief Add the decode cascade counters of all tiles to stats.
+     */
+    void addDecoderStats(DecoderStats_t* stats) const;
+
+    /**
+     * brief Pipeline heap allocations in steady state summed over all tiles.
+     */
+    uint64_t steadyStateAllocations() const;
+
+    /**
+     * brief Log the stage times of every tile's pipeline.
+     *
+     * param label Start of the log lines, followed by the tile number.
+     */
+    void logStageTimes(const char* label);
+
+private:
+    typedef struct Tile {
+        Tile() : decoder(pipeline) {}
+
+        Pipeline pipeline;
+        Decoder decoder;
+        cv::Rect rect;
+        /// Results of the last decode(), in region coordinates.
+        ZXing::Barcodes barcodes;
+        std::vector<cv::Rect> bounds;
+    } Tile_t;
+
+    static void layout(int length, int tile, int step, std::vector<int>* starts);
+
+    std::atomic<int> codeSize_;
+
+    /// Guards adding tiles and the settings they are created with. Only the
+    /// thread calling decode() adds tiles, so it may read them unlocked.
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Tile_t>> tiles_;
+    PipelineConfig_t config_;
+    int budgetMs_;
+
+    /// Owned by the thread calling decode().
+    std::vector<int> xs_;
+    std::vector<int> ys_;
+};
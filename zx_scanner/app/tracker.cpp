@@ -0,0 +1,59 @@
+#include "tracker.h"
+
+#include <algorithm>
+
+Tracker::Tracker()
+    : maxMisses_(3),
+      tracking_(false),
+      misses_(0),
+      framesTracked_(0),
+      hits_(0),
+      lost_(0) {}
+
+void Tracker::setMaxMisses(int misses) {
+    maxMisses_.store(misses > 0 ? misses : 0, std::memory_order_relaxed);
+}
+
+bool Tracker::region(const cv::Size& frameSize, const cv::Size& window, cv::Rect* region) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!tracking_ || maxMisses_.load(std::memory_order_relaxed) == 0) {
+        tracking_ = false;
+        return false;
+    }
+
+    int width   = std::min(window.width, frameSize.width);
+    int height  = std::min(window.height, frameSize.height);
+    int centreX = code_.x + code_.width / 2;
+    int centreY = code_.y + code_.height / 2;
+    region->x      = std::min(std::max(centreX - width / 2, 0), frameSize.width - width);
+    region->y      = std::min(std::max(centreY - height / 2, 0), frameSize.height - height);
+    region->width  = width;
+    region->height = height;
+
+    framesTracked_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void Tracker::found(const cv::Rect& code) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tracking_) {
+        hits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    tracking_ = true;
+    code_     = code;
+    misses_   = 0;
+}
+
+void Tracker::missed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tracking_ && ++misses_ >= maxMisses_.load(std::memory_order_relaxed)) {
+        tracking_ = false;
+        lost_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Tracker::getStats(TrackerStats_t* stats) const {
+    stats->framesTracked = framesTracked_.load(std::memory_order_relaxed);
+    stats->hits          = hits_.load(std::memory_order_relaxed);
+    stats->lost          = lost_.load(std::memory_order_relaxed);
+}
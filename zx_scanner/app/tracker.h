@@ -0,0 +1,94 @@
+/**
+ * Follows a decoded code from frame to frame.
+ *
+ * A visitor holds a pass in front of the camera for many frames, and from
+ * one frame to the next it barely moves. Once a code has been decoded, the
+ * next frames only decode a region around where it was last seen, skipping
+ * the search of the whole frame. The track is lost after a few frames in a
+ * row without a decode there, and the full search takes over again.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+#include <opencv2/core.hpp>
+#pragma GCC diagnostic pop
+
+/**
+ * brief Counters of tracked frames.
+ */
+typedef struct {
+    /// Frames decoded only around the tracked code.
+    uint64_t framesTracked;
+    /// Tracked frames in which the code was found again.
+    uint64_t hits;
+    /// Tracks given up.
+    uint64_t lost;
+} TrackerStats_t;
+
+/**
+ * brief The track of the last decoded code.
+ *
+ * May be used from any thread. Decode results arrive on the decode workers
+ * while the frame thread asks for the next region.
+ */
+class Tracker {
+public:
+    Tracker();
+
+    /**
+     * brief Set how long a track survives without a decode.
+     *
+     * param misses Frames in a row without a decode after which the track
+     *        is lost, 0 to turn tracking off.
+     */
+    void setMaxMisses(int misses);
+
+    /**
+     * brief Get the region to decode first in the next frame.
+     *
+     * param frameSize Size of the frame.
+     * param window Size of the region.
+     * param region Set to a region of the given size centred on the
+     *        tracked code, moved inside the frame if needed.
+     * return False if there is no track.
+     */
+    bool region(const cv::Size& frameSize, const cv::Size& window, cv::Rect* region);
+
+    /**
+     * brief Start or continue a track.
+     *
+     * param code Bounding box of a decoded code in frame coordinates.
+     */
+    void found(const cv::Rect& code);
+
+    /**
+     * brief Note a tracked frame in which the code was not decoded.
+     */
+    void missed();
+
+    /**
+     * brief Get the counters accumulated so far.
+     *
+     * param stats Filled with the counters.
+     */
+    void getStats(TrackerStats_t* stats) const;
+
+private:
+    std::atomic<int> maxMisses_;
+
+    /// Guards the track.
+    std::mutex mutex_;
+    bool tracking_;
+    cv::Rect code_;
+    int misses_;
+
+    std::atomic<uint64_t> framesTracked_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> lost_;
+};
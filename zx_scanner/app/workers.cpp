@@ -0,0 +1,197 @@
+#include "workers.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <syslog.h>
+
+DecodeWorkers::DecodeWorkers(DecodeDoneFunc done, void* user_data)
+    : done_(done),
+      userData_(user_data),
+      budgetMs_(0),
+      tileCodeSize_(0),
+      pending_(NULL),
+      stopping_(false),
+      jobsSubmitted_(0),
+      jobsSuperseded_(0),
+      jobsDecoded_(0) {}
+
+DecodeWorkers::~DecodeWorkers() {
+    stop();
+}
+
+void DecodeWorkers::start(int threads) {
+    threads = std::min(std::max(threads, 1), MAX_THREADS);
+
+    // One job per worker, one waiting and one being filled by the frame
+    // thread is all that can ever be in use
+    for (int i = 0; i < threads + 2; i++) {
+        jobs_.emplace_back(new FrameJob_t());
+        free_.push_back(jobs_.back().get());
+    }
+
+    stopping_ = false;
+    for (int i = 0; i < threads; i++) {
+        workers_.emplace_back(new Worker_t());
+        Worker_t* worker = workers_.back().get();
+        worker->pipeline.configure(config_);
+        worker->decoder.setFrameBudget(budgetMs_);
+        worker->tiles.configure(config_);
+        worker->tiles.setFrameBudget(budgetMs_);
+        worker->tiles.setCodeSize(tileCodeSize_);
+        worker->thread = std::thread(&DecodeWorkers::run, this, worker);
+    }
+    syslog(LOG_INFO, "Started %d decode workers", threads);
+}
+
+void DecodeWorkers::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeup_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    workers_.clear();
+}
+
+void DecodeWorkers::configure(const PipelineConfig_t& config) {
+    config_ = config;
+    for (auto& worker : workers_) {
+        worker->pipeline.configure(config);
+        worker->tiles.configure(config);
+    }
+}
+
+void DecodeWorkers::setFrameBudget(int ms) {
+    budgetMs_ = ms;
+    for (auto& worker : workers_) {
+        worker->decoder.setFrameBudget(ms);
+        worker->tiles.setFrameBudget(ms);
+    }
+}
+
+void DecodeWorkers::setTileCodeSize(int pixels) {
+    tileCodeSize_ = pixels;
+    for (auto& worker : workers_) {
+        worker->tiles.setCodeSize(pixels);
+    }
+}
+
+FrameJob_t* DecodeWorkers::acquire() {
+    FrameJob_t* job;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_.empty()) {
+            job = free_.back();
+            free_.pop_back();
+        } else {
+            // Cannot happen with two jobs more than workers, but never
+            // leave the frame thread without one: take back the waiting job
+            job      = pending_;
+            pending_ = NULL;
+        }
+    }
+    job->count   = 0;
+    job->tracked = false;
+    return job;
+}
+
+void DecodeWorkers::release(FrameJob_t* job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(job);
+}
+
+void DecodeWorkers::submit(FrameJob_t* job) {
+    jobsSubmitted_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_) {
+            // Latest wins, the older frame is not worth decoding any more
+            free_.push_back(pending_);
+            jobsSuperseded_.fetch_add(1, std::memory_order_relaxed);
+        }
+        pending_ = job;
+    }
+    wakeup_.notify_one();
+}
+
+void DecodeWorkers::run(Worker_t* worker) {
+    for (;;) {
+        FrameJob_t* job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeup_.wait(lock, [this] { return pending_ || stopping_; });
+            if (stopping_) {
+                return;
+            }
+            job      = pending_;
+            pending_ = NULL;
+        }
+
+        // Regions are in order of promise, stop at the first with a code
+        ZXing::Barcodes barcodes;
+        cv::Rect bounds;
+        for (size_t i = 0; i < job->count; i++) {
+            const cv::Mat& region = job->regions[i];
+            if (worker->tiles.wants(region.size())) {
+                barcodes = worker->tiles.decode(region, &worker->bounds);
+                if (!barcodes.empty()) {
+                    bounds = worker->bounds[0] + job->rects[i].tl();
+                    break;
+                }
+            } else {
+                barcodes = worker->decoder.decode(region);
+                if (!barcodes.empty()) {
+                    bounds = worker->decoder.bounds(barcodes[0]) + job->rects[i].tl();
+                    break;
+                }
+            }
+        }
+        jobsDecoded_.fetch_add(1, std::memory_order_relaxed);
+        done_(job, barcodes, bounds, userData_);
+
+        release(job);
+    }
+}
+
+void DecodeWorkers::getStats(WorkerStats_t* stats) const {
+    stats->jobsSubmitted  = jobsSubmitted_.load(std::memory_order_relaxed);
+    stats->jobsSuperseded = jobsSuperseded_.load(std::memory_order_relaxed);
+    stats->jobsDecoded    = jobsDecoded_.load(std::memory_order_relaxed);
+}
+
+void DecodeWorkers::getDecoderStats(DecoderStats_t* stats) const {
+    *stats = {};
+    for (auto& worker : workers_) {
+        DecoderStats_t worker_stats;
+        worker->decoder.getStats(&worker_stats);
+        stats->frames += worker_stats.frames;
+        for (int level = 0; level < DECODE_LEVELS; level++) {
+            stats->hits[level] += worker_stats.hits[level];
+        }
+        stats->budgetExhausted += worker_stats.budgetExhausted;
+        worker->tiles.addDecoderStats(stats);
+    }
+}
+
+uint64_t DecodeWorkers::steadyStateAllocations() const {
+    uint64_t allocations = 0;
+    for (auto& worker : workers_) {
+        allocations += worker->pipeline.steadyStateAllocations();
+        allocations += worker->tiles.steadyStateAllocations();
+    }
+    return allocations;
+}
+
+void DecodeWorkers::logStageTimes() {
+    for (size_t i = 0; i < workers_.size(); i++) {
+        char label[32];
+        snprintf(label, sizeof(label), "Worker %zu pipeline", i);
+        workers_[i]->pipeline.logStageTimes(label);
+        workers_[i]->tiles.logStageTimes(label);
+    }
+}
@@ -0,0 +1,204 @@
+/**
+ * Decode workers, so frames are decoded on several cores at once.
+ *
+ * The frame thread only gates, localises and copies the candidate regions
+ * of a frame into a job, then hands the VDO buffer straight back. Jobs go
+ * to a pool of worker threads, each with its own enhancement pipeline and
+ * decode cascade, so frame N+1 is being enhanced while frame N is still in
+ * ZXing. Between the frame thread and the workers there is a single slot:
+ * a job that has not been picked up when the next one arrives is dropped,
+ * so the workers always get the newest frame and never work through a
+ * backlog of stale ones.
+ *
+ * Regions larger than a tile are split and decoded on all cores, see
+ * tiles.h.
+ *
+ * Jobs come from a fixed pool and keep their region buffers, so handing a
+ * frame over does not touch the heap in steady state.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#include "decoder.h"
+#include "imgprovider.h"
+#include "pipeline.h"
+#include "tiles.h"
+
+/**
+ * brief Regions of one frame to decode.
+ */
+typedef struct FrameJob {
+    ImgFrameInfo_t info;
+    /// Number of regions in use.
+    size_t count;
+    /// Regions copied out of the frame, most promising first. Only the
+    /// first count are in use, the rest keep their memory for later jobs.
+    std::vector<cv::Mat> regions;
+    /// Where each region was in the frame.
+    std::vector<cv::Rect> rects;
+    /// Whether the regions came from the tracker rather than a search.
+    bool tracked;
+} FrameJob_t;
+
+/**
+ * brief Called on a worker thread when a job has been decoded.
+ *
+ * param job The job, only valid during the call.
+ * param barcodes Codes found in the first region that had any, or empty.
+ * param bounds Bounding box of the first code in frame coordinates.
+ * param user_data As given to DecodeWorkers.
+ */
+typedef void (*DecodeDoneFunc)(const FrameJob_t* job,
+                               const ZXing::Barcodes& barcodes,
+                               const cv::Rect& bounds,
+                               void* user_data);
+
+/**
+ * brief Counters of jobs handed to the workers.
+ */
+typedef struct {
+    uint64_t jobsSubmitted;
+    /// Jobs replaced by a newer one before a worker was free.
+    uint64_t jobsSuperseded;
+    uint64_t jobsDecoded;
+} WorkerStats_t;
+
+/**
+ * brief A pool of decode threads fed with the latest frame.
+ *
+ * acquire(), release() and submit() must always be called from the same
+ * thread, the other methods may be called from any thread.
+ */
+class DecodeWorkers {
+public:
+    /**
+     * brief Create the pool, no threads are started yet.
+     *
+     * param done Called with the result of every job.
+     * param user_data Passed to done.
+     */
+    DecodeWorkers(DecodeDoneFunc done, void* user_data);
+    ~DecodeWorkers();
+
+    /**
+     * brief Start the worker threads.
+     *
+     * param threads Number of workers, 1 to MAX_THREADS.
+     */
+    void start(int threads);
+
+    /**
+     * brief Stop and join the worker threads, jobs not yet picked up are
+     * dropped.
+     */
+    void stop();
+
+    /**
+     * brief Configure the pipeline of every worker.
+     *
+     * param config New settings, used from each worker's next job.
+     */
+    void configure(const PipelineConfig_t& config);
+
+    /**
+     * brief Set the decode cascade budget of every worker.
+     *
+     * param ms Budget in milliseconds, 0 for no limit.
+     */
+    void setFrameBudget(int ms);
+
+    /**
+     * brief Set the largest expected code of every worker's tile decoder.
+     *
+     * param pixels Side of the largest code, 0 to turn tiling off.
+     */
+    void setTileCodeSize(int pixels);
+
+    /**
+     * brief Get an empty job to fill.
+     *
+     * Never fails: if every job is taken, the one waiting for a worker is
+     * reused.
+     */
+    FrameJob_t* acquire();
+
+    /**
+     * brief Give back a job without decoding it.
+     */
+    void release(FrameJob_t* job);
+
+    /**
+     * brief Hand a filled job to the workers, replacing any job still
+     * waiting for one.
+     */
+    void submit(FrameJob_t* job);
+
+    /**
+     * brief Get the job counters accumulated so far.
+     */
+    void getStats(WorkerStats_t* stats) const;
+
+    /**
+     * brief Get the decode cascade counters summed over all workers.
+     */
+    void getDecoderStats(DecoderStats_t* stats) const;
+
+    /**
+     * brief Pipeline heap allocations in steady state summed over all
+     * workers, see Pipeline::steadyStateAllocations().
+     */
+    uint64_t steadyStateAllocations() const;
+
+    /**
+     * brief Log the stage times of every worker's pipeline.
+     */
+    void logStageTimes();
+
+    static const int MAX_THREADS = 8;
+
+private:
+    typedef struct Worker {
+        Worker() : decoder(pipeline) {}
+
+        Pipeline pipeline;
+        Decoder decoder;
+        TileDecoder tiles;
+        /// Bounds of the codes found by tiles.
+        std::vector<cv::Rect> bounds;
+        std::thread thread;
+    } Worker_t;
+
+    void run(Worker_t* worker);
+
+    DecodeDoneFunc done_;
+    void* userData_;
+
+    /// Settings for workers started later, only used by the thread
+    /// calling start() and configure().
+    PipelineConfig_t config_;
+    int budgetMs_;
+    int tileCodeSize_;
+
+    std::vector<std::unique_ptr<Worker_t>> workers_;
+    std::vector<std::unique_ptr<FrameJob_t>> jobs_;
+
+    /// Guards the fields below.
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    std::vector<FrameJob_t*> free_;
+    /// The job waiting for a worker, or NULL.
+    FrameJob_t* pending_;
+    bool stopping_;
+
+    std::atomic<uint64_t> jobsSubmitted_;
+    std::atomic<uint64_t> jobsSuperseded_;
+    std::atomic<uint64_t> jobsDecoded_;
+};
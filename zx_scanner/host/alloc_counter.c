@@ -0,0 +1,62 @@
+/**
+ * Heap allocation counter for the host build.
+ *
+ * Replaces the glibc allocation entry points with wrappers that count calls
+ * per thread before forwarding to the real allocator. The application looks
+ * up allocCounterRead() as a weak symbol, so the counter is only active in
+ * builds that link this file (make ALLOC_HOOK=1). Not compatible with the
+ * sanitizers, which bring their own allocator.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+static _Thread_local uint64_t allocations = 0;
+
+uint64_t allocCounterRead(void) {
+    return allocations;
+}
+
+void* malloc(size_t size) {
+    allocations++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    allocations++;
+    return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    allocations++;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+    if (alignment % sizeof(void*) || (alignment & (alignment - 1))) {
+        return EINVAL;
+    }
+    allocations++;
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr && size) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * Host stand-in for AXEvent.
+ *
+ * Sent events are recorded one per line as
+ *
+ *   <monotonic us> <ISO 8601 time> declaration=<id> <key>=<value> ...
+ *
+ * so that tools can correlate them with the frames that caused them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+
+#include <axsdk/axevent.h>
+
+typedef struct {
+    gchar* key;
+    gchar* nameSpace;
+    AXEventValueType type;
+    /// Printable form of the value, NULL for key-only entries.
+    gchar* value;
+} KeyValue;
+
+struct _AXEventKeyValueSet {
+    GPtrArray* entries;
+};
+
+struct _AXEvent {
+    AXEventKeyValueSet* keyValueSet;
+    GDateTime* dateTime;
+};
+
+struct _AXEventHandler {
+    guint nextDeclaration;
+    GHashTable* declarations;
+};
+
+typedef struct {
+    guint declaration;
+    AXDeclarationCompleteCallback callback;
+    gpointer userData;
+} DeclarationComplete;
+
+static GMutex logMutex;
+static FILE* logFile = NULL;
+
+static GQuark ax_event_host_error_quark(void) {
+    return g_quark_from_static_string("axevent-host-error-quark");
+}
+#define AX_EVENT_HOST_ERROR (ax_event_host_error_quark())
+
+static void key_value_free(gpointer data) {
+    KeyValue* kv = data;
+    g_free(kv->key);
+    g_free(kv->nameSpace);
+    g_free(kv->value);
+    g_free(kv);
+}
+
+static KeyValue* key_value_find(AXEventKeyValueSet* set, const gchar* key, const gchar* nameSpace) {
+    for (guint i = 0; i < set->entries->len; i++) {
+        KeyValue* kv = g_ptr_array_index(set->entries, i);
+        if (!g_strcmp0(kv->key, key) && !g_strcmp0(kv->nameSpace, nameSpace)) {
+            return kv;
+        }
+    }
+    return NULL;
+}
+
+static AXEventKeyValueSet* key_value_set_copy(AXEventKeyValueSet* set) {
+    AXEventKeyValueSet* copy = ax_event_key_value_set_new();
+    for (guint i = 0; i < set->entries->len; i++) {
+        KeyValue* kv  = g_ptr_array_index(set->entries, i);
+        KeyValue* dup = g_new0(KeyValue, 1);
+        dup->key       = g_strdup(kv->key);
+        dup->nameSpace = g_strdup(kv->nameSpace);
+        dup->type      = kv->type;
+        dup->value     = g_strdup(kv->value);
+        g_ptr_array_add(copy->entries, dup);
+    }
+    return copy;
+}
+
+AXEventKeyValueSet* ax_event_key_value_set_new(void) {
+    AXEventKeyValueSet* set = g_new0(AXEventKeyValueSet, 1);
+    set->entries            = g_ptr_array_new_with_free_func(key_value_free);
+    return set;
+}
+
+void ax_event_key_value_set_free(AXEventKeyValueSet* key_value_set) {
+    if (!key_value_set) {
+        return;
+    }
+    g_ptr_array_unref(key_value_set->entries);
+    g_free(key_value_set);
+}
+
+gboolean ax_event_key_value_set_add_key_value(AXEventKeyValueSet* key_value_set,
+                                              const gchar* key,
+                                              const gchar* name_space,
+                                              gconstpointer value,
+                                              AXEventValueType value_type,
+                                              GError** error) {
+    if (!key_value_set || !key) {
+        g_set_error(error, AX_EVENT_HOST_ERROR, 0, "Invalid key value set or key");
+        return FALSE;
+    }
+
+    KeyValue* kv = key_value_find(key_value_set, key, name_space);
+    if (!kv) {
+        kv            = g_new0(KeyValue, 1);
+        kv->key       = g_strdup(key);
+        kv->nameSpace = g_strdup(name_space);
+        g_ptr_array_add(key_value_set->entries, kv);
+    }
+    kv->type = value_type;
+    g_clear_pointer(&kv->value, g_free);
+
+    if (value) {
+        switch (value_type) {
+            case AX_VALUE_TYPE_INT:
+                kv->value = g_strdup_printf("%d", *(const gint*)value);
+                break;
+            case AX_VALUE_TYPE_BOOL:
+                kv->value = g_strdup(*(const gboolean*)value ? "true" : "false");
+                break;
+            case AX_VALUE_TYPE_DOUBLE:
+                kv->value = g_strdup_printf("%g", *(const gdouble*)value);
+                break;
+            case AX_VALUE_TYPE_STRING:
+            case AX_VALUE_TYPE_ELEMENT:
+                kv->value = g_strdup(value);
+                break;
+        }
+    }
+    return TRUE;
+}
+
+static gboolean mark(AXEventKeyValueSet* set, const gchar* key, const gchar* nameSpace, GError** error) {
+    if (!key_value_find(set, key, nameSpace)) {
+        g_set_error(error, AX_EVENT_HOST_ERROR, 0, "Key %s not in key value set", key);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean ax_event_key_value_set_mark_as_source(AXEventKeyValueSet* key_value_set,
+                                               const gchar* key,
+                                               const gchar* name_space,
+                                               GError** error) {
+    return mark(key_value_set, key, name_space, error);
+}
+
+gboolean ax_event_key_value_set_mark_as_data(AXEventKeyValueSet* key_value_set,
+                                             const gchar* key,
+                                             const gchar* name_space,
+                                             GError** error) {
+    return mark(key_value_set, key, name_space, error);
+}
+
+gboolean ax_event_key_value_set_mark_as_user_defined(AXEventKeyValueSet* key_value_set,
+                                                     const gchar* key,
+                                                     const gchar* name_space,
+                                                     const gchar* user_tag,
+                                                     GError** error) {
+    (void)user_tag;
+    return mark(key_value_set, key, name_space, error);
+}
+
+AXEvent* ax_event_new2(AXEventKeyValueSet* key_value_set, GDateTime* date_time) {
+    AXEvent* event     = g_new0(AXEvent, 1);
+    event->keyValueSet = key_value_set_copy(key_value_set);
+    event->dateTime    = date_time ? g_date_time_ref(date_time) : g_date_time_new_now_utc();
+    return event;
+}
+
+void ax_event_free(AXEvent* event) {
+    if (!event) {
+        return;
+    }
+    ax_event_key_value_set_free(event->keyValueSet);
+    g_date_time_unref(event->dateTime);
+    g_free(event);
+}
+
+AXEventHandler* ax_event_handler_new(void) {
+    AXEventHandler* handler  = g_new0(AXEventHandler, 1);
+    handler->nextDeclaration = 1;
+    handler->declarations    = g_hash_table_new_full(
+        g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)ax_event_key_value_set_free);
+    return handler;
+}
+
+void ax_event_handler_free(AXEventHandler* event_handler) {
+    if (!event_handler) {
+        return;
+    }
+    g_hash_table_unref(event_handler->declarations);
+    g_free(event_handler);
+}
+
+static gboolean declaration_complete(gpointer data) {
+    DeclarationComplete* complete = data;
+    complete->callback(complete->declaration, complete->userData);
+    g_free(complete);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean ax_event_handler_declare(AXEventHandler* event_handler,
+                                  AXEventKeyValueSet* key_value_set,
+                                  gboolean stateless,
+                                  guint* declaration,
+                                  AXDeclarationCompleteCallback callback,
+                                  gpointer user_data,
+                                  GError** error) {
+    (void)stateless;
+
+    if (!event_handler || !key_value_set || !declaration) {
+        g_set_error(error, AX_EVENT_HOST_ERROR, 0, "Invalid declaration arguments");
+        return FALSE;
+    }
+
+    *declaration = event_handler->nextDeclaration++;
+    g_hash_table_insert(event_handler->declarations,
+                        GUINT_TO_POINTER(*declaration),
+                        key_value_set_copy(key_value_set));
+
+    if (callback) {
+        DeclarationComplete* complete = g_new0(DeclarationComplete, 1);
+        complete->declaration         = *declaration;
+        complete->callback            = callback;
+        complete->userData            = user_data;
+        g_idle_add(declaration_complete, complete);
+    }
+    return TRUE;
+}
+
+gboolean ax_event_handler_undeclare(AXEventHandler* event_handler, guint declaration, GError** error) {
+    if (!g_hash_table_remove(event_handler->declarations, GUINT_TO_POINTER(declaration))) {
+        g_set_error(error, AX_EVENT_HOST_ERROR, 0, "Unknown declaration %u", declaration);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+gboolean ax_event_handler_send_event(AXEventHandler* event_handler,
+                                     guint declaration,
+                                     AXEvent* event,
+                                     GError** error) {
+    if (!event || !g_hash_table_contains(event_handler->declarations, GUINT_TO_POINTER(declaration))) {
+        g_set_error(error, AX_EVENT_HOST_ERROR, 0, "Unknown declaration %u", declaration);
+        return FALSE;
+    }
+
+    g_autofree gchar* when = g_date_time_format_iso8601(event->dateTime);
+    GString* line          = g_string_new(NULL);
+    g_string_printf(line, "%" G_GINT64_FORMAT " %s declaration=%u", g_get_monotonic_time(), when, declaration);
+    for (guint i = 0; i < event->keyValueSet->entries->len; i++) {
+        KeyValue* kv = g_ptr_array_index(event->keyValueSet->entries, i);
+        g_string_append_printf(line, " %s=%s", kv->key, kv->value ? kv->value : "");
+    }
+
+    g_mutex_lock(&logMutex);
+    if (!logFile) {
+        const gchar* path = g_getenv("AXEVENT_HOST_LOG");
+        logFile           = (path && *path) ? fopen(path, "a") : NULL;
+        if (!logFile) {
+            logFile = stderr;
+        }
+    }
+    fprintf(logFile, "%s\n", line->str);
+    fflush(logFile);
+    g_mutex_unlock(&logMutex);
+
+    g_string_free(line, TRUE);
+    return TRUE;
+}
@@ -0,0 +1,209 @@
+/**
+ * Host stand-in for AXParameter.
+ *
+ * Values are read from a param.conf style file. The file is watched, so
+ * editing it while the application runs behaves like changing a setting in
+ * the device web interface: registered callbacks are invoked on the default
+ * main context with the full "root.<app>.<NAME>" parameter name.
+ */
+
+#include <gio/gio.h>
+#include <string.h>
+#include <syslog.h>
+
+#include <axsdk/axparameter.h>
+
+typedef struct {
+    AXParameterCallback callback;
+    gpointer userdata;
+} ParameterCallback;
+
+struct _AXParameter {
+    gchar* appName;
+    gchar* path;
+    GHashTable* values;
+    /// Parameter name -> ParameterCallback.
+    GHashTable* callbacks;
+    GFileMonitor* monitor;
+};
+
+typedef struct {
+    AXParameter* parameter;
+    gchar* name;
+    gchar* value;
+} ParameterChange;
+
+static GQuark ax_parameter_host_error_quark(void) {
+    return g_quark_from_static_string("axparameter-host-error-quark");
+}
+#define AX_PARAMETER_HOST_ERROR (ax_parameter_host_error_quark())
+
+/// Strip an optional "root.<app>." prefix from a parameter name.
+static const gchar* short_name(AXParameter* parameter, const gchar* name) {
+    g_autofree gchar* prefix = g_strdup_printf("root.%s.", parameter->appName);
+    return g_str_has_prefix(name, prefix) ? name + strlen(prefix) : name;
+}
+
+static GHashTable* load_values(const gchar* path, GError** error) {
+    g_autofree gchar* contents = NULL;
+    if (!g_file_get_contents(path, &contents, NULL, error)) {
+        return NULL;
+    }
+
+    GHashTable* values = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    g_auto(GStrv) lines = g_strsplit(contents, "\n", -1);
+    for (gchar** line = lines; *line; line++) {
+        gchar* entry = g_strstrip(*line);
+        gchar* equal = strchr(entry, '=');
+        if (!*entry || *entry == '#' || !equal) {
+            continue;
+        }
+        *equal      = '\0';
+        gchar* name = g_strstrip(entry);
+        gchar* value = g_strstrip(equal + 1);
+        size_t len  = strlen(value);
+        if (len >= 2 && value[0] == '"' && value[len - 1] == '"') {
+            value[len - 1] = '\0';
+            value++;
+        }
+        g_hash_table_replace(values, g_strdup(name), g_strdup(value));
+    }
+    return values;
+}
+
+static gboolean dispatch_change(gpointer data) {
+    ParameterChange* change = data;
+    ParameterCallback* cb   = g_hash_table_lookup(change->parameter->callbacks, change->name);
+
+    if (cb) {
+        g_autofree gchar* fullName =
+            g_strdup_printf("root.%s.%s", change->parameter->appName, change->name);
+        cb->callback(fullName, change->value, cb->userdata);
+    }
+
+    g_free(change->name);
+    g_free(change->value);
+    g_free(change);
+    return G_SOURCE_REMOVE;
+}
+
+static void queue_change(AXParameter* parameter, const gchar* name, const gchar* value) {
+    ParameterChange* change = g_new0(ParameterChange, 1);
+    change->parameter       = parameter;
+    change->name            = g_strdup(name);
+    change->value           = g_strdup(value);
+    g_idle_add(dispatch_change, change);
+}
+
+static void file_changed(GFileMonitor* monitor,
+                         GFile* file,
+                         GFile* other,
+                         GFileMonitorEvent event,
+                         gpointer userdata) {
+    (void)monitor;
+    (void)file;
+    (void)other;
+
+    AXParameter* parameter = userdata;
+    if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT) {
+        return;
+    }
+
+    g_autoptr(GError) error = NULL;
+    GHashTable* values      = load_values(parameter->path, &error);
+    if (!values) {
+        syslog(LOG_WARNING, "%s: Failed to reload %s: %s", __func__, parameter->path, error->message);
+        return;
+    }
+
+    GHashTableIter iter;
+    gpointer name, value;
+    g_hash_table_iter_init(&iter, values);
+    while (g_hash_table_iter_next(&iter, &name, &value)) {
+        if (g_strcmp0(g_hash_table_lookup(parameter->values, name), value) != 0) {
+            queue_change(parameter, name, value);
+        }
+    }
+    g_hash_table_unref(parameter->values);
+    parameter->values = values;
+}
+
+AXParameter* ax_parameter_new(const gchar* app_name, GError** error) {
+    const gchar* path = g_getenv("AXPARAMETER_HOST_FILE");
+
+    AXParameter* parameter = g_new0(AXParameter, 1);
+    parameter->appName     = g_strdup(app_name);
+    parameter->path        = g_strdup((path && *path) ? path : "param.conf");
+    parameter->callbacks   = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    parameter->values      = load_values(parameter->path, error);
+    if (!parameter->values) {
+        ax_parameter_free(parameter);
+        return NULL;
+    }
+
+    g_autoptr(GFile) file = g_file_new_for_path(parameter->path);
+    parameter->monitor    = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+    if (parameter->monitor) {
+        g_signal_connect(parameter->monitor, "changed", G_CALLBACK(file_changed), parameter);
+    }
+
+    syslog(LOG_INFO, "Serving %u parameters from %s", g_hash_table_size(parameter->values), parameter->path);
+    return parameter;
+}
+
+void ax_parameter_free(AXParameter* parameter) {
+    if (!parameter) {
+        return;
+    }
+    g_clear_object(&parameter->monitor);
+    g_clear_pointer(&parameter->values, g_hash_table_unref);
+    g_clear_pointer(&parameter->callbacks, g_hash_table_unref);
+    g_free(parameter->path);
+    g_free(parameter->appName);
+    g_free(parameter);
+}
+
+gboolean ax_parameter_get(AXParameter* parameter, const gchar* name, gchar** value, GError** error) {
+    const gchar* found = g_hash_table_lookup(parameter->values, short_name(parameter, name));
+    if (!found) {
+        g_set_error(error, AX_PARAMETER_HOST_ERROR, 0, "Parameter %s not found in %s", name, parameter->path);
+        return FALSE;
+    }
+    *value = g_strdup(found);
+    return TRUE;
+}
+
+gboolean ax_parameter_set(AXParameter* parameter,
+                          const gchar* name,
+                          const gchar* value,
+                          gboolean do_sync,
+                          GError** error) {
+    (void)do_sync;
+
+    name = short_name(parameter, name);
+    if (!g_hash_table_contains(parameter->values, name)) {
+        g_set_error(error, AX_PARAMETER_HOST_ERROR, 0, "Parameter %s not found in %s", name, parameter->path);
+        return FALSE;
+    }
+    g_hash_table_replace(parameter->values, g_strdup(name), g_strdup(value));
+    queue_change(parameter, name, value);
+    return TRUE;
+}
+
+gboolean ax_parameter_register_callback(AXParameter* parameter,
+                                        const gchar* name,
+                                        AXParameterCallback callback,
+                                        gpointer userdata,
+                                        GError** error) {
+    (void)error;
+
+    ParameterCallback* cb = g_new0(ParameterCallback, 1);
+    cb->callback          = callback;
+    cb->userdata          = userdata;
+    g_hash_table_replace(parameter->callbacks, g_strdup(short_name(parameter, name)), cb);
+    return TRUE;
+}
+
+void ax_parameter_unregister_callback(AXParameter* parameter, const gchar* name) {
+    g_hash_table_remove(parameter->callbacks, short_name(parameter, name));
+}
@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+"""Scan-to-decision latency of the host build, end to end.
+
+Replays generated frames in which a QR code appears every so often, checks
+the codes with a local pass_server.py that can be made slow and unreliable,
+and records the SuccessValue events the app sends. For every decision, the
+latency is the time from the capture of the first frame that showed the code
+to the event. Prints the p50/p95/p99 latency, the frames per second the
+stream delivered and the CPU time the app used per decision.
+
+  --duration S       Seconds to measure, after --warmup S (default 2).
+  --fps N            Frame rate of the replay (default 30).
+  --codes N          Different codes in the replayed clip (default 4).
+  --gap N, --hold N  Frames without a code, then frames showing it
+                     (default 15 each).
+  --latency-ms, --jitter-ms, --error-rate, --stall-rate
+                     Passed on to pass_server.py.
+  --https            Check over HTTPS with a throwaway certificate.
+  --local            Resolve the passes on the device (SYNC_ENDPOINT).
+  --param NAME=VALUE Override an app parameter, may be repeated.
+
+The codes repeat every codes * (gap + hold) frames. DEDUP_TTL_MS is set to
+half that, so every appearance of a code is checked again.
+
+Usage: bench_decisions.py [options]
+"""
+
+import argparse
+import os
+import re
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+WIDTH = 1280
+HEIGHT = 720
+PORT = 8089
+# One SuccessValue of each answer the server knows
+VALUES = [1, 2, 3, 4, 5]
+
+
+def write_clip(path, args):
+    """Write the replayed clip as raw NV12, a code in each segment."""
+    import cv2
+    import numpy as np
+
+    background = np.full((HEIGHT, WIDTH, 3), 96, np.uint8)
+    cv2.randn(background, 96, 12)
+    encoder = cv2.QRCodeEncoder.create()
+
+    def nv12(bgr):
+        i420 = cv2.cvtColor(bgr, cv2.COLOR_BGR2YUV_I420)
+        y, u, v = i420[:HEIGHT], i420[HEIGHT:HEIGHT * 5 // 4], i420[HEIGHT * 5 // 4:]
+        uv = np.empty((HEIGHT // 2, WIDTH), np.uint8)
+        uv[:, 0::2] = u.reshape(HEIGHT // 2, WIDTH // 2)
+        uv[:, 1::2] = v.reshape(HEIGHT // 2, WIDTH // 2)
+        return y.tobytes() + uv.tobytes()
+
+    empty = nv12(background)
+    with open(path, "wb") as clip:
+        for code in range(args.codes):
+            qr = encoder.encode(code_text(code))
+            qr = cv2.resize(qr, (240, 240), interpolation=cv2.INTER_NEAREST)
+            frame = background.copy()
+            top, left = (HEIGHT - 240) // 2, (WIDTH - 240) // 2 + (code % 3 - 1) * 320
+            frame[top:top + 240, left:left + 240] = cv2.cvtColor(qr, cv2.COLOR_GRAY2BGR)
+            shown = nv12(frame)
+            clip.write(empty * args.gap + shown * args.hold)
+
+
+def code_text(code):
+    return "BENCH-%04d" % code
+
+
+def write_params(path, args, tmp):
+    """param.conf with the defaults, pointed at the mock server."""
+    scheme = "https" if args.https else "http"
+    period = args.codes * (args.gap + args.hold)
+    params = {
+        "ENDPOINT": "%s://127.0.0.1:%d/fastPassScan.php" % (scheme, PORT),
+        "SYNC_ENDPOINT": "%s://127.0.0.1:%d/sync" % (scheme, PORT) if args.local else "",
+        "PASS_STORE_FILE": os.path.join(tmp, "passes.bin"),
+        "JOURNAL_FILE": os.path.join(tmp, "journal"),
+        "DEDUP_TTL_MS": str(int(500 * period / args.fps)),
+    }
+    for param in args.param:
+        name, _, value = param.partition("=")
+        params[name] = value
+
+    with open("param.conf", encoding="utf-8") as defaults:
+        lines = defaults.read().splitlines()
+    with open(path, "w", encoding="utf-8") as conf:
+        for line in lines:
+            name = line.split("=", 1)[0]
+            conf.write('%s="%s"\n' % (name, params.pop(name)) if name in params else line + "\n")
+        for name, value in params.items():
+            conf.write('%s="%s"\n' % (name, value))
+
+
+def cpu_seconds(pid):
+    """User and system time of a process so far."""
+    with open("/proc/%d/stat" % pid, encoding="utf-8") as stat:
+        fields = stat.read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(int(fraction * len(ordered)), len(ordered) - 1)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--duration", type=float, default=60)
+    parser.add_argument("--warmup", type=float, default=2)
+    parser.add_argument("--fps", type=int, default=30)
+    parser.add_argument("--codes", type=int, default=4)
+    parser.add_argument("--gap", type=int, default=15)
+    parser.add_argument("--hold", type=int, default=15)
+    parser.add_argument("--latency-ms", default="50")
+    parser.add_argument("--jitter-ms", default="20")
+    parser.add_argument("--error-rate", default="0")
+    parser.add_argument("--stall-rate", default="0")
+    parser.add_argument("--https", action="store_true")
+    parser.add_argument("--local", action="store_true")
+    parser.add_argument("--param", action="append", default=[])
+    args = parser.parse_args()
+    if args.fps < 1 or args.codes < 2 or args.gap < 1 or args.hold < 1:
+        sys.exit("--fps and --gap, --hold must be at least 1, --codes at least 2")
+
+    os.chdir(os.path.dirname(os.path.abspath(__file__)))
+    subprocess.run(["make", "-s", "all"], check=True)
+
+    with tempfile.TemporaryDirectory() as tmp:
+        clip = os.path.join(tmp, "clip.nv12")
+        passes = os.path.join(tmp, "passes.txt")
+        params = os.path.join(tmp, "param.conf")
+        frames = os.path.join(tmp, "frames.log")
+        events = os.path.join(tmp, "events.log")
+        log = os.path.join(tmp, "app.log")
+
+        write_clip(clip, args)
+        write_params(params, args, tmp)
+        with open(passes, "w", encoding="utf-8") as lines:
+            for code in range(args.codes):
+                lines.write("%d %s\n" % (VALUES[code % len(VALUES)], code_text(code)))
+
+        server_args = ["./pass_server.py", passes, str(PORT), "--seed", "1",
+                       "--latency-ms", args.latency_ms, "--jitter-ms", args.jitter_ms,
+                       "--error-rate", args.error_rate, "--stall-rate", args.stall_rate]
+        env = dict(os.environ,
+                   VDO_HOST_SOURCE=clip,
+                   VDO_HOST_FPS=str(args.fps),
+                   VDO_HOST_LOOP="1",
+                   VDO_HOST_RESOLUTIONS="%dx%d" % (WIDTH, HEIGHT),
+                   VDO_HOST_FRAME_LOG=frames,
+                   AXEVENT_HOST_LOG=events,
+                   AXPARAMETER_HOST_FILE=params,
+                   HOST_LOG_LEVEL="6")
+        if args.https:
+            cert, key = os.path.join(tmp, "cert.pem"), os.path.join(tmp, "key.pem")
+            subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1",
+                            "-subj", "/CN=127.0.0.1", "-addext", "subjectAltName=IP:127.0.0.1",
+                            "-keyout", key, "-out", cert], check=True, capture_output=True)
+            server_args += ["--cert", cert, "--key", key]
+            env["CURL_CA_BUNDLE"] = cert
+
+        server = subprocess.Popen(server_args, stdout=subprocess.PIPE)
+        server.stdout.readline()
+        try:
+            with open(log, "w", encoding="utf-8") as stderr:
+                app = subprocess.Popen(["./ParkspassQRScanner"], env=env, stderr=stderr)
+                time.sleep(args.warmup)
+                start, cpu_start = time.monotonic(), cpu_seconds(app.pid)
+                time.sleep(args.duration)
+                end, cpu_end = time.monotonic(), cpu_seconds(app.pid)
+                app.send_signal(signal.SIGTERM)
+                app.wait()
+        finally:
+            server.terminate()
+            server.wait()
+
+        report(args, frames, events, log, start, end, cpu_end - cpu_start)
+
+
+def report(args, frames_path, events_path, log_path, start, end, cpu):
+    # <monotonic us> <sequence> delivered|dropped
+    frames = {}
+    with open(frames_path, encoding="utf-8") as lines:
+        for line in lines:
+            us, sequence, state = line.split()
+            frames[int(sequence)] = (int(us) / 1e6, state == "delivered")
+
+    # The events do not say which frame they are for, the log line written
+    # right after each does
+    sent = []
+    with open(events_path, encoding="utf-8") as lines:
+        for line in lines:
+            value = re.search(r"SuccessValue=(\d+)", line)
+            sent.append((int(line.split()[0]) / 1e6, int(value.group(1)) if value else 0))
+    decided = []
+    with open(log_path, encoding="utf-8") as lines:
+        for line in lines:
+            match = re.search(r"Decision for frame (\d+) sent", line)
+            if match:
+                decided.append(int(match.group(1)))
+    if len(sent) != len(decided):
+        print("warning: %d events but %d decisions logged" % (len(sent), len(decided)))
+
+    # The code of a frame and the first frame of its appearance follow from
+    # the layout of the clip
+    segment = args.gap + args.hold
+    period = args.codes * segment
+    latencies = []
+    values = {}
+    for (sent_at, value), sequence in zip(sent, decided):
+        offset = sequence % period % segment
+        first = sequence - (offset - args.gap)
+        if offset < args.gap or first not in frames:
+            continue
+        shown_at = frames[first][0]
+        if start <= shown_at < end:
+            latencies.append((sent_at - shown_at) * 1000)
+            values[value] = values.get(value, 0) + 1
+
+    window = [delivered for at, delivered in frames.values() if start <= at < end]
+    appearances = sum(1 for sequence, (at, _) in frames.items()
+                      if start <= at < end and sequence % period % segment == args.gap)
+    seconds = end - start
+
+    print("decisions        %d of %d appearances  %s" % (
+        len(latencies), appearances,
+        " ".join("value %d: %d" % item for item in sorted(values.items()))))
+    if latencies:
+        print("latency ms       p50 %.1f  p95 %.1f  p99 %.1f  max %.1f" % (
+            percentile(latencies, 0.50), percentile(latencies, 0.95),
+            percentile(latencies, 0.99), max(latencies)))
+    print("frames/s         %.1f delivered  %.1f dropped" % (
+        sum(window) / seconds, (len(window) - sum(window)) / seconds))
+    print("CPU              %.1f%% of a core  %.1f ms per decision" % (
+        100 * cpu / seconds, 1000 * cpu / len(latencies) if latencies else 0))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Decode throughput of the host build with 1 to N decode workers.
+#
+# usage: ./bench_workers.sh SOURCE [MAX_THREADS]
+#
+# Replays SOURCE as fast as the app takes frames, once per worker count,
+# and prints the frames the workers decoded per second over the first
+# statistics interval (60 s). The scene gate is turned off so that every
+# frame is decoded. Every decoded pass is checked with the server, so SOURCE
+# should show the scene without passes: that is the worst case, where every
+# frame goes through the whole decode cascade.
+
+set -e
+
+SOURCE=$1
+MAX_THREADS=${2:-$(nproc)}
+DURATION=65
+INTERVAL=60
+
+if [ -z "$SOURCE" ]; then
+    echo "usage: $0 SOURCE [MAX_THREADS]" >&2
+    exit 1
+fi
+
+cd "$(dirname "$0")"
+make -s all
+
+PARAMS=$(mktemp)
+LOG=$(mktemp)
+trap 'rm -f "$PARAMS" "$LOG"' EXIT
+
+echo "threads frames/s superseded/s"
+threads=1
+while [ "$threads" -le "$MAX_THREADS" ]; do
+    sed -e "s/^WORKER_THREADS=.*/WORKER_THREADS=\"$threads\"/" \
+        -e 's/^SCENE_THRESHOLD=.*/SCENE_THRESHOLD="0"/' param.conf > "$PARAMS"
+
+    AXPARAMETER_HOST_FILE=$PARAMS VDO_HOST_SOURCE=$SOURCE VDO_HOST_FPS=0 HOST_LOG_LEVEL=6 \
+        timeout "$DURATION" ./ParkspassQRScanner 2> "$LOG" || true
+
+    # Workers last 60s: frames submitted N, superseded N, decoded N
+    grep -m 1 "Workers last" "$LOG" |
+        sed -e 's/.*superseded \([0-9]*\), decoded \([0-9]*\).*/\2 \1/' |
+        awk -v t="$threads" -v s="$INTERVAL" '{ printf "%7d %8.1f %12.1f\n", t, $1 / s, $2 / s }'
+
+    threads=$((threads + 1))
+done
@@ -0,0 +1,241 @@
+/**
+ * Replay of NV12 frames for the host VDO stand-in.
+ */
+
+#include "frame_source.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <filesystem>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <syslog.h>
+#include <vector>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace fs = std::filesystem;
+
+static GQuark frameSourceErrorQuark(void) {
+    return g_quark_from_static_string("host-frame-source-error-quark");
+}
+
+enum class SourceKind { Images, RawFile, Decoder };
+
+struct HostFrameSource {
+    SourceKind kind;
+    std::string path;
+    guint width;
+    guint height;
+    bool loop;
+
+    /// Pre-converted, tightly packed NV12 frames for image sources.
+    std::vector<std::vector<guint8>> images;
+    size_t nextImage;
+
+    /// Raw NV12 file or the stdout of the ffmpeg decoder.
+    FILE* file;
+    std::vector<guint8> scratch;
+
+    size_t frameSize() const { return (size_t)width * height * 3 / 2; }
+};
+
+/// Convert an image to tightly packed NV12 at the source resolution.
+static bool imageToNv12(const cv::Mat& image, guint width, guint height, std::vector<guint8>& nv12) {
+    cv::Mat bgr, i420;
+    cv::resize(image, bgr, cv::Size((int)width, (int)height), 0, 0, cv::INTER_AREA);
+    cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+
+    const size_t lumaSize   = (size_t)width * height;
+    const size_t chromaSize = lumaSize / 4;
+    const guint8* y         = i420.ptr<guint8>();
+    const guint8* u         = y + lumaSize;
+    const guint8* v         = u + chromaSize;
+
+    nv12.resize(lumaSize * 3 / 2);
+    memcpy(nv12.data(), y, lumaSize);
+    guint8* uv = nv12.data() + lumaSize;
+    for (size_t i = 0; i < chromaSize; i++) {
+        uv[2 * i]     = u[i];
+        uv[2 * i + 1] = v[i];
+    }
+    return true;
+}
+
+static bool loadImages(HostFrameSource* source, GError** error) {
+    std::vector<fs::path> files;
+    if (fs::is_directory(source->path)) {
+        for (const auto& entry : fs::directory_iterator(source->path)) {
+            if (entry.is_regular_file() && cv::haveImageReader(entry.path().string())) {
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+    } else {
+        files.push_back(source->path);
+    }
+
+    for (const auto& file : files) {
+        cv::Mat image = cv::imread(file.string(), cv::IMREAD_COLOR);
+        if (image.empty()) {
+            syslog(LOG_WARNING, "%s: Skipping unreadable image %s", __func__, file.c_str());
+            continue;
+        }
+        source->images.emplace_back();
+        imageToNv12(image, source->width, source->height, source->images.back());
+    }
+
+    if (source->images.empty()) {
+        g_set_error(error, frameSourceErrorQuark(), 0, "No readable images in %s", source->path.c_str());
+        return false;
+    }
+    syslog(LOG_INFO, "%s: Loaded %zu images from %s", __func__, source->images.size(), source->path.c_str());
+    return true;
+}
+
+static bool openStream(HostFrameSource* source, GError** error) {
+    if (source->kind == SourceKind::RawFile) {
+        source->file = fopen(source->path.c_str(), "rb");
+    } else {
+        g_autofree gchar* quoted  = g_shell_quote(source->path.c_str());
+        g_autofree gchar* command = g_strdup_printf(
+            "ffmpeg -nostdin -v error -i %s -f rawvideo -pix_fmt nv12 -s %ux%u -",
+            quoted,
+            source->width,
+            source->height);
+        source->file = popen(command, "r");
+    }
+
+    if (!source->file) {
+        g_set_error(error,
+                    frameSourceErrorQuark(),
+                    0,
+                    "Unable to open %s: %s",
+                    source->path.c_str(),
+                    strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static void closeStream(HostFrameSource* source) {
+    if (!source->file) {
+        return;
+    }
+    if (source->kind == SourceKind::RawFile) {
+        fclose(source->file);
+    } else {
+        pclose(source->file);
+    }
+    source->file = NULL;
+}
+
+/// Read one packed frame from the stream into scratch, restarting if looping.
+static bool readStreamFrame(HostFrameSource* source, GError** error) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (fread(source->scratch.data(), 1, source->scratch.size(), source->file) ==
+            source->scratch.size()) {
+            return true;
+        }
+        if (!source->loop) {
+            break;
+        }
+        closeStream(source);
+        if (!openStream(source, error)) {
+            return false;
+        }
+    }
+    g_set_error(error, frameSourceErrorQuark(), 0, "End of %s", source->path.c_str());
+    return false;
+}
+
+HostFrameSource* host_frame_source_open(const gchar* path,
+                                        guint width,
+                                        guint height,
+                                        gboolean loop,
+                                        GError** error) {
+    if ((width & 1) || (height & 1)) {
+        g_set_error(error, frameSourceErrorQuark(), 0, "NV12 needs even dimensions, got %ux%u", width, height);
+        return NULL;
+    }
+
+    HostFrameSource* source = new HostFrameSource();
+    source->path            = path;
+    source->width           = width;
+    source->height          = height;
+    source->loop            = loop;
+    source->nextImage       = 0;
+    source->file            = NULL;
+
+    std::string extension = fs::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    bool ok;
+    if (fs::is_directory(path) || cv::haveImageReader(path)) {
+        source->kind = SourceKind::Images;
+        ok           = loadImages(source, error);
+    } else {
+        source->kind = (extension == ".nv12" || extension == ".yuv") ? SourceKind::RawFile
+                                                                     : SourceKind::Decoder;
+        source->scratch.resize(source->frameSize());
+        ok = openStream(source, error);
+    }
+
+    if (!ok) {
+        host_frame_source_close(source);
+        return NULL;
+    }
+    return source;
+}
+
+gboolean host_frame_source_read(HostFrameSource* source, guint8* dst, guint pitch, GError** error) {
+    const guint8* src;
+    if (source->kind == SourceKind::Images) {
+        if (source->nextImage >= source->images.size()) {
+            if (!source->loop) {
+                g_set_error(error, frameSourceErrorQuark(), 0, "End of %s", source->path.c_str());
+                return FALSE;
+            }
+            source->nextImage = 0;
+        }
+        src = source->images[source->nextImage++].data();
+    } else {
+        if (!readStreamFrame(source, error)) {
+            return FALSE;
+        }
+        src = source->scratch.data();
+    }
+
+    // Luma rows followed by interleaved chroma rows, both at the given pitch.
+    for (guint row = 0; row < source->height * 3 / 2; row++) {
+        memcpy(dst + (size_t)row * pitch, src + (size_t)row * source->width, source->width);
+    }
+    return TRUE;
+}
+
+gboolean host_frame_source_skip(HostFrameSource* source, guint count, GError** error) {
+    if (source->kind == SourceKind::Images) {
+        source->nextImage += count;
+        if (source->loop) {
+            source->nextImage %= source->images.size();
+        }
+        return TRUE;
+    }
+
+    for (guint i = 0; i < count; i++) {
+        if (!readStreamFrame(source, error)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void host_frame_source_close(HostFrameSource* source) {
+    if (!source) {
+        return;
+    }
+    closeStream(source);
+    delete source;
+}
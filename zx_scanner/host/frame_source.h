@@ -0,0 +1,53 @@
+/**
+ * Replay of NV12 frames for the host VDO stand-in.
+ *
+ * A source is one of:
+ * - a raw NV12 file (*.nv12, *.yuv) holding tightly packed frames of the
+ *   stream resolution,
+ * - a directory of images, or a single image, decoded with OpenCV, scaled
+ *   to the stream resolution and converted to NV12 up front,
+ * - any other file, decoded to NV12 at the stream resolution by an
+ *   ffmpeg child process.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct HostFrameSource HostFrameSource;
+
+/**
+ * brief Open a frame source.
+ *
+ * param path File or directory to replay.
+ * param width Output frame width.
+ * param height Output frame height.
+ * param loop Restart from the first frame once the source is exhausted.
+ * param error Set if the source could not be opened.
+ * return Pointer to new source, or NULL if failed.
+ */
+HostFrameSource* host_frame_source_open(const gchar* path,
+                                        guint width,
+                                        guint height,
+                                        gboolean loop,
+                                        GError** error);
+
+/**
+ * brief Write the next frame as NV12 with the given pitch.
+ *
+ * param dst Destination with room for pitch * height * 3 / 2 bytes.
+ * param pitch Destination row pitch in bytes, at least width.
+ * return False at end of a non-looping source or on read errors.
+ */
+gboolean host_frame_source_read(HostFrameSource* source, guint8* dst, guint pitch, GError** error);
+
+/**
+ * brief Advance past frames without delivering them.
+ */
+gboolean host_frame_source_skip(HostFrameSource* source, guint count, GError** error);
+
+void host_frame_source_close(HostFrameSource* source);
+
+G_END_DECLS
@@ -0,0 +1,73 @@
+/**
+ * Host stand-in for the AXEvent API.
+ *
+ * Declarations complete asynchronously on the default main context. Every
+ * sent event is recorded as one line in the file named by AXEVENT_HOST_LOG,
+ * or on stderr if it is unset, together with the g_get_monotonic_time()
+ * at which it was sent.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    AX_VALUE_TYPE_INT,
+    AX_VALUE_TYPE_BOOL,
+    AX_VALUE_TYPE_DOUBLE,
+    AX_VALUE_TYPE_STRING,
+    AX_VALUE_TYPE_ELEMENT,
+} AXEventValueType;
+
+typedef struct _AXEventHandler AXEventHandler;
+typedef struct _AXEventKeyValueSet AXEventKeyValueSet;
+typedef struct _AXEvent AXEvent;
+
+typedef void (*AXDeclarationCompleteCallback)(guint declaration, gpointer user_data);
+
+AXEventKeyValueSet* ax_event_key_value_set_new(void);
+void ax_event_key_value_set_free(AXEventKeyValueSet* key_value_set);
+
+gboolean ax_event_key_value_set_add_key_value(AXEventKeyValueSet* key_value_set,
+                                              const gchar* key,
+                                              const gchar* name_space,
+                                              gconstpointer value,
+                                              AXEventValueType value_type,
+                                              GError** error);
+gboolean ax_event_key_value_set_mark_as_source(AXEventKeyValueSet* key_value_set,
+                                               const gchar* key,
+                                               const gchar* name_space,
+                                               GError** error);
+gboolean ax_event_key_value_set_mark_as_data(AXEventKeyValueSet* key_value_set,
+                                             const gchar* key,
+                                             const gchar* name_space,
+                                             GError** error);
+gboolean ax_event_key_value_set_mark_as_user_defined(AXEventKeyValueSet* key_value_set,
+                                                     const gchar* key,
+                                                     const gchar* name_space,
+                                                     const gchar* user_tag,
+                                                     GError** error);
+
+AXEvent* ax_event_new2(AXEventKeyValueSet* key_value_set, GDateTime* date_time);
+void ax_event_free(AXEvent* event);
+
+AXEventHandler* ax_event_handler_new(void);
+void ax_event_handler_free(AXEventHandler* event_handler);
+
+gboolean ax_event_handler_declare(AXEventHandler* event_handler,
+                                  AXEventKeyValueSet* key_value_set,
+                                  gboolean stateless,
+                                  guint* declaration,
+                                  AXDeclarationCompleteCallback callback,
+                                  gpointer user_data,
+                                  GError** error);
+gboolean ax_event_handler_undeclare(AXEventHandler* event_handler, guint declaration, GError** error);
+gboolean ax_event_handler_send_event(AXEventHandler* event_handler,
+                                     guint declaration,
+                                     AXEvent* event,
+                                     GError** error);
+
+G_END_DECLS
@@ -0,0 +1,37 @@
+/**
+ * Host stand-in for the AXParameter API.
+ *
+ * Parameters are served from a param.conf style file with one NAME="value"
+ * entry per line. The file is taken from AXPARAMETER_HOST_FILE and defaults
+ * to ./param.conf. Values set through ax_parameter_set() are kept in memory
+ * and reported to registered callbacks, as on the device.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _AXParameter AXParameter;
+
+typedef void (*AXParameterCallback)(const gchar* name, const gchar* value, gpointer user_data);
+
+AXParameter* ax_parameter_new(const gchar* app_name, GError** error);
+void ax_parameter_free(AXParameter* parameter);
+
+gboolean ax_parameter_get(AXParameter* parameter, const gchar* name, gchar** value, GError** error);
+gboolean ax_parameter_set(AXParameter* parameter,
+                          const gchar* name,
+                          const gchar* value,
+                          gboolean do_sync,
+                          GError** error);
+
+gboolean ax_parameter_register_callback(AXParameter* parameter,
+                                        const gchar* name,
+                                        AXParameterCallback callback,
+                                        gpointer userdata,
+                                        GError** error);
+void ax_parameter_unregister_callback(AXParameter* parameter, const gchar* name);
+
+G_END_DECLS
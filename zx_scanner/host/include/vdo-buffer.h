@@ -0,0 +1,29 @@
+/**
+ * Host stand-in for VDO buffers and frames.
+ *
+ * As in VDO, a VdoFrame is the frame view of a VdoBuffer and the two
+ * pointers are interchangeable.
+ */
+
+#pragma once
+
+#include "vdo-types.h"
+
+G_BEGIN_DECLS
+
+#define VDO_TYPE_BUFFER (vdo_buffer_get_type())
+G_DECLARE_FINAL_TYPE(VdoBuffer, vdo_buffer, VDO, BUFFER, GObject)
+
+typedef VdoBuffer VdoFrame;
+
+gpointer vdo_buffer_get_data(VdoBuffer* buffer);
+gsize vdo_buffer_get_capacity(VdoBuffer* buffer);
+gpointer vdo_buffer_get_opaque(VdoBuffer* buffer);
+VdoFrame* vdo_buffer_get_frame(VdoBuffer* buffer);
+
+guint vdo_frame_get_sequence_nbr(VdoFrame* frame);
+/// Capture time in microseconds on the g_get_monotonic_time() clock.
+guint64 vdo_frame_get_timestamp(VdoFrame* frame);
+gsize vdo_frame_get_size(VdoFrame* frame);
+
+G_END_DECLS
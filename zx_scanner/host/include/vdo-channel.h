@@ -0,0 +1,23 @@
+/**
+ * Host stand-in for VDO channels.
+ *
+ * The reported resolutions come from VDO_HOST_RESOLUTIONS, a comma separated
+ * list such as "640x360,1280x720,1920x1080".
+ */
+
+#pragma once
+
+#include "vdo-map.h"
+#include "vdo-types.h"
+
+G_BEGIN_DECLS
+
+#define VDO_TYPE_CHANNEL (vdo_channel_get_type())
+G_DECLARE_FINAL_TYPE(VdoChannel, vdo_channel, VDO, CHANNEL, GObject)
+
+VdoChannel* vdo_channel_get(guint nbr, GError** error);
+
+/// Free the returned set with g_free().
+VdoResolutionSet* vdo_channel_get_resolutions(VdoChannel* self, VdoMap* filter, GError** error);
+
+G_END_DECLS
@@ -0,0 +1,27 @@
+/**
+ * Host stand-in for the VDO settings map.
+ */
+
+#pragma once
+
+#include "vdo-types.h"
+
+G_BEGIN_DECLS
+
+#define VDO_TYPE_MAP (vdo_map_get_type())
+G_DECLARE_FINAL_TYPE(VdoMap, vdo_map, VDO, MAP, GObject)
+
+VdoMap* vdo_map_new(void);
+
+gboolean vdo_map_contains(const VdoMap* self, const gchar* name);
+
+void vdo_map_set_uint32(VdoMap* self, const gchar* name, guint32 value);
+guint32 vdo_map_get_uint32(const VdoMap* self, const gchar* name, guint32 def);
+
+void vdo_map_set_string(VdoMap* self, const gchar* name, const gchar* value);
+const gchar* vdo_map_get_string(const VdoMap* self, const gchar* name, gsize* size, const gchar* def);
+
+/// Write all entries to syslog, one per line.
+void vdo_map_dump(const VdoMap* self);
+
+G_END_DECLS
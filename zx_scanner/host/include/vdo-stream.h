@@ -0,0 +1,37 @@
+/**
+ * Host stand-in for VDO streams.
+ *
+ * Frames are replayed from the source named by the VDO_HOST_SOURCE
+ * environment variable, see zx_scanner/README.md for the supported sources
+ * and the remaining VDO_HOST_* settings.
+ */
+
+#pragma once
+
+#include "vdo-buffer.h"
+#include "vdo-map.h"
+#include "vdo-types.h"
+
+G_BEGIN_DECLS
+
+#define VDO_TYPE_STREAM (vdo_stream_get_type())
+G_DECLARE_FINAL_TYPE(VdoStream, vdo_stream, VDO, STREAM, GObject)
+
+typedef void (*VdoBufferFinalizer)(VdoBuffer* buffer);
+
+VdoStream* vdo_stream_new(VdoMap* settings, VdoBufferFinalizer fin, GError** error);
+
+/// Returns a map holding at least "width", "height", "pitch" and "framerate".
+VdoMap* vdo_stream_get_info(VdoStream* self, GError** error);
+
+gboolean vdo_stream_start(VdoStream* self, GError** error);
+void vdo_stream_stop(VdoStream* self);
+
+VdoBuffer* vdo_stream_buffer_alloc(VdoStream* self, gpointer opaque, GError** error);
+gboolean vdo_stream_buffer_enqueue(VdoStream* self, VdoBuffer* buffer, GError** error);
+gboolean vdo_stream_buffer_unref(VdoStream* self, VdoBuffer** buffer, GError** error);
+
+/// Blocks until the next frame is due, returns a new reference to it.
+VdoBuffer* vdo_stream_get_buffer(VdoStream* self, GError** error);
+
+G_END_DECLS
@@ -0,0 +1,48 @@
+/**
+ * Host stand-in for the VDO type definitions.
+ *
+ * Only the subset of the VDO API used by the Parkspass QR Scanner is
+ * provided. Values match the ones in the ACAP Native SDK so that settings
+ * maps built by the application are interpreted the same way.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+    VDO_FORMAT_NONE = -1,
+    VDO_FORMAT_H264 = 0,
+    VDO_FORMAT_H265,
+    VDO_FORMAT_JPEG,
+    VDO_FORMAT_YUV,
+    VDO_FORMAT_BAYER,
+    VDO_FORMAT_IVS,
+    VDO_FORMAT_RAW,
+    VDO_FORMAT_RGBA,
+    VDO_FORMAT_RGB,
+    VDO_FORMAT_PLANAR_RGB,
+} VdoFormat;
+
+typedef enum {
+    VDO_BUFFER_STRATEGY_NONE = 0,
+    VDO_BUFFER_STRATEGY_INPUT,
+    VDO_BUFFER_STRATEGY_EXTERNAL,
+    VDO_BUFFER_STRATEGY_EXPLICIT,
+    VDO_BUFFER_STRATEGY_INFINITE,
+} VdoBufferStrategy;
+
+typedef struct {
+    guint32 width;
+    guint32 height;
+} VdoResolution;
+
+typedef struct {
+    gsize count;
+    VdoResolution resolutions[];
+} VdoResolutionSet;
+
+G_END_DECLS
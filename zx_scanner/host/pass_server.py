@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Local stand-in for the pass validation server.
+
+Serves passes from a file of "<SuccessValue> <code>" lines, re-read on every
+request, so lines appended while it runs are picked up like new passes.
+
+  GET /sync?park_abbr=..&entrance=..&since=N
+      The sync endpoint of passstore.h. The cursor is the number of lines
+      already sent; without one, or if the file shrank, the whole file is
+      sent as a full list.
+  GET /fastPassScan.php?park_abbr=..&entrance=..&scandata=..
+      A check, answered with the message for the pass's SuccessValue, or
+      "pass not found".
+
+Checks can be slowed down and made to fail, to see how the app copes with a
+poor network or a loaded server:
+
+  --latency-ms N     Answer checks after N ms.
+  --jitter-ms N      Add a random -N to +N ms to the latency.
+  --error-rate F     Answer this fraction of checks with 503.
+  --stall-rate F     Hold this fraction of checks for --stall-ms (default
+                     30000) before answering, longer than the app waits.
+  --cert/--key FILE  Serve HTTPS with this certificate and key.
+  --seed N           Seed of the random draws, for repeatable runs.
+
+Usage: pass_server.py [options] PASSES_FILE [PORT]
+"""
+
+import argparse
+import http.server
+import json
+import random
+import ssl
+import threading
+import time
+import urllib.parse
+
+MESSAGES = {
+    1: "pass found",
+    2: "pass not found",
+    3: "invalid format",
+    4: "checkin failed",
+    5: "pass expired",
+}
+
+
+def read_passes(path):
+    with open(path, encoding="utf-8") as passes:
+        return [line.rstrip("\n") for line in passes if line.strip()]
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    disable_nagle_algorithm = True
+
+    def do_GET(self):
+        url = urllib.parse.urlsplit(self.path)
+        query = urllib.parse.parse_qs(url.query)
+        lines = read_passes(self.server.passes)
+
+        if url.path.endswith("/sync"):
+            since = query.get("since", [""])[0]
+            start = int(since) if since.isdigit() and int(since) <= len(lines) else None
+            body = ["full"] + lines if start is None else lines[start:]
+            self.answer("text/plain", "\n".join(body + ["cursor %d" % len(lines)]) + "\n")
+            return
+
+        delay_ms, status = self.server.draw()
+        time.sleep(delay_ms / 1000)
+        if status != 200:
+            self.answer("text/plain", "unavailable\n", status)
+            return
+
+        code = query.get("scandata", [""])[0]
+        values = {line.split(" ", 1)[1]: int(line.split(" ", 1)[0]) for line in lines if " " in line}
+        message = MESSAGES.get(values.get(code, 2), "unknown")
+        result = "success" if message == "pass found" else "failure"
+        self.answer("application/json", json.dumps({"result": result, "message": message}))
+
+    def answer(self, content_type, text, status=200):
+        body = text.encode()
+        self.send_response(status)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class Server(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+
+    def __init__(self, args):
+        super().__init__(("127.0.0.1", args.port), Handler)
+        self.passes = args.passes
+        self.args = args
+        self.random = random.Random(args.seed)
+        self.lock = threading.Lock()
+
+    def draw(self):
+        """Delay in ms and status of the next check."""
+        args = self.args
+        with self.lock:
+            roll = self.random.random()
+            jitter = self.random.uniform(-args.jitter_ms, args.jitter_ms)
+        if roll < args.stall_rate:
+            return args.stall_ms, 200
+        status = 503 if roll < args.stall_rate + args.error_rate else 200
+        return max(args.latency_ms + jitter, 0), status
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("passes")
+    parser.add_argument("port", nargs="?", type=int, default=8080)
+    parser.add_argument("--latency-ms", type=float, default=0)
+    parser.add_argument("--jitter-ms", type=float, default=0)
+    parser.add_argument("--error-rate", type=float, default=0)
+    parser.add_argument("--stall-rate", type=float, default=0)
+    parser.add_argument("--stall-ms", type=float, default=30000)
+    parser.add_argument("--cert")
+    parser.add_argument("--key")
+    parser.add_argument("--seed", type=int)
+    args = parser.parse_args()
+
+    server = Server(args)
+    scheme = "http"
+    if args.cert:
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(args.cert, args.key)
+        server.socket = context.wrap_socket(server.socket, server_side=True)
+        scheme = "https"
+    print("Serving %s on %s://127.0.0.1:%d" % (args.passes, scheme, args.port), flush=True)
+    server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
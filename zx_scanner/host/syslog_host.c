@@ -0,0 +1,57 @@
+/**
+ * Host replacement for syslog.
+ *
+ * The applications log everything through syslog(3). On a development
+ * machine that ends up in the system journal, interleaved with everything
+ * else, so the host build routes it to stderr instead, prefixed with the
+ * monotonic time in seconds. Messages above HOST_LOG_LEVEL (a syslog
+ * priority, default LOG_DEBUG) are dropped.
+ */
+
+#include <glib.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <unistd.h>
+
+static const char* logIdent = "";
+static int maxPriority      = -1;
+
+void openlog(const char* ident, int option, int facility) {
+    (void)option;
+    (void)facility;
+    logIdent = ident ? ident : "";
+}
+
+void closelog(void) {}
+
+void vsyslog(int priority, const char* format, va_list ap) {
+    static const char* const names[] = {
+        "emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"};
+
+    if (maxPriority < 0) {
+        const char* level = getenv("HOST_LOG_LEVEL");
+        maxPriority       = (level && *level) ? atoi(level) : LOG_DEBUG;
+    }
+    if (LOG_PRI(priority) > maxPriority) {
+        return;
+    }
+
+    g_autofree gchar* message = g_strdup_vprintf(format, ap);
+    g_strchomp(message);
+    fprintf(stderr,
+            "[%12.6f] %s[%d] %s: %s\n",
+            g_get_monotonic_time() / 1e6,
+            logIdent,
+            (int)getpid(),
+            names[LOG_PRI(priority)],
+            message);
+}
+
+void syslog(int priority, const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    vsyslog(priority, format, ap);
+    va_end(ap);
+}
@@ -0,0 +1,268 @@
+/**
+ * Host checks of the image enhancement pipeline, built and run by make test.
+ *
+ * The fused pass is compared to the separate median, unsharp, threshold and
+ * close stages it stands in for, both run through Pipeline as the app runs
+ * them. The images are random, smooth and text-like, from 1x1 up to
+ * 1280x720 with odd sizes in between, and are generated the same on every
+ * host. On x86 this checks the scalar version of the fused kernel, on an
+ * ARM host the NEON one.
+ *
+ * When the allocation counter is linked in, which it is unless the test is
+ * built with SANITIZE, the stage sets that are meant to run without heap
+ * allocations are checked to make none once their buffers are set up. The
+ * fused kernel is also run at alternating widths, as the upscale stage does
+ * with several scales.
+ *
+ * Prints every failed check and exits with 1 if there was any.
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "fusedkernel.h"
+#include "pipeline.h"
+
+// Share of the pixels of an image the fused pass may get different from the
+// separate stages, see fusedkernel.h. Images below 1 / MAX_DIFFER_FRACTION
+// pixels must match exactly.
+#define MAX_DIFFER_FRACTION 1.5e-5
+
+typedef struct {
+    int width;
+    int height;
+    int blockSize;
+    int c;
+} Case_t;
+
+// Frames run through each stage set in the allocation check
+#define ALLOCATION_FRAMES 10
+
+static const Case_t cases[] = {
+    {1, 1, 25, 2},
+    {1, 7, 25, 2},
+    {7, 1, 25, 2},
+    {2, 3, 3, 2},
+    {5, 3, 25, 2},
+    {37, 29, 25, 2},
+    {100, 80, 7, 5},
+    {300, 200, 51, -3},
+    {641, 361, 25, 2},
+    {640, 360, 25, 0},
+    {1280, 720, 25, 2},
+};
+
+// Stage sets that must not touch the heap once their buffers are set up.
+// The other stages are exempt, the OpenCV functions they call allocate on
+// every call: clahe (its parallel loop), upscale by other factors than 1
+// (cv::resize), and median, unsharp, threshold and close on their own (the
+// filter engines behind cv::medianBlur(), cv::GaussianBlur(), cv::dilate()
+// and cv::erode()).
+typedef struct {
+    const char* stages;
+    int upscaleFactor;
+} AllocationCase_t;
+
+static const AllocationCase_t allocationCases[] = {
+    {"fused", 2},
+    {"upscale,fused", 1},
+    {"upscale,median,unsharp,threshold,close", 1},
+};
+
+enum { IMAGE_RANDOM, IMAGE_SMOOTH, IMAGE_TEXT, IMAGE_KINDS };
+static const char* const imageNames[IMAGE_KINDS] = {"random", "smooth", "text"};
+
+// xorshift32, so that the images do not depend on the C library
+static uint32_t next_random(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void make_image(cv::Mat& image, int kind, uint32_t seed) {
+    const int width  = image.cols;
+    const int height = image.rows;
+    uint32_t state   = seed;
+
+    if (kind == IMAGE_RANDOM) {
+        for (int y = 0; y < height; y++) {
+            uchar* row = image.ptr<uchar>(y);
+            for (int x = 0; x < width; x++) {
+                row[x] = (uchar)(next_random(&state) >> 24);
+            }
+        }
+    } else if (kind == IMAGE_SMOOTH) {
+        // Bilinear between random values 16 pixels apart
+        const int gridWidth  = width / 16 + 2;
+        const int gridHeight = height / 16 + 2;
+        std::vector<int> grid((size_t)gridWidth * gridHeight);
+        for (int& value : grid) {
+            value = (int)(next_random(&state) >> 24);
+        }
+        for (int y = 0; y < height; y++) {
+            const int* g0 = &grid[(size_t)(y / 16) * gridWidth];
+            const int* g1 = g0 + gridWidth;
+            const int fy  = y % 16;
+            uchar* row    = image.ptr<uchar>(y);
+            for (int x = 0; x < width; x++) {
+                const int gx = x / 16;
+                const int fx = x % 16;
+                row[x]       = (uchar)((g0[gx] * (16 - fx) * (16 - fy) + g0[gx + 1] * fx * (16 - fy) +
+                                  g1[gx] * (16 - fx) * fy + g1[gx + 1] * fx * fy + 128) >>
+                                 8);
+            }
+        }
+    } else {
+        // Soft dark on light text with some noise, like a printed label
+        cv::Mat text = cv::Mat::zeros(image.size(), CV_8UC1);
+        cv::putText(text,
+                    "QR 123",
+                    cv::Point(0, height / 2),
+                    cv::FONT_HERSHEY_SIMPLEX,
+                    std::max(width / 200.0, 0.3),
+                    cv::Scalar(255),
+                    2);
+        cv::GaussianBlur(text, text, cv::Size(3, 3), 0);
+        for (int y = 0; y < height; y++) {
+            const uchar* t = text.ptr<uchar>(y);
+            uchar* row     = image.ptr<uchar>(y);
+            for (int x = 0; x < width; x++) {
+                int value = t[x] * 7 / 10 + 34 + (int)((next_random(&state) >> 24) % 13);
+                row[x]    = (uchar)std::min(value, 255);
+            }
+        }
+    }
+}
+
+// Fused pass against the separate stages
+static bool check_fused(void) {
+    Pipeline separate;
+    Pipeline fused;
+    uint64_t differ = 0;
+    uint64_t total  = 0;
+    bool passed     = true;
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const Case_t& test = cases[i];
+
+        PipelineConfig_t config;
+        config.stages             = "median,unsharp,threshold,close";
+        config.thresholdBlockSize = test.blockSize;
+        config.thresholdC         = test.c;
+        config.fusedKernel        = false;
+        separate.configure(config);
+        config.fusedKernel = true;
+        fused.configure(config);
+
+        for (int kind = 0; kind < IMAGE_KINDS; kind++) {
+            cv::Mat image(test.height, test.width, CV_8UC1);
+            make_image(image, kind, (uint32_t)(i * IMAGE_KINDS + kind + 1) * 0x9e3779b9u);
+
+            cv::Mat expected = separate.run(image);
+            cv::Mat actual   = fused.run(image);
+            if (fused.stageCount() != 1 || fused.stagesThrough("fused") != 1) {
+                printf("FAILED: %s %dx%d: the fused pass was not used\n",
+                       imageNames[kind],
+                       test.width,
+                       test.height);
+                passed = false;
+                continue;
+            }
+
+            int count = 0;
+            for (int y = 0; y < image.rows; y++) {
+                const uchar* e = expected.ptr<uchar>(y);
+                const uchar* a = actual.ptr<uchar>(y);
+                for (int x = 0; x < image.cols; x++) {
+                    count += e[x] != a[x];
+                }
+            }
+            differ += count;
+            total += image.total();
+            if (count > image.total() * MAX_DIFFER_FRACTION) {
+                printf("FAILED: %s %dx%d block size %d C %d: %d of %zu pixels differ\n",
+                       imageNames[kind],
+                       test.width,
+                       test.height,
+                       test.blockSize,
+                       test.c,
+                       count,
+                       image.total());
+                passed = false;
+            }
+        }
+    }
+
+    printf("Fused pass: %llu of %llu pixels differ from the separate stages\n",
+           (unsigned long long)differ,
+           (unsigned long long)total);
+    return passed;
+}
+
+// Heap allocations in steady state
+static bool check_allocations(void) {
+    bool passed = true;
+
+    if (!allocCounterRead) {
+        printf("Allocation checks skipped, no allocation counter linked\n");
+        return true;
+    }
+
+    cv::Mat image(360, 640, CV_8UC1);
+    make_image(image, IMAGE_RANDOM, 1);
+    for (const AllocationCase_t& test : allocationCases) {
+        PipelineConfig_t config;
+        config.stages        = test.stages;
+        config.upscaleFactor = test.upscaleFactor;
+        Pipeline pipeline;
+        pipeline.configure(config);
+        for (int i = 0; i < ALLOCATION_FRAMES; i++) {
+            pipeline.run(image);
+        }
+        if (pipeline.steadyStateAllocations() != 0) {
+            printf("FAILED: stages %s upscale factor %d: %llu heap allocations in %d frames\n",
+                   test.stages,
+                   test.upscaleFactor,
+                   (unsigned long long)pipeline.steadyStateAllocations(),
+                   ALLOCATION_FRAMES);
+            passed = false;
+        }
+    }
+
+    // The pipeline sets the kernel up for every scale, widest or not
+    static const int widths[] = {640, 1280, 320};
+    static const int order[]  = {640, 1280, 320, 1280, 640};
+    cv::Mat wide(90, 1280, CV_8UC1);
+    cv::Mat output(90, 1280, CV_8UC1);
+    make_image(wide, IMAGE_RANDOM, 2);
+    FusedKernel kernel(25, 2);
+    for (int width : widths) {
+        kernel.allocate(width);
+    }
+    uint64_t before = allocCounterRead();
+    for (int width : order) {
+        kernel.run(wide.data, wide.step, output.data, output.step, width, wide.rows);
+    }
+    uint64_t allocations = allocCounterRead() - before;
+    if (allocations != 0) {
+        printf("FAILED: fused kernel at alternating widths: %llu heap allocations\n",
+               (unsigned long long)allocations);
+        passed = false;
+    }
+
+    printf("Allocation checks: %s\n", passed ? "none in steady state" : "FAILED");
+    return passed;
+}
+
+int main(void) {
+    bool passed = check_fused();
+    passed      = check_allocations() && passed;
+
+    printf("%s\n", passed ? "All pipeline checks passed" : "Pipeline checks FAILED");
+    return passed ? 0 : 1;
+}
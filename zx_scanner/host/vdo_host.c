@@ -0,0 +1,444 @@
+/**
+ * Host stand-in for the parts of VDO used by the Parkspass QR Scanner.
+ *
+ * Streams replay NV12 frames from a HostFrameSource at the configured frame
+ * rate. Buffers follow the explicit buffer strategy: the application
+ * allocates them, enqueues them and receives them back filled from
+ * vdo_stream_get_buffer(). A frame that falls due while no buffer is
+ * enqueued is dropped, which is what happens on a camera when the
+ * application holds on to too many buffers.
+ *
+ * If VDO_HOST_FRAME_LOG is set, every frame that falls due is recorded in
+ * that file, one per line, as
+ *
+ *   <monotonic us> <sequence number> delivered|dropped
+ *
+ * so that tools can tell when a frame was captured even if the application
+ * never saw it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "frame_source.h"
+#include "vdo-channel.h"
+#include "vdo-map.h"
+#include "vdo-stream.h"
+
+#define DEFAULT_FPS (30)
+#define DEFAULT_RESOLUTIONS "640x360,1280x720,1920x1080"
+#define BUFFER_WAIT_US (G_USEC_PER_SEC)
+
+static GQuark vdo_host_error_quark(void) {
+    return g_quark_from_static_string("vdo-host-error-quark");
+}
+#define VDO_HOST_ERROR (vdo_host_error_quark())
+
+static guint env_uint(const gchar* name, guint def) {
+    const gchar* value = g_getenv(name);
+    return (value && *value) ? (guint)g_ascii_strtoull(value, NULL, 10) : def;
+}
+
+// Flushed per line, the application may be killed at any time
+static void log_frame(FILE* log, guint sequenceNbr, gint64 time, gboolean delivered) {
+    if (log) {
+        fprintf(log, "%" G_GINT64_FORMAT " %u %s\n", time, sequenceNbr, delivered ? "delivered" : "dropped");
+        fflush(log);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * VdoMap
+ * ---------------------------------------------------------------------- */
+
+struct _VdoMap {
+    GObject parent;
+    GHashTable* entries;
+};
+
+G_DEFINE_TYPE(VdoMap, vdo_map, G_TYPE_OBJECT)
+
+static void vdo_map_finalize(GObject* object) {
+    g_hash_table_unref(VDO_MAP(object)->entries);
+    G_OBJECT_CLASS(vdo_map_parent_class)->finalize(object);
+}
+
+static void vdo_map_class_init(VdoMapClass* klass) {
+    G_OBJECT_CLASS(klass)->finalize = vdo_map_finalize;
+}
+
+static void vdo_map_init(VdoMap* self) {
+    self->entries =
+        g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_variant_unref);
+}
+
+VdoMap* vdo_map_new(void) {
+    return g_object_new(VDO_TYPE_MAP, NULL);
+}
+
+gboolean vdo_map_contains(const VdoMap* self, const gchar* name) {
+    return g_hash_table_contains(self->entries, name);
+}
+
+void vdo_map_set_uint32(VdoMap* self, const gchar* name, guint32 value) {
+    g_hash_table_insert(self->entries, g_strdup(name), g_variant_ref_sink(g_variant_new_uint32(value)));
+}
+
+guint32 vdo_map_get_uint32(const VdoMap* self, const gchar* name, guint32 def) {
+    GVariant* value = g_hash_table_lookup(self->entries, name);
+    if (!value || !g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+        return def;
+    }
+    return g_variant_get_uint32(value);
+}
+
+void vdo_map_set_string(VdoMap* self, const gchar* name, const gchar* value) {
+    g_hash_table_insert(self->entries, g_strdup(name), g_variant_ref_sink(g_variant_new_string(value)));
+}
+
+const gchar* vdo_map_get_string(const VdoMap* self, const gchar* name, gsize* size, const gchar* def) {
+    GVariant* value = g_hash_table_lookup(self->entries, name);
+    if (!value || !g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+        if (size) {
+            *size = def ? strlen(def) : 0;
+        }
+        return def;
+    }
+    return g_variant_get_string(value, size);
+}
+
+void vdo_map_dump(const VdoMap* self) {
+    GList* keys = g_list_sort(g_hash_table_get_keys(self->entries), (GCompareFunc)g_strcmp0);
+    for (GList* key = keys; key; key = key->next) {
+        g_autofree gchar* text =
+            g_variant_print(g_hash_table_lookup(self->entries, key->data), FALSE);
+        syslog(LOG_INFO, "%s: %s", (const gchar*)key->data, text);
+    }
+    g_list_free(keys);
+}
+
+/* -------------------------------------------------------------------------
+ * VdoBuffer
+ * ---------------------------------------------------------------------- */
+
+struct _VdoBuffer {
+    GObject parent;
+    guint8* data;
+    gsize capacity;
+    gsize size;
+    gpointer opaque;
+    guint sequenceNbr;
+    guint64 timestamp;
+};
+
+G_DEFINE_TYPE(VdoBuffer, vdo_buffer, G_TYPE_OBJECT)
+
+static void vdo_buffer_finalize(GObject* object) {
+    g_free(VDO_BUFFER(object)->data);
+    G_OBJECT_CLASS(vdo_buffer_parent_class)->finalize(object);
+}
+
+static void vdo_buffer_class_init(VdoBufferClass* klass) {
+    G_OBJECT_CLASS(klass)->finalize = vdo_buffer_finalize;
+}
+
+static void vdo_buffer_init(VdoBuffer* self) {
+    (void)self;
+}
+
+gpointer vdo_buffer_get_data(VdoBuffer* buffer) {
+    return buffer->data;
+}
+
+gsize vdo_buffer_get_capacity(VdoBuffer* buffer) {
+    return buffer->capacity;
+}
+
+gpointer vdo_buffer_get_opaque(VdoBuffer* buffer) {
+    return buffer->opaque;
+}
+
+VdoFrame* vdo_buffer_get_frame(VdoBuffer* buffer) {
+    return buffer;
+}
+
+guint vdo_frame_get_sequence_nbr(VdoFrame* frame) {
+    return frame->sequenceNbr;
+}
+
+guint64 vdo_frame_get_timestamp(VdoFrame* frame) {
+    return frame->timestamp;
+}
+
+gsize vdo_frame_get_size(VdoFrame* frame) {
+    return frame->size;
+}
+
+/* -------------------------------------------------------------------------
+ * VdoStream
+ * ---------------------------------------------------------------------- */
+
+struct _VdoStream {
+    GObject parent;
+    VdoMap* settings;
+    guint width;
+    guint height;
+    guint pitch;
+    guint fps;
+
+    /// Buffers enqueued by the application and waiting to be filled.
+    GAsyncQueue* enqueued;
+
+    HostFrameSource* source;
+    FILE* frameLog;
+    gboolean running;
+    guint sequenceNbr;
+    gint64 nextDue;
+};
+
+G_DEFINE_TYPE(VdoStream, vdo_stream, G_TYPE_OBJECT)
+
+static void vdo_stream_finalize(GObject* object) {
+    VdoStream* self = VDO_STREAM(object);
+
+    vdo_stream_stop(self);
+    g_async_queue_unref(self->enqueued);
+    g_clear_object(&self->settings);
+    G_OBJECT_CLASS(vdo_stream_parent_class)->finalize(object);
+}
+
+static void vdo_stream_class_init(VdoStreamClass* klass) {
+    G_OBJECT_CLASS(klass)->finalize = vdo_stream_finalize;
+}
+
+static void vdo_stream_init(VdoStream* self) {
+    self->enqueued = g_async_queue_new();
+}
+
+VdoStream* vdo_stream_new(VdoMap* settings, VdoBufferFinalizer fin, GError** error) {
+    (void)fin;
+
+    guint format = vdo_map_get_uint32(settings, "format", VDO_FORMAT_YUV);
+    if (format != VDO_FORMAT_YUV) {
+        g_set_error(error, VDO_HOST_ERROR, 0, "Only VDO_FORMAT_YUV (NV12) is supported on host");
+        return NULL;
+    }
+
+    VdoStream* self = g_object_new(VDO_TYPE_STREAM, NULL);
+    self->settings  = g_object_ref(settings);
+    self->width     = vdo_map_get_uint32(settings, "width", 1280);
+    self->height    = vdo_map_get_uint32(settings, "height", 720);
+    self->fps       = env_uint("VDO_HOST_FPS", vdo_map_get_uint32(settings, "framerate", DEFAULT_FPS));
+
+    // Camera buffers are usually padded, allow the same on host so that
+    // stride handling is exercised.
+    guint align = MAX(env_uint("VDO_HOST_PITCH_ALIGN", 1), 1);
+    self->pitch = (self->width + align - 1) / align * align;
+
+    return self;
+}
+
+VdoMap* vdo_stream_get_info(VdoStream* self, GError** error) {
+    (void)error;
+
+    VdoMap* info = vdo_map_new();
+    vdo_map_set_uint32(info, "format", VDO_FORMAT_YUV);
+    vdo_map_set_uint32(info, "width", self->width);
+    vdo_map_set_uint32(info, "height", self->height);
+    vdo_map_set_uint32(info, "pitch", self->pitch);
+    vdo_map_set_uint32(info, "framerate", self->fps);
+    return info;
+}
+
+gboolean vdo_stream_start(VdoStream* self, GError** error) {
+    const gchar* path = g_getenv("VDO_HOST_SOURCE");
+    if (!path || !*path) {
+        g_set_error(error, VDO_HOST_ERROR, 0, "VDO_HOST_SOURCE is not set");
+        return FALSE;
+    }
+
+    self->source = host_frame_source_open(path,
+                                          self->width,
+                                          self->height,
+                                          env_uint("VDO_HOST_LOOP", 1) != 0,
+                                          error);
+    if (!self->source) {
+        return FALSE;
+    }
+
+    syslog(LOG_INFO,
+           "Replaying %s as %ux%u NV12 (pitch %u) at %u fps",
+           path,
+           self->width,
+           self->height,
+           self->pitch,
+           self->fps);
+
+    const gchar* log = g_getenv("VDO_HOST_FRAME_LOG");
+    if (log && *log && !(self->frameLog = fopen(log, "w"))) {
+        syslog(LOG_WARNING, "Cannot write frame log %s", log);
+    }
+
+    self->running = TRUE;
+    self->nextDue = g_get_monotonic_time();
+    return TRUE;
+}
+
+void vdo_stream_stop(VdoStream* self) {
+    self->running = FALSE;
+    if (self->source) {
+        host_frame_source_close(self->source);
+        self->source = NULL;
+    }
+    if (self->frameLog) {
+        fclose(self->frameLog);
+        self->frameLog = NULL;
+    }
+}
+
+VdoBuffer* vdo_stream_buffer_alloc(VdoStream* self, gpointer opaque, GError** error) {
+    (void)error;
+
+    VdoBuffer* buffer = g_object_new(VDO_TYPE_BUFFER, NULL);
+    buffer->capacity  = (gsize)self->pitch * self->height * 3 / 2;
+    buffer->data      = g_malloc0(buffer->capacity);
+    buffer->opaque    = opaque;
+    return buffer;
+}
+
+gboolean vdo_stream_buffer_enqueue(VdoStream* self, VdoBuffer* buffer, GError** error) {
+    if (!buffer) {
+        g_set_error(error, VDO_HOST_ERROR, 0, "Cannot enqueue a NULL buffer");
+        return FALSE;
+    }
+    g_async_queue_push(self->enqueued, buffer);
+    return TRUE;
+}
+
+gboolean vdo_stream_buffer_unref(VdoStream* self, VdoBuffer** buffer, GError** error) {
+    (void)self;
+    (void)error;
+
+    g_clear_object(buffer);
+    return TRUE;
+}
+
+VdoBuffer* vdo_stream_get_buffer(VdoStream* self, GError** error) {
+    if (!self->running) {
+        g_set_error(error, VDO_HOST_ERROR, 0, "Stream is not running");
+        return NULL;
+    }
+
+    VdoBuffer* buffer = NULL;
+    if (self->fps == 0) {
+        // Unthrottled replay, deliver as soon as a buffer is available.
+        buffer = g_async_queue_timeout_pop(self->enqueued, BUFFER_WAIT_US);
+    } else {
+        const gint64 period   = G_USEC_PER_SEC / self->fps;
+        const gint64 deadline = g_get_monotonic_time() + BUFFER_WAIT_US;
+
+        while (!buffer) {
+            gint64 now = g_get_monotonic_time();
+            if (now < self->nextDue) {
+                g_usleep(self->nextDue - now);
+            } else if (now >= self->nextDue + period) {
+                // The caller was late, skip the frames a camera would
+                // have captured in the meantime.
+                guint missed = (guint)((now - self->nextDue) / period);
+                if (!host_frame_source_skip(self->source, missed, error)) {
+                    return NULL;
+                }
+                for (guint i = 0; i < missed; i++) {
+                    log_frame(self->frameLog, self->sequenceNbr + i, self->nextDue + (gint64)i * period, FALSE);
+                }
+                self->sequenceNbr += missed;
+                self->nextDue += (gint64)missed * period;
+            }
+            self->nextDue += period;
+
+            buffer = g_async_queue_try_pop(self->enqueued);
+            if (!buffer) {
+                // No buffer to capture into, this frame is lost.
+                log_frame(self->frameLog, self->sequenceNbr, self->nextDue - period, FALSE);
+                self->sequenceNbr++;
+                if (!host_frame_source_skip(self->source, 1, error)) {
+                    return NULL;
+                }
+                if (g_get_monotonic_time() > deadline) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!buffer) {
+        g_set_error(error, VDO_HOST_ERROR, 0, "No buffer enqueued by the application");
+        return NULL;
+    }
+
+    buffer->timestamp   = (guint64)g_get_monotonic_time();
+    buffer->sequenceNbr = self->sequenceNbr++;
+    buffer->size        = buffer->capacity;
+    if (!host_frame_source_read(self->source, buffer->data, self->pitch, error)) {
+        // Keep the buffer with VDO and give the caller a frame period to
+        // notice that the source is exhausted.
+        g_async_queue_push_front(self->enqueued, buffer);
+        g_usleep(self->fps ? G_USEC_PER_SEC / self->fps : 1000);
+        return NULL;
+    }
+    log_frame(self->frameLog, buffer->sequenceNbr, (gint64)buffer->timestamp, TRUE);
+
+    return g_object_ref(buffer);
+}
+
+/* -------------------------------------------------------------------------
+ * VdoChannel
+ * ---------------------------------------------------------------------- */
+
+struct _VdoChannel {
+    GObject parent;
+    guint nbr;
+};
+
+G_DEFINE_TYPE(VdoChannel, vdo_channel, G_TYPE_OBJECT)
+
+static void vdo_channel_class_init(VdoChannelClass* klass) {
+    (void)klass;
+}
+
+static void vdo_channel_init(VdoChannel* self) {
+    (void)self;
+}
+
+VdoChannel* vdo_channel_get(guint nbr, GError** error) {
+    (void)error;
+
+    VdoChannel* self = g_object_new(VDO_TYPE_CHANNEL, NULL);
+    self->nbr        = nbr;
+    return self;
+}
+
+VdoResolutionSet* vdo_channel_get_resolutions(VdoChannel* self, VdoMap* filter, GError** error) {
+    (void)self;
+    (void)filter;
+
+    const gchar* list = g_getenv("VDO_HOST_RESOLUTIONS");
+    g_auto(GStrv) items = g_strsplit((list && *list) ? list : DEFAULT_RESOLUTIONS, ",", -1);
+
+    VdoResolutionSet* set =
+        g_malloc0(sizeof(VdoResolutionSet) + g_strv_length(items) * sizeof(VdoResolution));
+    for (gchar** item = items; *item; item++) {
+        guint width = 0, height = 0;
+        if (sscanf(*item, "%ux%u", &width, &height) != 2 || !width || !height) {
+            g_set_error(error, VDO_HOST_ERROR, 0, "Bad resolution '%s' in VDO_HOST_RESOLUTIONS", *item);
+            g_free(set);
+            return NULL;
+        }
+        set->resolutions[set->count].width  = width;
+        set->resolutions[set->count].height = height;
+        set->count++;
+    }
+    return set;
+}